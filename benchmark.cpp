@@ -0,0 +1,1264 @@
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPaintEvent>
+#include <QTemporaryDir>
+#include <QtMath>
+#include <QWindow>
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include "examplewidget.h"
+#include "cube.h"
+#include "rhiwidgetcapture.h"
+#include "rhiwidgetformats_p.h"
+
+// Headless benchmarks for QRhiWidget. By default this runs with the offscreen
+// platform plugin and the Null backend, which measures the overhead of the
+// widget itself. Pass --backend to run with a real graphics API, for example
+// software OpenGL (QT_OPENGL=software, or Mesa's llvmpipe) or Vulkan (with
+// lavapipe), to get end-to-end numbers. Results are printed as JSON.
+//
+// Scenarios that need the top-level window to composite QRhiWidgets are
+// reported as skipped when the platform plugin does not support that. The
+// grab scenarios use the widget's dedicated offscreen QRhi and always run.
+
+// Counts allocations, to verify that rendering an unchanged frame does not
+// allocate. With glibc, malloc(), calloc(), realloc(), and the aligned
+// allocation functions are replaced, which covers Qt's containers as well as
+// operator new, as that allocates with malloc() or aligned_alloc(). Elsewhere
+// only operator new (and so new[] as well) is counted.
+static QBasicAtomicInteger<qint64> allocationCount = Q_BASIC_ATOMIC_INITIALIZER(0);
+
+#if defined(__GLIBC__)
+extern "C" {
+void *__libc_malloc(std::size_t size);
+void *__libc_calloc(std::size_t count, std::size_t size);
+void *__libc_realloc(void *p, std::size_t size);
+void *__libc_memalign(std::size_t alignment, std::size_t size);
+
+void *malloc(std::size_t size) noexcept
+{
+    allocationCount.fetchAndAddRelaxed(1);
+    return __libc_malloc(size);
+}
+
+void *calloc(std::size_t count, std::size_t size) noexcept
+{
+    allocationCount.fetchAndAddRelaxed(1);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *p, std::size_t size) noexcept
+{
+    allocationCount.fetchAndAddRelaxed(1);
+    return __libc_realloc(p, size);
+}
+
+void *memalign(std::size_t alignment, std::size_t size) noexcept
+{
+    allocationCount.fetchAndAddRelaxed(1);
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(std::size_t alignment, std::size_t size) noexcept
+{
+    allocationCount.fetchAndAddRelaxed(1);
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **p, std::size_t alignment, std::size_t size) noexcept
+{
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0)
+        return EINVAL;
+    allocationCount.fetchAndAddRelaxed(1);
+    void *result = __libc_memalign(alignment, size);
+    if (!result && size)
+        return ENOMEM;
+    *p = result;
+    return 0;
+}
+}
+#else
+void *operator new(std::size_t size)
+{
+    allocationCount.fetchAndAddRelaxed(1);
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+#endif
+
+class BenchmarkWidget : public ExampleRhiWidget
+{
+public:
+    BenchmarkWidget(QRhiWidget::Api api, int sampleCount = 1)
+    {
+        setApi(api);
+        setDebugLayer(false);
+        setSampleCount(sampleCount);
+        setPipelineCacheFile(QString());
+    }
+
+    ~BenchmarkWidget()
+    {
+        stopRenderThread();
+    }
+
+    void initialize(QRhi *rhi, QRhiTexture *outputTexture) override
+    {
+        initializeCount.fetchAndAddRelaxed(1);
+        ExampleRhiWidget::initialize(rhi, outputTexture);
+    }
+
+    void render(QRhiCommandBuffer *cb) override
+    {
+        renderCount.fetchAndAddRelaxed(1);
+        ExampleRhiWidget::render(cb);
+    }
+
+    bool needsRender() const override
+    {
+        return alwaysRender || ExampleRhiWidget::needsRender();
+    }
+
+    // renders a frame without going through the repaint manager and the
+    // backing store, which have allocations of their own
+    void paintFrame(QPaintEvent *e)
+    {
+        paintEvent(e);
+    }
+
+    // atomic, as these are incremented on the render thread with threaded rendering
+    QAtomicInt initializeCount;
+    QAtomicInt renderCount;
+    // for measuring frames that would otherwise be skipped as unchanged
+    bool alwaysRender = false;
+};
+
+class DiscardCaptureSink : public QRhiWidgetCaptureSink
+{
+public:
+    bool open(const QSize &, QRhiTexture::Format) override { return true; }
+    bool writeFrame(const uchar *, qsizetype, qint64) override
+    {
+        frames.fetchAndAddRelaxed(1);
+        return true;
+    }
+    void close() override { }
+
+    QAtomicInteger<qint64> frames;
+};
+
+struct Samples
+{
+    void add(qint64 nsecs) { values.push_back(nsecs); }
+    QJsonObject toJson() const;
+
+    std::vector<qint64> values;
+};
+
+QJsonObject Samples::toJson() const
+{
+    QJsonObject result;
+    result.insert(QLatin1String("iterations"), int(values.size()));
+    if (values.empty())
+        return result;
+
+    std::vector<qint64> sorted = values;
+    std::sort(sorted.begin(), sorted.end());
+    qint64 sum = 0;
+    for (qint64 v : sorted)
+        sum += v;
+    const size_t p99Index = qMin(sorted.size() - 1, (sorted.size() * 99) / 100);
+    result.insert(QLatin1String("minMs"), sorted.front() / 1000000.0);
+    result.insert(QLatin1String("avgMs"), sum / double(sorted.size()) / 1000000.0);
+    result.insert(QLatin1String("medianMs"), sorted[sorted.size() / 2] / 1000000.0);
+    result.insert(QLatin1String("p99Ms"), sorted[p99Index] / 1000000.0);
+    result.insert(QLatin1String("totalMs"), sum / 1000000.0);
+    return result;
+}
+
+class Benchmark
+{
+public:
+    Benchmark(QRhiWidget::Api api, int iterations, const QStringList &filters)
+        : api(api), iterations(iterations), filters(filters)
+    { }
+
+    void run();
+    QJsonArray results() const { return m_results; }
+
+    qint64 steadyStateAllocationCount = -1;
+
+private:
+    bool selected(const QString &name) const;
+    void report(const QString &name, QJsonObject result);
+    void skip(const QString &name, const QString &reason);
+    bool showWindow(QWidget *window, BenchmarkWidget *widget);
+
+    void paint(int sampleCount, const QSize &pixelSize = QSize(), const char *label = nullptr);
+    void resizeStorm(int resizeDelay);
+    void reparent();
+    void manyWidgets(int count, bool batched);
+    void grab(int size);
+    void grabAsync();
+    void capture(const QSize &pixelSize, const char *label);
+    void pipelineCache(bool warm);
+    void conversionKernels();
+    void steadyStateAllocations();
+    void instancing(int count, bool partialUpdates);
+    void geometry(ExampleGeometry::Quantization quantization);
+    void textChange(ExampleRhiWidget::TextRendering mode);
+    void perObjectUniforms(int count);
+    void paintUnchanged();
+    void adaptiveResolution();
+    void threadedGrab();
+    void threadedPaint();
+    void multiView(int count, bool singleWidget);
+
+    QRhiWidget::Api api;
+    int iterations;
+    QStringList filters;
+    QJsonArray m_results;
+};
+
+bool Benchmark::selected(const QString &name) const
+{
+    if (filters.isEmpty())
+        return true;
+    for (const QString &filter : filters) {
+        if (name.contains(filter))
+            return true;
+    }
+    return false;
+}
+
+void Benchmark::report(const QString &name, QJsonObject result)
+{
+    result.insert(QLatin1String("name"), name);
+    m_results.append(result);
+}
+
+void Benchmark::skip(const QString &name, const QString &reason)
+{
+    QJsonObject result;
+    result.insert(QLatin1String("name"), name);
+    result.insert(QLatin1String("skipped"), reason);
+    m_results.append(result);
+}
+
+static const char NO_COMPOSITION[] = "the platform does not composite QRhiWidget content";
+
+// Shows the window and renders a first frame. Returns false when the widget
+// did not get to render, which happens with platform plugins that do not
+// support QRhi-based composition for widgets.
+bool Benchmark::showWindow(QWidget *window, BenchmarkWidget *widget)
+{
+    window->show();
+    QElapsedTimer timer;
+    timer.start();
+    while (!window->windowHandle() || !window->windowHandle()->isExposed()) {
+        if (timer.elapsed() > 5000)
+            return false;
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+    }
+    QCoreApplication::processEvents();
+    widget->repaint();
+    // with threaded rendering the frame completes on the render thread
+    timer.restart();
+    while (widget->isThreadedRenderingEnabled() && widget->renderCount.loadRelaxed() == 0 && timer.elapsed() < 5000)
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+    return widget->renderCount.loadRelaxed() > 0;
+}
+
+// Without a pixel size, the texture follows the 512x512 widget, otherwise the
+// given size is set as the explicitSize.
+void Benchmark::paint(int sampleCount, const QSize &pixelSize, const char *label)
+{
+    const QString name = label ? QString::asprintf("paint_%dx_%s", sampleCount, label)
+                               : QString::asprintf("paint_%dx", sampleCount);
+    if (!selected(name))
+        return;
+
+    QWidget window;
+    window.resize(512, 512);
+    BenchmarkWidget *widget = new BenchmarkWidget(api, sampleCount);
+    widget->setParent(&window);
+    widget->setGeometry(0, 0, 512, 512);
+    if (!pixelSize.isEmpty())
+        widget->setExplicitSize(pixelSize);
+    if (!showWindow(&window, widget)) {
+        skip(name, QLatin1String(NO_COMPOSITION));
+        return;
+    }
+
+    for (int i = 0; i < 10; ++i)
+        widget->repaint();
+
+    Samples samples;
+    QElapsedTimer timer;
+    for (int i = 0; i < iterations; ++i) {
+        widget->setCubeRotation(i % 360);
+        timer.start();
+        widget->repaint();
+        samples.add(timer.nsecsElapsed());
+    }
+
+    QJsonObject result = samples.toJson();
+    result.insert(QLatin1String("width"), pixelSize.isEmpty() ? 512 : pixelSize.width());
+    result.insert(QLatin1String("height"), pixelSize.isEmpty() ? 512 : pixelSize.height());
+    result.insert(QLatin1String("requestedSampleCount"), sampleCount);
+    result.insert(QLatin1String("sampleCount"), widget->renderTarget() ? widget->renderTarget()->sampleCount() : 1);
+    report(name, result);
+}
+
+void Benchmark::resizeStorm(int resizeDelay)
+{
+    const QString name = resizeDelay > 0 ? QString::asprintf("resize_storm_delay_%dms", resizeDelay)
+                                         : QLatin1String("resize_storm");
+    if (!selected(name))
+        return;
+
+    QWidget window;
+    window.resize(1024, 1024);
+    BenchmarkWidget *widget = new BenchmarkWidget(api);
+    widget->setParent(&window);
+    widget->setGeometry(0, 0, 256, 256);
+    widget->setTextureResizeDelay(resizeDelay);
+    if (!showWindow(&window, widget)) {
+        skip(name, QLatin1String(NO_COMPOSITION));
+        return;
+    }
+
+    const int initializeCountBefore = widget->initializeCount.loadRelaxed();
+    const qint64 reallocationsBefore = widget->textureReallocationCount();
+    Samples samples;
+    QElapsedTimer timer;
+    QElapsedTimer total;
+    total.start();
+    for (int i = 0; i < iterations; ++i) {
+        // interactive resizing, no two consecutive sizes are the same
+        timer.start();
+        widget->resize(256 + (i * 7) % 512, 256 + (i * 13) % 512);
+        widget->repaint();
+        samples.add(timer.nsecsElapsed());
+    }
+
+    // let the deferred reallocation happen
+    if (resizeDelay > 0) {
+        QElapsedTimer settle;
+        settle.start();
+        while (settle.elapsed() < resizeDelay + 50)
+            QCoreApplication::processEvents(QEventLoop::AllEvents, 5);
+        widget->repaint();
+    }
+
+    QJsonObject result = samples.toJson();
+    result.insert(QLatin1String("settledMs"), total.nsecsElapsed() / 1000000.0);
+    result.insert(QLatin1String("initializeCalls"), widget->initializeCount.loadRelaxed() - initializeCountBefore);
+    const qint64 reallocationsAfter = widget->textureReallocationCount();
+    result.insert(QLatin1String("textureReallocationsBefore"), reallocationsBefore);
+    result.insert(QLatin1String("textureReallocationsAfter"), reallocationsAfter);
+    result.insert(QLatin1String("textureReallocations"), reallocationsAfter - reallocationsBefore);
+    report(name, result);
+}
+
+void Benchmark::reparent()
+{
+    const QString name = QLatin1String("reparent");
+    if (!selected(name))
+        return;
+
+    QWidget windows[2];
+    for (QWidget &w : windows)
+        w.resize(512, 512);
+    BenchmarkWidget *widget = new BenchmarkWidget(api);
+    widget->setParent(&windows[0]);
+    widget->setGeometry(0, 0, 512, 512);
+    windows[1].show();
+    if (!showWindow(&windows[0], widget)) {
+        skip(name, QLatin1String(NO_COMPOSITION));
+        return;
+    }
+
+    Samples samples;
+    QElapsedTimer timer;
+    for (int i = 0; i < iterations; ++i) {
+        timer.start();
+        widget->setParent(&windows[(i + 1) % 2]);
+        widget->setGeometry(0, 0, 512, 512);
+        widget->show();
+        widget->repaint();
+        samples.add(timer.nsecsElapsed());
+    }
+
+    QJsonObject result = samples.toJson();
+    result.insert(QLatin1String("initializeCalls"), widget->initializeCount.loadRelaxed());
+    report(name, result);
+}
+
+void Benchmark::manyWidgets(int count, bool batched)
+{
+    const QString name = QString::asprintf(batched ? "many_widgets_%d_batched" : "many_widgets_%d", count);
+    if (!selected(name))
+        return;
+
+    const int columns = qCeil(qSqrt(count));
+    const int widgetSize = 128;
+    QWidget window;
+    window.resize(columns * widgetSize, ((count + columns - 1) / columns) * widgetSize);
+    QList<BenchmarkWidget *> widgets;
+    for (int i = 0; i < count; ++i) {
+        BenchmarkWidget *widget = new BenchmarkWidget(api, 4);
+        widget->setParent(&window);
+        widget->setGeometry((i % columns) * widgetSize, (i / columns) * widgetSize, widgetSize, widgetSize);
+        widgets.append(widget);
+    }
+    QRhiWidget::setBatchedRendering(&window, batched);
+    if (!showWindow(&window, widgets.first())) {
+        skip(name, QLatin1String(NO_COMPOSITION));
+        return;
+    }
+
+    Samples samples;
+    QElapsedTimer timer;
+    for (int i = 0; i < iterations; ++i) {
+        for (BenchmarkWidget *widget : widgets)
+            widget->setCubeRotation(i % 360);
+        timer.start();
+        window.repaint();
+        samples.add(timer.nsecsElapsed());
+    }
+
+    const QRhiWidget::ResourcePoolStatistics pool = widgets.first()->resourcePoolStatistics();
+    QJsonObject result = samples.toJson();
+    result.insert(QLatin1String("widgetCount"), count);
+    result.insert(QLatin1String("batched"), batched);
+    result.insert(QLatin1String("textureBytes"), pool.textureBytes);
+    result.insert(QLatin1String("renderBufferBytes"), pool.renderBufferBytes);
+    result.insert(QLatin1String("sharedBytesSaved"), pool.sharedBytesSaved);
+    report(name, result);
+}
+
+void Benchmark::grab(int size)
+{
+    const QString imageName = QString::asprintf("grab_image_%d", size);
+    const QString intoName = QString::asprintf("grab_into_image_%d", size);
+    const QString rawName = QString::asprintf("grab_raw_%d", size);
+    const QString copyName = QString::asprintf("grab_image_copy_%d", size);
+    if (!selected(imageName) && !selected(intoName) && !selected(rawName) && !selected(copyName))
+        return;
+
+    // never shown, so this goes through the widget's own offscreen QRhi
+    BenchmarkWidget widget(api);
+    widget.resize(size, size);
+    widget.setExplicitSize(QSize(size, size));
+    if (widget.grabTexture().isNull()) {
+        skip(imageName, QLatin1String("grabTexture() failed"));
+        return;
+    }
+
+    const auto measure = [this](const QString &name, const std::function<void()> &f) {
+        if (!selected(name))
+            return;
+        Samples samples;
+        QElapsedTimer timer;
+        for (int i = 0; i < iterations; ++i) {
+            timer.start();
+            f();
+            samples.add(timer.nsecsElapsed());
+        }
+        report(name, samples.toJson());
+    };
+
+    measure(imageName, [&widget] { widget.grabTexture(); });
+    QImage image;
+    measure(intoName, [&widget, &image] { widget.grabTexture(&image); });
+    measure(rawName, [&widget] { widget.grabTextureData(); });
+    // how grabTexture() used to work: wrap the readback data, then copy()
+    measure(copyName, [&widget] {
+        const QRhiWidget::RawTextureData data = widget.grabTextureData();
+        const QImage wrapped(reinterpret_cast<const uchar *>(data.data.constData()),
+                             data.pixelSize.width(), data.pixelSize.height(),
+                             data.bytesPerLine, QImage::Format_RGBA8888);
+        const QImage image = wrapped.copy();
+        Q_UNUSED(image);
+    });
+}
+
+void Benchmark::grabAsync()
+{
+    const QString name = QLatin1String("grab_async_512");
+    if (!selected(name))
+        return;
+
+    QWidget window;
+    window.resize(512, 512);
+    BenchmarkWidget *widget = new BenchmarkWidget(api);
+    widget->setParent(&window);
+    widget->setGeometry(0, 0, 512, 512);
+    if (!showWindow(&window, widget)) {
+        skip(name, QLatin1String(NO_COMPOSITION));
+        return;
+    }
+
+    Samples samples;
+    QElapsedTimer timer;
+    for (int i = 0; i < iterations; ++i) {
+        timer.start();
+        QFuture<QImage> future = widget->grabTextureAsync();
+        widget->repaint();
+        future.waitForFinished();
+        samples.add(timer.nsecsElapsed());
+    }
+    report(name, samples.toJson());
+}
+
+// Streams every frame to a sink that discards it. "deliveredFps" counts the
+// frames that reached the sink over the time from the first frame until
+// stopCapture() has returned, which includes the sink catching up.
+void Benchmark::capture(const QSize &pixelSize, const char *label)
+{
+    const QString name = QString::asprintf("capture_%s", label);
+    if (!selected(name))
+        return;
+
+    QWidget window;
+    window.resize(512, 512);
+    BenchmarkWidget *widget = new BenchmarkWidget(api);
+    widget->setParent(&window);
+    widget->setGeometry(0, 0, 512, 512);
+    widget->setExplicitSize(pixelSize);
+    if (!showWindow(&window, widget)) {
+        skip(name, QLatin1String(NO_COMPOSITION));
+        return;
+    }
+
+    DiscardCaptureSink sink;
+    widget->startCapture(&sink);
+    Samples samples;
+    QElapsedTimer timer;
+    QElapsedTimer total;
+    total.start();
+    for (int i = 0; i < iterations; ++i) {
+        widget->setCubeRotation(i % 360);
+        timer.start();
+        widget->repaint();
+        samples.add(timer.nsecsElapsed());
+    }
+    widget->stopCapture();
+    const qint64 totalNsecs = total.nsecsElapsed();
+
+    QJsonObject result = samples.toJson();
+    result.insert(QLatin1String("width"), pixelSize.width());
+    result.insert(QLatin1String("height"), pixelSize.height());
+    result.insert(QLatin1String("capturedFrames"), sink.frames.loadRelaxed());
+    result.insert(QLatin1String("droppedFrames"), widget->droppedCaptureFrameCount());
+    result.insert(QLatin1String("deliveredFps"), sink.frames.loadRelaxed() / (totalNsecs / 1000000000.0));
+    report(name, result);
+}
+
+// Time to first frame for a widget with its own QRhi, with and without a
+// pipeline cache file from a previous run. The cache is only saved when the
+// QRhi allows retrieving its contents, "cacheFileBytes" shows if it did.
+void Benchmark::pipelineCache(bool warm)
+{
+    const QString name = warm ? QLatin1String("pipeline_cache_warm") : QLatin1String("pipeline_cache_cold");
+    if (!selected(name))
+        return;
+
+    QTemporaryDir dir;
+    const QString fileName = dir.filePath(QLatin1String("pipelines.bin"));
+    const int runs = qMin(iterations, 20);
+
+    const auto firstFrame = [this, &fileName] {
+        BenchmarkWidget widget(api);
+        widget.resize(256, 256);
+        widget.setExplicitSize(QSize(256, 256));
+        widget.setPipelineCacheFile(fileName);
+        QElapsedTimer timer;
+        timer.start();
+        widget.grabTexture();
+        return timer.nsecsElapsed();
+    };
+
+    if (warm)
+        firstFrame();
+
+    Samples samples;
+    for (int i = 0; i < runs; ++i) {
+        if (!warm)
+            QFile::remove(fileName);
+        samples.add(firstFrame());
+    }
+
+    QJsonObject result = samples.toJson();
+    result.insert(QLatin1String("cacheFileBytes"), QFileInfo(fileName).size());
+    report(name, result);
+}
+
+void Benchmark::conversionKernels()
+{
+    static const int PIXELS = 1024 * 1024;
+    std::vector<quint8> src(PIXELS * 16, 0x5a);
+    std::vector<quint8> dst(PIXELS * 16);
+
+    const auto measure = [this](const QString &name, const std::function<void()> &f) {
+        if (!selected(name))
+            return;
+        Samples samples;
+        QElapsedTimer timer;
+        for (int i = 0; i < iterations; ++i) {
+            timer.start();
+            f();
+            samples.add(timer.nsecsElapsed());
+        }
+        QJsonObject result = samples.toJson();
+        result.insert(QLatin1String("pixels"), PIXELS);
+        report(name, result);
+    };
+
+    using namespace QRhiWidgetFormats;
+    measure(QLatin1String("convert_rg8"), [&] {
+        convertRG8ToRGBX8888(dst.data(), src.data(), PIXELS);
+    });
+    measure(QLatin1String("convert_rg16"), [&] {
+        convertRG16ToRGBX64(reinterpret_cast<quint16 *>(dst.data()), reinterpret_cast<const quint16 *>(src.data()), PIXELS);
+    });
+    measure(QLatin1String("convert_r16f"), [&] {
+        convertR16FToRGBX16F(reinterpret_cast<quint16 *>(dst.data()), reinterpret_cast<const quint16 *>(src.data()), PIXELS);
+    });
+    measure(QLatin1String("convert_r32f"), [&] {
+        convertR32FToRGBX32F(reinterpret_cast<float *>(dst.data()), reinterpret_cast<const float *>(src.data()), PIXELS);
+    });
+    measure(QLatin1String("premultiply_8888"), [&] {
+        premultiply8888(dst.data(), PIXELS);
+    });
+}
+
+// Renders 1000 frames with nothing changing in between and counts the
+// allocations. The expected result is 0, see --check-allocations. The widget
+// is shown and painted through paintEvent(), with the QRhi of the window
+// when the platform composites QRhiWidget content. Otherwise a synchronous
+// grab gives the widget a dedicated QRhi, which its paint events then render
+// with, so that this runs headless as well. composited tells which it was.
+// The repaint manager and the backing store are left out, they have
+// allocations of their own.
+void Benchmark::steadyStateAllocations()
+{
+    const QString name = QLatin1String("steady_state_allocations");
+    if (!selected(name))
+        return;
+
+    QWidget window;
+    window.resize(512, 512);
+    BenchmarkWidget *widget = new BenchmarkWidget(api, 4);
+    widget->setParent(&window);
+    widget->setGeometry(0, 0, 512, 512);
+    widget->alwaysRender = true;
+    const bool composited = showWindow(&window, widget);
+    if (!composited && widget->grabTexture().isNull()) {
+        skip(name, QLatin1String("failed to render"));
+        return;
+    }
+
+    QPaintEvent e(widget->rect());
+    for (int i = 0; i < 10; ++i)
+        widget->paintFrame(&e);
+
+    static const int FRAMES = 1000;
+    const int renderCountBefore = widget->renderCount.loadRelaxed();
+    Samples samples;
+    samples.values.reserve(FRAMES);
+    QElapsedTimer timer;
+    const qint64 allocationsBefore = allocationCount.loadRelaxed();
+    for (int i = 0; i < FRAMES; ++i) {
+        timer.start();
+        widget->paintFrame(&e);
+        samples.add(timer.nsecsElapsed());
+    }
+    const qint64 allocations = allocationCount.loadRelaxed() - allocationsBefore;
+
+    if (widget->renderCount.loadRelaxed() - renderCountBefore != FRAMES) {
+        skip(name, QLatin1String("frames were not rendered"));
+        return;
+    }
+
+    steadyStateAllocationCount = allocations;
+    QJsonObject result = samples.toJson();
+    result.insert(QLatin1String("composited"), composited);
+    result.insert(QLatin1String("allocations"), allocations);
+    result.insert(QLatin1String("allocationsPerFrame"), allocations / double(FRAMES));
+    report(name, result);
+}
+
+// Frame time as a function of the instance count, either with nothing
+// changing or with 1% of the instances moving in every frame.
+void Benchmark::instancing(int count, bool partialUpdates)
+{
+    const QString name = QString::asprintf(partialUpdates ? "instancing_update_%d" : "instancing_%d", count);
+    if (!selected(name))
+        return;
+
+    QWidget window;
+    window.resize(512, 512);
+    BenchmarkWidget *widget = new BenchmarkWidget(api);
+    widget->setParent(&window);
+    widget->setGeometry(0, 0, 512, 512);
+    widget->setInstanceCount(count);
+    widget->alwaysRender = true;
+    if (!showWindow(&window, widget)) {
+        skip(name, QLatin1String(NO_COMPOSITION));
+        return;
+    }
+
+    const int changedPerFrame = qMax(1, count / 100);
+    const float scale = 1.0f / qCeil(std::cbrt(double(count)));
+    Samples samples;
+    QElapsedTimer timer;
+    for (int i = 0; i < iterations; ++i) {
+        timer.start();
+        if (partialUpdates) {
+            const int first = (i * changedPerFrame) % count;
+            for (int j = first; j < qMin(count, first + changedPerFrame); ++j) {
+                widget->setInstanceTransform(j, QVector3D(0, float(i % 10) * 0.01f, 0), scale * 0.35f,
+                                             QQuaternion::fromEulerAngles(0, float(i % 360), 0));
+            }
+        }
+        widget->repaint();
+        samples.add(timer.nsecsElapsed());
+    }
+
+    QJsonObject result = samples.toJson();
+    result.insert(QLatin1String("instanceCount"), count);
+    if (partialUpdates)
+        result.insert(QLatin1String("changedPerFrame"), changedPerFrame);
+    report(name, result);
+}
+
+// The cost of preparing the example's cube, and the resulting vertex sizes
+// and post-transform cache efficiency before and after.
+void Benchmark::geometry(ExampleGeometry::Quantization quantization)
+{
+    const QString name = quantization == ExampleGeometry::HalfFloatQuantization
+            ? QLatin1String("geometry_cube_half") : QLatin1String("geometry_cube");
+    if (!selected(name))
+        return;
+
+    ExampleGeometry::Statistics stats;
+    Samples samples;
+    QElapsedTimer timer;
+    for (int i = 0; i < iterations; ++i) {
+        timer.start();
+        ExampleGeometry::prepare(cube, cube + 36 * 3, 36, quantization, &stats);
+        samples.add(timer.nsecsElapsed());
+    }
+
+    QJsonObject result = samples.toJson();
+    result.insert(QLatin1String("vertexCountBefore"), stats.vertexCountBefore);
+    result.insert(QLatin1String("vertexCountAfter"), stats.vertexCountAfter);
+    result.insert(QLatin1String("bytesPerVertexBefore"), stats.bytesPerVertexBefore);
+    result.insert(QLatin1String("bytesPerVertexAfter"), stats.bytesPerVertexAfter);
+    result.insert(QLatin1String("totalBytesBefore"), stats.totalBytesBefore);
+    result.insert(QLatin1String("totalBytesAfter"), stats.totalBytesAfter);
+    result.insert(QLatin1String("acmrBefore"), stats.acmrBefore);
+    result.insert(QLatin1String("acmrAfter"), stats.acmrAfter);
+    report(name, result);
+}
+
+// The cost of a text change on the cube, typing a sentence one character at
+// a time, with the whole texture redrawn by QPainter on a worker thread or
+// with the glyph atlas.
+void Benchmark::textChange(ExampleRhiWidget::TextRendering mode)
+{
+    const QString name = mode == ExampleRhiWidget::PainterText
+            ? QLatin1String("text_change_painter") : QLatin1String("text_change_glyph_atlas");
+    if (!selected(name))
+        return;
+
+    QWidget window;
+    window.resize(512, 512);
+    BenchmarkWidget *widget = new BenchmarkWidget(api);
+    widget->setParent(&window);
+    widget->setGeometry(0, 0, 512, 512);
+    widget->setTextRendering(mode);
+    if (!showWindow(&window, widget)) {
+        skip(name, QLatin1String(NO_COMPOSITION));
+        return;
+    }
+
+    const QString sentence = QLatin1String("The quick brown fox jumps over the lazy dog. ");
+    const qint64 uploadedBefore = widget->textUploadBytes();
+    Samples samples;
+    QElapsedTimer timer;
+    for (int i = 0; i < iterations; ++i) {
+        timer.start();
+        widget->setCubeTextureText(sentence.left(i % sentence.size() + 1));
+        widget->repaint();
+        samples.add(timer.nsecsElapsed());
+    }
+
+    QJsonObject result = samples.toJson();
+    if (mode == ExampleRhiWidget::PainterText) {
+        // the changes above only measure the GUI thread, the texture is
+        // rasterized on the worker, where superseded changes are dropped
+        timer.start();
+        QRhiWidgetImageProducer *producer = widget->textureProducer();
+        while (producer->isBusy())
+            QCoreApplication::processEvents(QEventLoop::AllEvents, 1);
+        widget->repaint();
+        result.insert(QLatin1String("settleMs"), timer.nsecsElapsed() / 1000000.0);
+        const qint64 produced = producer->producedImageCount();
+        result.insert(QLatin1String("producedImageCount"), produced);
+        result.insert(QLatin1String("discardedImageCount"), producer->discardedImageCount());
+        result.insert(QLatin1String("workerMsPerImage"),
+                      produced ? producer->productionNsecs() / double(produced) / 1000000.0 : 0.0);
+
+        // the latency of a single change, from the change to the repaint
+        // that uploads its texture, with the worker idle in between
+        Samples settleSamples;
+        for (int i = 0; i < iterations; ++i) {
+            timer.start();
+            widget->setCubeTextureText(sentence.left(i % sentence.size() + 1));
+            widget->repaint();
+            while (producer->isBusy())
+                QCoreApplication::processEvents(QEventLoop::AllEvents, 1);
+            widget->repaint();
+            settleSamples.add(timer.nsecsElapsed());
+        }
+        result.insert(QLatin1String("settlePerChange"), settleSamples.toJson());
+    }
+    result.insert(QLatin1String("uploadedBytesPerChange"),
+                  (widget->textUploadBytes() - uploadedBefore) / double(iterations));
+    if (mode == ExampleRhiWidget::GlyphAtlasText) {
+        const ExampleGlyphAtlas::Statistics stats = widget->glyphAtlasStatistics();
+        result.insert(QLatin1String("atlasGlyphCount"), stats.glyphCount);
+        result.insert(QLatin1String("rasterizedGlyphCount"), stats.rasterizedGlyphCount);
+    }
+    report(name, result);
+}
+
+// Frame time with a draw call and individual uniform data per object, the
+// uniforms suballocated from the transient allocator in every frame. Compare
+// with instancing_N for the same count.
+void Benchmark::perObjectUniforms(int count)
+{
+    const QString name = QString::asprintf("per_object_uniforms_%d", count);
+    if (!selected(name))
+        return;
+
+    QWidget window;
+    window.resize(512, 512);
+    BenchmarkWidget *widget = new BenchmarkWidget(api);
+    widget->setParent(&window);
+    widget->setGeometry(0, 0, 512, 512);
+    widget->setInstanceCount(count);
+    widget->setPerObjectUniforms(true);
+    if (!showWindow(&window, widget)) {
+        skip(name, QLatin1String(NO_COMPOSITION));
+        return;
+    }
+
+    Samples samples;
+    QElapsedTimer timer;
+    for (int i = 0; i < iterations; ++i) {
+        timer.start();
+        widget->setCubeRotation(float(i % 360));
+        widget->repaint();
+        samples.add(timer.nsecsElapsed());
+    }
+
+    const QRhiWidgetTransientAllocator::Statistics stats = widget->transientAllocatorStatistics();
+    QJsonObject result = samples.toJson();
+    result.insert(QLatin1String("objectCount"), count);
+    result.insert(QLatin1String("blockCount"), stats.blockCount);
+    result.insert(QLatin1String("capacityBytes"), stats.capacityBytes);
+    result.insert(QLatin1String("allocatedBytesPerFrame"), stats.allocatedBytes);
+    result.insert(QLatin1String("paddingBytesPerFrame"), stats.paddingBytes);
+    report(name, result);
+}
+
+// Paint events with nothing changed, as caused by expose events or sibling
+// repaints, which skip rendering. Compare with paint_1x.
+void Benchmark::paintUnchanged()
+{
+    const QString name = QLatin1String("paint_unchanged");
+    if (!selected(name))
+        return;
+
+    QWidget window;
+    window.resize(512, 512);
+    BenchmarkWidget *widget = new BenchmarkWidget(api);
+    widget->setParent(&window);
+    widget->setGeometry(0, 0, 512, 512);
+    if (!showWindow(&window, widget)) {
+        skip(name, QLatin1String(NO_COMPOSITION));
+        return;
+    }
+
+    const int renderCountBefore = widget->renderCount.loadRelaxed();
+    const qint64 skippedBefore = widget->skippedFrameCount();
+    Samples samples;
+    QElapsedTimer timer;
+    for (int i = 0; i < iterations; ++i) {
+        timer.start();
+        widget->repaint();
+        samples.add(timer.nsecsElapsed());
+    }
+
+    QJsonObject result = samples.toJson();
+    result.insert(QLatin1String("renderCalls"), widget->renderCount.loadRelaxed() - renderCountBefore);
+    result.insert(QLatin1String("skippedFrames"), widget->skippedFrameCount() - skippedBefore);
+    report(name, result);
+}
+
+// Frames of a heavy scene with the target frame time set to half of what
+// they take at full resolution. Reports where the scale settled, how often it
+// changed, and the frame times once settled, compared to the first frames.
+void Benchmark::adaptiveResolution()
+{
+    const QString name = QLatin1String("adaptive_resolution");
+    if (!selected(name))
+        return;
+
+    QWidget window;
+    window.resize(1024, 1024);
+    BenchmarkWidget *widget = new BenchmarkWidget(api, 4);
+    widget->setParent(&window);
+    widget->setGeometry(0, 0, 1024, 1024);
+    widget->setInstanceCount(100000);
+    widget->alwaysRender = true;
+    if (!showWindow(&window, widget)) {
+        skip(name, QLatin1String(NO_COMPOSITION));
+        return;
+    }
+
+    QElapsedTimer timer;
+    Samples fullSamples;
+    for (int i = 0; i < 20; ++i) {
+        timer.start();
+        widget->repaint();
+        fullSamples.add(timer.nsecsElapsed());
+    }
+    std::vector<qint64> sorted = fullSamples.values;
+    std::sort(sorted.begin(), sorted.end());
+    const qreal targetMs = sorted[sorted.size() / 2] / 2000000.0;
+
+    int scaleChanges = 0;
+    QObject::connect(widget, &QRhiWidget::effectiveResolutionScaleChanged, widget, [&scaleChanges] { ++scaleChanges; });
+    widget->setTargetFrameTime(targetMs);
+    const int frames = qMax(iterations, 200);
+    Samples settledSamples;
+    for (int i = 0; i < frames; ++i) {
+        timer.start();
+        widget->repaint();
+        if (i >= frames / 2)
+            settledSamples.add(timer.nsecsElapsed());
+    }
+
+    QJsonObject result = settledSamples.toJson();
+    result.insert(QLatin1String("fullResolution"), fullSamples.toJson());
+    result.insert(QLatin1String("targetMs"), targetMs);
+    result.insert(QLatin1String("scale"), widget->effectiveResolutionScale());
+    result.insert(QLatin1String("scaleChanges"), scaleChanges);
+    report(name, result);
+}
+
+static const char NO_THREADED_RENDERING[] = "threaded rendering is not supported with OpenGL";
+
+// Synchronous grabs of a hidden widget rendering on its render thread, which
+// works without composition, and so with the offscreen platform too. Compare
+// with grab_image_N: the difference is the cost of the handoff between the
+// threads.
+void Benchmark::threadedGrab()
+{
+    const QString name = QLatin1String("threaded_grab_512");
+    if (!selected(name))
+        return;
+    if (api == QRhiWidget::OpenGL) {
+        skip(name, QLatin1String(NO_THREADED_RENDERING));
+        return;
+    }
+
+    BenchmarkWidget widget(api);
+    widget.setThreadedRendering(true);
+    widget.resize(512, 512);
+    widget.setExplicitSize(QSize(512, 512));
+    if (widget.grabTexture().isNull()) {
+        skip(name, QLatin1String("grabTexture() failed"));
+        return;
+    }
+
+    Samples samples;
+    QElapsedTimer timer;
+    for (int i = 0; i < iterations; ++i) {
+        widget.setCubeRotation(float(i % 360));
+        timer.start();
+        widget.grabTexture();
+        samples.add(timer.nsecsElapsed());
+    }
+    report(name, samples.toJson());
+}
+
+// The time the GUI thread spends in a paint event with threaded rendering,
+// which only synchronizes and starts the frame, and the latency until the
+// frame is handed back, taken from an asynchronous grab served by it.
+void Benchmark::threadedPaint()
+{
+    const QString name = QLatin1String("threaded_paint_512");
+    if (!selected(name))
+        return;
+    if (api == QRhiWidget::OpenGL) {
+        skip(name, QLatin1String(NO_THREADED_RENDERING));
+        return;
+    }
+
+    QWidget window;
+    window.resize(512, 512);
+    BenchmarkWidget *widget = new BenchmarkWidget(api);
+    widget->setThreadedRendering(true);
+    widget->setParent(&window);
+    widget->setGeometry(0, 0, 512, 512);
+    widget->setInstanceCount(10000);
+    if (!showWindow(&window, widget)) {
+        skip(name, QLatin1String(NO_COMPOSITION));
+        return;
+    }
+
+    Samples guiSamples;
+    Samples latencySamples;
+    QElapsedTimer timer;
+    for (int i = 0; i < iterations; ++i) {
+        widget->setCubeRotation(float(i % 360));
+        timer.start();
+        QFuture<QImage> future = widget->grabTextureAsync();
+        widget->repaint();
+        guiSamples.add(timer.nsecsElapsed());
+        // the frame is handed back via the event loop
+        while (!future.isFinished())
+            QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+        latencySamples.add(timer.nsecsElapsed());
+    }
+
+    QJsonObject result = guiSamples.toJson();
+    result.insert(QLatin1String("latency"), latencySamples.toJson());
+    result.insert(QLatin1String("frames"), widget->renderCount.loadRelaxed());
+    report(name, result);
+}
+
+void Benchmark::run()
+{
+    for (int sampleCount : { 1, 4, 8 }) {
+        paint(sampleCount);
+        paint(sampleCount, QSize(1920, 1080), "1080p");
+        paint(sampleCount, QSize(3840, 2160), "4k");
+    }
+    resizeStorm(0);
+    resizeStorm(100);
+    reparent();
+    for (int count : { 1, 16, 64 }) {
+        manyWidgets(count, false);
+        manyWidgets(count, true);
+    }
+    for (int size : { 256, 1024, 2048 })
+        grab(size);
+    grabAsync();
+    capture(QSize(512, 512), "512");
+    capture(QSize(1920, 1080), "1080p");
+    capture(QSize(3840, 2160), "4k");
+    pipelineCache(false);
+    pipelineCache(true);
+    conversionKernels();
+    steadyStateAllocations();
+    for (int count : { 1, 1000, 10000, 100000, 1000000 }) {
+        instancing(count, false);
+        instancing(count, true);
+    }
+    geometry(ExampleGeometry::NoQuantization);
+    geometry(ExampleGeometry::HalfFloatQuantization);
+    textChange(ExampleRhiWidget::PainterText);
+    textChange(ExampleRhiWidget::GlyphAtlasText);
+    for (int count : { 1000, 10000 })
+        perObjectUniforms(count);
+    paintUnchanged();
+    adaptiveResolution();
+    threadedGrab();
+    threadedPaint();
+    for (int count : { 4, 16 }) {
+        multiView(count, false);
+        multiView(count, true);
+    }
+}
+
+// N camera views of the same scene, in a 512x512 area of the window, either
+// as N widgets with a texture, a frame, and scene resources each, or as one
+// widget with a view layout rendering all of them in a single pass.
+void Benchmark::multiView(int count, bool singleWidget)
+{
+    const QString name = QString::asprintf(singleWidget ? "multi_view_%d_views" : "multi_view_%d_widgets", count);
+    if (!selected(name))
+        return;
+
+    const int columns = qCeil(qSqrt(count));
+    const int rows = (count + columns - 1) / columns;
+    const int size = 512;
+    QWidget window;
+    window.resize(size, size);
+    QList<BenchmarkWidget *> widgets;
+    if (singleWidget) {
+        BenchmarkWidget *widget = new BenchmarkWidget(api);
+        widget->setParent(&window);
+        widget->setGeometry(0, 0, size, size);
+        widget->setViewGrid(columns, rows);
+        widgets.append(widget);
+    } else {
+        for (int i = 0; i < count; ++i) {
+            BenchmarkWidget *widget = new BenchmarkWidget(api);
+            widget->setParent(&window);
+            widget->setGeometry((i % columns) * size / columns, (i / columns) * size / rows,
+                                size / columns, size / rows);
+            widgets.append(widget);
+        }
+    }
+    if (!showWindow(&window, widgets.first())) {
+        skip(name, QLatin1String(NO_COMPOSITION));
+        return;
+    }
+
+    Samples samples;
+    QElapsedTimer timer;
+    for (int i = 0; i < iterations; ++i) {
+        timer.start();
+        for (BenchmarkWidget *widget : widgets)
+            widget->setCubeRotation(i % 360);
+        window.repaint();
+        samples.add(timer.nsecsElapsed());
+    }
+
+    const QRhiWidget::ResourcePoolStatistics pool = widgets.first()->resourcePoolStatistics();
+    QJsonObject result = samples.toJson();
+    result.insert(QLatin1String("viewCount"), count);
+    result.insert(QLatin1String("widgetCount"), int(widgets.size()));
+    result.insert(QLatin1String("textureBytes"), pool.textureBytes);
+    result.insert(QLatin1String("renderBufferBytes"), pool.renderBufferBytes);
+    report(name, result);
+}
+
+static bool apiFromString(const QString &s, QRhiWidget::Api *api)
+{
+    if (s == QLatin1String("null"))
+        *api = QRhiWidget::Null;
+    else if (s == QLatin1String("opengl"))
+        *api = QRhiWidget::OpenGL;
+    else if (s == QLatin1String("vulkan"))
+        *api = QRhiWidget::Vulkan;
+    else if (s == QLatin1String("d3d11"))
+        *api = QRhiWidget::D3D11;
+    else if (s == QLatin1String("metal"))
+        *api = QRhiWidget::Metal;
+    else
+        return false;
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QLatin1String("QRhiWidget benchmarks, results are printed as JSON"));
+    parser.addHelpOption();
+    QCommandLineOption backendOption(QLatin1String("backend"),
+                                     QLatin1String("Graphics API: null, opengl, vulkan, d3d11, metal. Can be given multiple times."),
+                                     QLatin1String("api"), QLatin1String("null"));
+    parser.addOption(backendOption);
+    QCommandLineOption iterationsOption(QLatin1String("iterations"),
+                                        QLatin1String("Iterations per scenario."),
+                                        QLatin1String("count"), QLatin1String("100"));
+    parser.addOption(iterationsOption);
+    QCommandLineOption scenarioOption(QLatin1String("scenario"),
+                                      QLatin1String("Only run scenarios whose name contains the given text. Can be given multiple times."),
+                                      QLatin1String("text"));
+    parser.addOption(scenarioOption);
+    QCommandLineOption outputOption(QLatin1String("output"),
+                                    QLatin1String("Write the results to a file instead of stdout."),
+                                    QLatin1String("file"));
+    parser.addOption(outputOption);
+    QCommandLineOption checkAllocationsOption(QLatin1String("check-allocations"),
+                                              QLatin1String("Exit with an error when rendering unchanged frames allocates, or when that could not be checked."));
+    parser.addOption(checkAllocationsOption);
+    parser.process(app);
+
+    const int iterations = qMax(1, parser.value(iterationsOption).toInt());
+    QJsonArray runs;
+    bool allocationCheckFailed = false;
+    for (const QString &backend : parser.values(backendOption)) {
+        QRhiWidget::Api api;
+        if (!apiFromString(backend, &api)) {
+            qWarning("Unknown backend '%s'", qPrintable(backend));
+            return 1;
+        }
+        Benchmark benchmark(api, iterations, parser.values(scenarioOption));
+        benchmark.run();
+        if (parser.isSet(checkAllocationsOption)) {
+            if (benchmark.steadyStateAllocationCount < 0) {
+                qWarning("The allocations of the %s backend were not checked, steady_state_allocations did not run",
+                         qPrintable(backend));
+                allocationCheckFailed = true;
+            } else if (benchmark.steadyStateAllocationCount > 0) {
+                qWarning("Rendering unchanged frames with the %s backend made %lld allocations",
+                         qPrintable(backend), benchmark.steadyStateAllocationCount);
+                allocationCheckFailed = true;
+            }
+        }
+        QJsonObject run;
+        run.insert(QLatin1String("backend"), backend);
+        run.insert(QLatin1String("results"), benchmark.results());
+        runs.append(run);
+    }
+
+    QJsonObject root;
+    root.insert(QLatin1String("qtVersion"), QLatin1String(qVersion()));
+    root.insert(QLatin1String("platform"), QGuiApplication::platformName());
+    root.insert(QLatin1String("iterations"), iterations);
+    root.insert(QLatin1String("runs"), runs);
+    const QByteArray json = QJsonDocument(root).toJson();
+
+    if (parser.isSet(outputOption)) {
+        QFile f(parser.value(outputOption));
+        if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            qWarning("Failed to open %s", qPrintable(f.fileName()));
+            return 1;
+        }
+        f.write(json);
+    } else {
+        fwrite(json.constData(), 1, json.size(), stdout);
+    }
+
+    if (parser.isSet(checkAllocationsOption) && allocationCheckFailed)
+        return 2;
+    return 0;
+}
@@ -0,0 +1,275 @@
+#include "examplegeometry.h"
+#include <QFloat16>
+#include <QHash>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+// Turns unindexed triangle lists with separate position and texture
+// coordinate arrays into indexed, interleaved geometry: identical vertices
+// are merged, the triangles are reordered for the post-transform vertex cache
+// (Tom Forsyth, "Linear-Speed Vertex Cache Optimisation"), the vertices are
+// then ordered by first use for locality of vertex fetches, and the
+// attributes can optionally be stored as half floats.
+
+namespace ExampleGeometry {
+
+namespace {
+
+struct Vertex {
+    float position[3];
+    float texcoord[2];
+
+    bool operator==(const Vertex &other) const
+    {
+        return std::memcmp(this, &other, sizeof(Vertex)) == 0;
+    }
+};
+
+size_t qHash(const Vertex &v, size_t seed = 0)
+{
+    return qHashBits(&v, sizeof(Vertex), seed);
+}
+
+} // namespace
+
+static const int FORSYTH_CACHE_SIZE = 32;
+
+static float forsythVertexScore(int cachePosition, int remainingTriangles)
+{
+    if (remainingTriangles == 0)
+        return -1.0f;
+
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        if (cachePosition < 3) {
+            // the vertices of the last triangle, deliberately not the highest
+            // score so that the next triangle is not the same strip direction
+            score = 0.75f;
+        } else {
+            const float scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+            score = std::pow(1.0f - (cachePosition - 3) * scaler, 1.5f);
+        }
+    }
+    // prefer vertices with few triangles left, to get rid of lone triangles
+    score += 2.0f * std::pow(float(remainingTriangles), -0.5f);
+    return score;
+}
+
+static std::vector<quint32> optimizeVertexCache(const std::vector<quint32> &indices, int vertexCount)
+{
+    const int triangleCount = int(indices.size() / 3);
+    std::vector<int> remaining(vertexCount, 0);
+    for (quint32 i : indices)
+        ++remaining[i];
+
+    // triangles using each vertex, in one array
+    std::vector<int> adjacencyOffset(vertexCount + 1, 0);
+    for (int v = 0; v < vertexCount; ++v)
+        adjacencyOffset[v + 1] = adjacencyOffset[v] + remaining[v];
+    std::vector<int> adjacency(indices.size());
+    std::vector<int> adjacencyCount(vertexCount, 0);
+    for (int t = 0; t < triangleCount; ++t) {
+        for (int k = 0; k < 3; ++k) {
+            const quint32 v = indices[t * 3 + k];
+            adjacency[adjacencyOffset[v] + adjacencyCount[v]++] = t;
+        }
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScore(vertexCount);
+    for (int v = 0; v < vertexCount; ++v)
+        vertexScore[v] = forsythVertexScore(-1, remaining[v]);
+
+    std::vector<bool> triangleAdded(triangleCount, false);
+    std::vector<float> triangleScore(triangleCount);
+    for (int t = 0; t < triangleCount; ++t)
+        triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+
+    std::vector<quint32> result;
+    result.reserve(indices.size());
+    std::vector<int> cache;
+    std::vector<int> newCache;
+    int bestTriangle = -1;
+
+    for (int n = 0; n < triangleCount; ++n) {
+        if (bestTriangle < 0) {
+            // nothing adjacent to the cache is left, fall back to a full scan
+            float bestScore = -1.0f;
+            for (int t = 0; t < triangleCount; ++t) {
+                if (!triangleAdded[t] && triangleScore[t] > bestScore) {
+                    bestScore = triangleScore[t];
+                    bestTriangle = t;
+                }
+            }
+        }
+
+        const int t = bestTriangle;
+        triangleAdded[t] = true;
+        newCache.clear();
+        for (int k = 0; k < 3; ++k) {
+            const quint32 v = indices[t * 3 + k];
+            result.push_back(v);
+            newCache.push_back(int(v));
+            // drop the triangle from the vertex's list of remaining ones
+            int *begin = &adjacency[adjacencyOffset[v]];
+            int *end = begin + remaining[v];
+            std::iter_swap(std::find(begin, end, t), end - 1);
+            --remaining[v];
+        }
+        for (int v : cache) {
+            if (std::find(newCache.begin(), newCache.end(), v) == newCache.end())
+                newCache.push_back(v);
+        }
+
+        // update the vertices that are, or just dropped out of, the cache
+        for (size_t i = 0; i < newCache.size(); ++i) {
+            const int v = newCache[i];
+            cachePosition[v] = i < size_t(FORSYTH_CACHE_SIZE) ? int(i) : -1;
+            vertexScore[v] = forsythVertexScore(cachePosition[v], remaining[v]);
+        }
+
+        // rescore their triangles, the best one of these comes next
+        bestTriangle = -1;
+        float bestScore = -1.0f;
+        for (int v : newCache) {
+            for (int i = 0; i < remaining[v]; ++i) {
+                const int adjacent = adjacency[adjacencyOffset[v] + i];
+                const float score = vertexScore[indices[adjacent * 3]]
+                        + vertexScore[indices[adjacent * 3 + 1]]
+                        + vertexScore[indices[adjacent * 3 + 2]];
+                triangleScore[adjacent] = score;
+                if (score > bestScore) {
+                    bestScore = score;
+                    bestTriangle = adjacent;
+                }
+            }
+        }
+
+        if (newCache.size() > size_t(FORSYTH_CACHE_SIZE))
+            newCache.resize(FORSYTH_CACHE_SIZE);
+        cache.swap(newCache);
+    }
+
+    return result;
+}
+
+qreal averageCacheMissRatio(const quint32 *indices, int indexCount, int cacheSize)
+{
+    if (indexCount < 3)
+        return 0;
+
+    // a FIFO cache, as found in most GPUs
+    std::vector<quint32> fifo;
+    fifo.reserve(cacheSize + 1);
+    int misses = 0;
+    for (int i = 0; i < indexCount; ++i) {
+        if (std::find(fifo.begin(), fifo.end(), indices[i]) == fifo.end()) {
+            ++misses;
+            fifo.push_back(indices[i]);
+            if (int(fifo.size()) > cacheSize)
+                fifo.erase(fifo.begin());
+        }
+    }
+    return misses / qreal(indexCount / 3);
+}
+
+Mesh prepare(const float *positions, const float *texcoords, int vertexCount,
+             Quantization quantization, Statistics *stats)
+{
+    // merge identical vertices
+    std::vector<Vertex> vertices;
+    std::vector<quint32> indices;
+    indices.reserve(vertexCount);
+    QHash<Vertex, quint32> uniqueVertices;
+    for (int i = 0; i < vertexCount; ++i) {
+        Vertex v;
+        std::memcpy(v.position, positions + i * 3, sizeof(v.position));
+        std::memcpy(v.texcoord, texcoords + i * 2, sizeof(v.texcoord));
+        auto it = uniqueVertices.constFind(v);
+        if (it == uniqueVertices.constEnd()) {
+            it = uniqueVertices.insert(v, quint32(vertices.size()));
+            vertices.push_back(v);
+        }
+        indices.push_back(*it);
+    }
+
+    indices = optimizeVertexCache(indices, int(vertices.size()));
+
+    // renumber the vertices in the order the triangles first use them
+    std::vector<quint32> remap(vertices.size(), UINT_MAX);
+    std::vector<Vertex> orderedVertices;
+    orderedVertices.reserve(vertices.size());
+    for (quint32 &i : indices) {
+        if (remap[i] == UINT_MAX) {
+            remap[i] = quint32(orderedVertices.size());
+            orderedVertices.push_back(vertices[i]);
+        }
+        i = remap[i];
+    }
+
+    Mesh mesh;
+    mesh.vertexCount = int(orderedVertices.size());
+    mesh.indexCount = int(indices.size());
+    if (quantization == HalfFloatQuantization) {
+        // 4 components for the position, keeping the texture coordinates aligned
+        mesh.positionFormat = QRhiVertexInputAttribute::Half4;
+        mesh.texcoordFormat = QRhiVertexInputAttribute::Half2;
+        mesh.texcoordOffset = 4 * sizeof(qfloat16);
+        mesh.stride = 6 * sizeof(qfloat16);
+    } else {
+        mesh.positionFormat = QRhiVertexInputAttribute::Float3;
+        mesh.texcoordFormat = QRhiVertexInputAttribute::Float2;
+        mesh.texcoordOffset = 3 * sizeof(float);
+        mesh.stride = 5 * sizeof(float);
+    }
+
+    mesh.vertexData.resize(mesh.vertexCount * mesh.stride);
+    char *p = mesh.vertexData.data();
+    for (const Vertex &v : orderedVertices) {
+        if (quantization == HalfFloatQuantization) {
+            const qfloat16 h[6] = {
+                qfloat16(v.position[0]), qfloat16(v.position[1]), qfloat16(v.position[2]), qfloat16(1.0f),
+                qfloat16(v.texcoord[0]), qfloat16(v.texcoord[1])
+            };
+            std::memcpy(p, h, sizeof(h));
+        } else {
+            std::memcpy(p, v.position, sizeof(v.position));
+            std::memcpy(p + sizeof(v.position), v.texcoord, sizeof(v.texcoord));
+        }
+        p += mesh.stride;
+    }
+
+    if (mesh.vertexCount <= 0xFFFF) {
+        mesh.indexFormat = QRhiCommandBuffer::IndexUInt16;
+        mesh.indexData.resize(mesh.indexCount * sizeof(quint16));
+        quint16 *dst = reinterpret_cast<quint16 *>(mesh.indexData.data());
+        for (quint32 i : indices)
+            *dst++ = quint16(i);
+    } else {
+        mesh.indexFormat = QRhiCommandBuffer::IndexUInt32;
+        mesh.indexData.resize(mesh.indexCount * sizeof(quint32));
+        std::memcpy(mesh.indexData.data(), indices.data(), mesh.indexData.size());
+    }
+
+    if (stats) {
+        // unindexed, every vertex is transformed, the ratio is always 3
+        std::vector<quint32> unindexed(vertexCount);
+        for (int i = 0; i < vertexCount; ++i)
+            unindexed[i] = quint32(i);
+        stats->vertexCountBefore = vertexCount;
+        stats->vertexCountAfter = mesh.vertexCount;
+        stats->bytesPerVertexBefore = 5 * sizeof(float);
+        stats->bytesPerVertexAfter = int(mesh.stride);
+        stats->totalBytesBefore = vertexCount * stats->bytesPerVertexBefore;
+        stats->totalBytesAfter = int(mesh.vertexData.size() + mesh.indexData.size());
+        stats->acmrBefore = averageCacheMissRatio(unindexed.data(), vertexCount);
+        stats->acmrAfter = averageCacheMissRatio(indices.data(), mesh.indexCount);
+    }
+
+    return mesh;
+}
+
+} // namespace ExampleGeometry
@@ -0,0 +1,43 @@
+#ifndef EXAMPLEGEOMETRY_H
+#define EXAMPLEGEOMETRY_H
+
+#include <QtGui/private/qrhi_p.h>
+
+namespace ExampleGeometry {
+
+enum Quantization {
+    NoQuantization,
+    HalfFloatQuantization
+};
+
+struct Mesh {
+    QByteArray vertexData;
+    QByteArray indexData;
+    quint32 stride = 0;
+    quint32 texcoordOffset = 0;
+    QRhiVertexInputAttribute::Format positionFormat = QRhiVertexInputAttribute::Float3;
+    QRhiVertexInputAttribute::Format texcoordFormat = QRhiVertexInputAttribute::Float2;
+    QRhiCommandBuffer::IndexFormat indexFormat = QRhiCommandBuffer::IndexUInt16;
+    int vertexCount = 0;
+    int indexCount = 0;
+};
+
+struct Statistics {
+    int vertexCountBefore = 0;
+    int vertexCountAfter = 0;
+    int bytesPerVertexBefore = 0;
+    int bytesPerVertexAfter = 0;
+    int totalBytesBefore = 0;
+    int totalBytesAfter = 0;
+    qreal acmrBefore = 0;
+    qreal acmrAfter = 0;
+};
+
+Mesh prepare(const float *positions, const float *texcoords, int vertexCount,
+             Quantization quantization, Statistics *stats = nullptr);
+
+qreal averageCacheMissRatio(const quint32 *indices, int indexCount, int cacheSize = 16);
+
+} // namespace ExampleGeometry
+
+#endif
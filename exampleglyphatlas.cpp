@@ -0,0 +1,150 @@
+#include "exampleglyphatlas.h"
+#include <QGlyphRun>
+#include <QPainter>
+#include <QTextLayout>
+
+void ExampleGlyphAtlas::create(QRhi *rhi)
+{
+    m_texture.reset(rhi->newTexture(QRhiTexture::R8, QSize(ATLAS_SIZE, ATLAS_SIZE)));
+    m_texture->create();
+    reset();
+    m_stats = Statistics();
+}
+
+void ExampleGlyphAtlas::reset()
+{
+    m_fonts.clear();
+    m_glyphs.clear();
+    m_shelfPos = QPoint(0, 0);
+    m_shelfHeight = 0;
+    m_stats.glyphCount = 0;
+    ++m_stats.resetCount;
+}
+
+// Glyphs are packed left to right into shelves as tall as the tallest glyph
+// on them. There is no eviction of individual glyphs, once the atlas is full
+// it starts over.
+bool ExampleGlyphAtlas::findOrAddGlyph(const QRawFont &font, quint32 glyphIndex,
+                                       QRhiResourceUpdateBatch *u, Glyph *glyph)
+{
+    qsizetype fontIndex = m_fonts.indexOf(font);
+    if (fontIndex < 0) {
+        fontIndex = m_fonts.size();
+        m_fonts.append(font);
+    }
+    const quint64 key = (quint64(fontIndex) << 32) | glyphIndex;
+    auto it = m_glyphs.constFind(key);
+    if (it != m_glyphs.constEnd()) {
+        *glyph = *it;
+        return true;
+    }
+
+    const QRectF glyphBounds = font.boundingRect(glyphIndex);
+    if (glyphBounds.isEmpty()) {
+        // whitespace, nothing to draw
+        *glyph = Glyph();
+        m_glyphs.insert(key, *glyph);
+        m_stats.glyphCount = int(m_glyphs.size());
+        return true;
+    }
+
+    // one pixel of transparent border, and rows padded to 4 bytes, which is
+    // the unpack alignment all backends handle for tightly packed data
+    const QRect bounds = glyphBounds.toAlignedRect().adjusted(-1, -1, 1, 1);
+    const int stride = (bounds.width() + 3) & ~3;
+    if (m_shelfPos.x() + stride > ATLAS_SIZE) {
+        m_shelfPos = QPoint(0, m_shelfPos.y() + m_shelfHeight);
+        m_shelfHeight = 0;
+    }
+    if (stride > ATLAS_SIZE || m_shelfPos.y() + bounds.height() > ATLAS_SIZE)
+        return false;
+
+    QImage image(stride, bounds.height(), QImage::Format_Alpha8);
+    image.fill(0);
+    QPainter p(&image);
+    QGlyphRun run;
+    run.setRawFont(font);
+    run.setGlyphIndexes({ glyphIndex });
+    run.setPositions({ QPointF(-bounds.x(), -bounds.y()) });
+    p.drawGlyphRun(QPointF(0, 0), run);
+    p.end();
+
+    const QByteArray data(reinterpret_cast<const char *>(image.constBits()), image.sizeInBytes());
+    QRhiTextureSubresourceUploadDescription desc(data);
+    desc.setSourceSize(image.size());
+    desc.setDestinationTopLeft(m_shelfPos);
+    u->uploadTexture(m_texture.data(), QRhiTextureUploadDescription({ 0, 0, desc }));
+
+    glyph->atlasRect = QRect(m_shelfPos, bounds.size());
+    glyph->offset = bounds.topLeft();
+    m_glyphs.insert(key, *glyph);
+
+    m_shelfPos.rx() += stride;
+    m_shelfHeight = qMax(m_shelfHeight, bounds.height());
+
+    m_stats.glyphCount = int(m_glyphs.size());
+    ++m_stats.rasterizedGlyphCount;
+    m_stats.uploadedBytes += data.size();
+    return true;
+}
+
+int ExampleGlyphAtlas::layoutText(const QString &text, const QFont &font, QRhiResourceUpdateBatch *u,
+                                  std::vector<Vertex> *vertices)
+{
+    QString s = text;
+    s.replace(QLatin1Char('\n'), QChar::LineSeparator);
+    QTextLayout layout(s, font);
+    QTextOption option;
+    option.setWrapMode(QTextOption::NoWrap);
+    layout.setTextOption(option);
+    layout.beginLayout();
+    qreal y = 0;
+    for (QTextLine line = layout.createLine(); line.isValid(); line = layout.createLine()) {
+        line.setPosition(QPointF(0, y));
+        y += line.height();
+    }
+    layout.endLayout();
+    const QList<QGlyphRun> runs = layout.glyphRuns();
+
+    const float scale = 1.0f / ATLAS_SIZE;
+    bool restarted = false;
+    int glyphCount = 0;
+    vertices->clear();
+    for (int r = 0; r < runs.size(); ++r) {
+        const QRawFont rawFont = runs[r].rawFont();
+        const QList<quint32> indexes = runs[r].glyphIndexes();
+        const QList<QPointF> positions = runs[r].positions();
+        for (int i = 0; i < indexes.size(); ++i) {
+            Glyph g;
+            if (!findOrAddGlyph(rawFont, indexes[i], u, &g)) {
+                if (restarted)
+                    continue; // the text alone does not fit, drop what is left over
+                // start over with an empty atlas, the glyphs already
+                // emitted get rasterized again
+                reset();
+                restarted = true;
+                vertices->clear();
+                glyphCount = 0;
+                r = -1;
+                break;
+            }
+            if (g.atlasRect.isNull())
+                continue;
+
+            const float x0 = qRound(positions[i].x()) + g.offset.x();
+            const float y0 = qRound(positions[i].y()) + g.offset.y();
+            const float x1 = x0 + g.atlasRect.width();
+            const float y1 = y0 + g.atlasRect.height();
+            const float u0 = g.atlasRect.x() * scale;
+            const float v0 = g.atlasRect.y() * scale;
+            const float u1 = (g.atlasRect.x() + g.atlasRect.width()) * scale;
+            const float v1 = (g.atlasRect.y() + g.atlasRect.height()) * scale;
+            vertices->insert(vertices->end(), {
+                { x0, y0, u0, v0 }, { x0, y1, u0, v1 }, { x1, y0, u1, v0 },
+                { x1, y0, u1, v0 }, { x0, y1, u0, v1 }, { x1, y1, u1, v1 }
+            });
+            ++glyphCount;
+        }
+    }
+    return glyphCount;
+}
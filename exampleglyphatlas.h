@@ -0,0 +1,63 @@
+#ifndef EXAMPLEGLYPHATLAS_H
+#define EXAMPLEGLYPHATLAS_H
+
+#include <QtGui/private/qrhi_p.h>
+#include <QFont>
+#include <QHash>
+#include <QRawFont>
+#include <vector>
+
+// Caches rasterized glyphs in a single-channel texture. Laying out a string
+// produces two textured triangles per glyph, and only the glyphs that have
+// not been seen before are rasterized and uploaded, each into its own small
+// sub-rectangle of the atlas.
+class ExampleGlyphAtlas
+{
+public:
+    static const int ATLAS_SIZE = 1024;
+
+    // x and y in pixels, relative to the top-left of the text, u and v in
+    // normalized atlas coordinates
+    struct Vertex {
+        float x, y, u, v;
+    };
+
+    struct Statistics {
+        int glyphCount = 0;
+        int rasterizedGlyphCount = 0;
+        qint64 uploadedBytes = 0;
+        int resetCount = 0;
+    };
+
+    // (re)creates the texture on the given QRhi and forgets all glyphs
+    void create(QRhi *rhi);
+    QRhiTexture *texture() const { return m_texture.data(); }
+    void releaseResources() { m_texture.reset(); }
+
+    // Lays out a single line of text with its first baseline at the font's
+    // ascent, like QPainter::drawText() into a rectangle with no flags.
+    // Replaces the contents of vertices, and enqueues the uploads for new
+    // glyphs on u. Returns the number of glyphs.
+    int layoutText(const QString &text, const QFont &font, QRhiResourceUpdateBatch *u,
+                   std::vector<Vertex> *vertices);
+
+    Statistics statistics() const { return m_stats; }
+
+private:
+    struct Glyph {
+        QRect atlasRect;
+        QPoint offset; // of the image's top-left from the pen position on the baseline
+    };
+
+    bool findOrAddGlyph(const QRawFont &font, quint32 glyphIndex, QRhiResourceUpdateBatch *u, Glyph *glyph);
+    void reset();
+
+    QScopedPointer<QRhiTexture> m_texture;
+    QList<QRawFont> m_fonts;
+    QHash<quint64, Glyph> m_glyphs;
+    QPoint m_shelfPos;
+    int m_shelfHeight = 0;
+    Statistics m_stats;
+};
+
+#endif
@@ -2,48 +2,105 @@
 #include "cube.h"
 #include <QFile>
 #include <QPainter>
+#include <QStandardPaths>
+#include <QtMath>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
 
 static const QSize CUBE_TEX_SIZE(512, 512);
+static const QColor CLEAR_COLOR = QColor::fromRgbF(0.4f, 0.7f, 0.0f, 1.0f);
+// the matrix and the flip flag, as in the shaders
+static const quint32 UNIFORM_SIZE = 68;
 
 ExampleRhiWidget::ExampleRhiWidget(QWidget *parent, Qt::WindowFlags f)
     : QRhiWidget(parent, f)
 {
     setDebugLayer(true);
+    setSampleCount(4);
+    setAutoRenderTarget(true);
+    setPipelineCacheFile(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)
+                         + QLatin1String("/pipelines.bin"));
+}
+
+ExampleRhiWidget::~ExampleRhiWidget()
+{
+    // with threaded rendering, before the scene goes away
+    stopRenderThread();
+}
+
+// Everything set on the GUI thread since the last frame goes over to the
+// render side here. Only what changed is copied.
+void ExampleRhiWidget::synchronize()
+{
+    synced.itemData.cubeText = itemData.cubeText;
+    synced.itemData.cubeTextDirty = synced.itemData.cubeTextDirty || itemData.cubeTextDirty;
+    synced.itemData.cubeRotation = itemData.cubeRotation;
+    synced.itemData.cubeRotationDirty = synced.itemData.cubeRotationDirty || itemData.cubeRotationDirty;
+    itemData.cubeTextDirty = false;
+    itemData.cubeRotationDirty = false;
+    synced.textRendering = m_textRendering;
+    if (synced.perObjectUniforms != m_perObjectUniforms) {
+        synced.perObjectUniforms = m_perObjectUniforms;
+        synced.perObjectUniformsDirty = true;
+    }
+    if (m_textRendering == PainterText) {
+        // superseded images never get here
+        QImage image;
+        if (m_textureProducer.takeImage(&image))
+            synced.cubeImage = image;
+    } else {
+        synced.cubeImage = QImage();
+    }
+
+    if (instances.dirtyBegin < instances.dirtyEnd) {
+        Instances &dst(synced.instances);
+        dst.data.resize(instances.data.size());
+        std::copy(instances.data.cbegin() + instances.dirtyBegin, instances.data.cbegin() + instances.dirtyEnd,
+                  dst.data.begin() + instances.dirtyBegin);
+        if (dst.dirtyBegin < dst.dirtyEnd) {
+            dst.dirtyBegin = qMin(dst.dirtyBegin, instances.dirtyBegin);
+            dst.dirtyEnd = qMin(qMax(dst.dirtyEnd, instances.dirtyEnd), int(dst.data.size()));
+        } else {
+            dst.dirtyBegin = instances.dirtyBegin;
+            dst.dirtyEnd = instances.dirtyEnd;
+        }
+        instances.dirtyBegin = instances.dirtyEnd = 0;
+    }
+}
+
+// Nothing in the scene animates on its own, so unless something was set
+// since the last frame, the texture already has the right contents.
+bool ExampleRhiWidget::needsRender() const
+{
+    return synced.itemData.cubeTextDirty || synced.itemData.cubeRotationDirty
+            || synced.perObjectUniformsDirty || !synced.cubeImage.isNull()
+            || synced.instances.dirtyBegin < synced.instances.dirtyEnd;
 }
 
 void ExampleRhiWidget::initialize(QRhi *rhi, QRhiTexture *outputTexture)
 {
     if (m_rhi != rhi) {
-        m_rt.reset();
-        m_rp.reset();
-        m_ds.reset();
         scene.vbuf.reset();
-    } else if (m_output != outputTexture) {
-        m_rt.reset();
-        m_rp.reset();
+        scene.ps.reset();
     }
 
     m_rhi = rhi;
     m_output = outputTexture;
 
-    if (!m_ds) {
-        m_ds.reset(m_rhi->newRenderBuffer(QRhiRenderBuffer::DepthStencil, m_output->pixelSize()));
-        m_ds->create();
-    } else if (m_ds->pixelSize() != m_output->pixelSize()) {
-        m_ds->setPixelSize(m_output->pixelSize());
-        m_ds->create();
-    }
-
-    if (!m_rt) {
-        m_rt.reset(m_rhi->newTextureRenderTarget({ { m_output }, m_ds.data() }));
-        m_rp.reset(m_rt->newCompatibleRenderPassDescriptor());
-        m_rt->setRenderPassDescriptor(m_rp.data());
-        m_rt->create();
-    }
-
     if (!scene.vbuf) {
         initScene();
-        updateCubeTexture();
+        synced.itemData.cubeTextDirty = true;
+    }
+
+    // the render pass descriptor survives resizes, so this only happens when
+    // the QRhi or the sample count changes
+    QRhiRenderTarget *rt = renderTarget();
+    if (!scene.ps || scene.ps->renderPassDescriptor() != rt->renderPassDescriptor()
+            || scene.ps->sampleCount() != rt->sampleCount())
+    {
+        initPipeline();
     }
 
     const QSize outputSize = m_output->pixelSize();
@@ -55,29 +112,207 @@ void ExampleRhiWidget::initialize(QRhi *rhi, QRhiTexture *outputTexture)
 
 void ExampleRhiWidget::updateMvp()
 {
-    QMatrix4x4 mvp = scene.mvp * QMatrix4x4(QQuaternion::fromEulerAngles(QVector3D(30, itemData.cubeRotation, 0)).toRotationMatrix());
+    QMatrix4x4 mvp = scene.mvp * QMatrix4x4(QQuaternion::fromEulerAngles(QVector3D(30, synced.itemData.cubeRotation, 0)).toRotationMatrix());
     if (!scene.resourceUpdates)
         scene.resourceUpdates = m_rhi->nextResourceUpdateBatch();
     scene.resourceUpdates->updateDynamicBuffer(scene.ubuf.data(), 0, 64, mvp.constData());
 }
 
-void ExampleRhiWidget::updateCubeTexture()
+// Lays out the cubes in a grid filling the space of the single cube.
+void ExampleRhiWidget::setInstanceCount(int count)
+{
+    count = qBound(1, count, MAX_INSTANCE_COUNT);
+    if (count == instanceCount())
+        return;
+
+    const int side = qCeil(std::cbrt(double(count)));
+    const float spacing = 2.0f / side;
+    const float scale = count == 1 ? 1.0f : spacing * 0.35f;
+    instances.data.resize(count);
+    for (int i = 0; i < count; ++i) {
+        InstanceData &inst(instances.data[i]);
+        inst.translationScale[0] = -1.0f + spacing * (i % side + 0.5f);
+        inst.translationScale[1] = -1.0f + spacing * ((i / side) % side + 0.5f);
+        inst.translationScale[2] = -1.0f + spacing * (i / (side * side) + 0.5f);
+        inst.translationScale[3] = scale;
+        inst.rotation[0] = inst.rotation[1] = inst.rotation[2] = 0.0f;
+        inst.rotation[3] = 1.0f;
+    }
+    instances.dirtyBegin = 0;
+    instances.dirtyEnd = count;
+    update();
+}
+
+void ExampleRhiWidget::setInstanceTransform(int index, const QVector3D &translation, float scale,
+                                            const QQuaternion &rotation)
+{
+    if (index < 0 || index >= instanceCount())
+        return;
+
+    InstanceData &inst(instances.data[index]);
+    inst.translationScale[0] = translation.x();
+    inst.translationScale[1] = translation.y();
+    inst.translationScale[2] = translation.z();
+    inst.translationScale[3] = scale;
+    inst.rotation[0] = rotation.x();
+    inst.rotation[1] = rotation.y();
+    inst.rotation[2] = rotation.z();
+    inst.rotation[3] = rotation.scalar();
+
+    // only the range covering the changed instances gets uploaded
+    if (instances.dirtyBegin < instances.dirtyEnd) {
+        instances.dirtyBegin = qMin(instances.dirtyBegin, index);
+        instances.dirtyEnd = qMax(instances.dirtyEnd, index + 1);
+    } else {
+        instances.dirtyBegin = index;
+        instances.dirtyEnd = index + 1;
+    }
+    update();
+}
+
+void ExampleRhiWidget::updateInstances()
+{
+    const quint32 size = quint32(synced.instances.data.size() * sizeof(InstanceData));
+    if (scene.instanceBuf->size() < size) {
+        // grow, and upload everything to the new buffer
+        scene.instanceBuf->setSize(size);
+        scene.instanceBuf->create();
+        scene.vbufBindings[1] = { scene.instanceBuf.data(), 0 };
+        synced.instances.dirtyBegin = 0;
+        synced.instances.dirtyEnd = int(synced.instances.data.size());
+    }
+
+    if (!scene.resourceUpdates)
+        scene.resourceUpdates = m_rhi->nextResourceUpdateBatch();
+    scene.resourceUpdates->uploadStaticBuffer(scene.instanceBuf.data(),
+                                              quint32(synced.instances.dirtyBegin * sizeof(InstanceData)),
+                                              quint32((synced.instances.dirtyEnd - synced.instances.dirtyBegin) * sizeof(InstanceData)),
+                                              synced.instances.data.data() + synced.instances.dirtyBegin);
+    synced.instances.dirtyBegin = synced.instances.dirtyEnd = 0;
+}
+
+static QFont cubeTextFont()
+{
+    QFont font;
+    font.setPointSize(24);
+    return font;
+}
+
+// Runs on a worker thread.
+static QImage paintCubeTexture(const QString &text)
 {
     QImage image(CUBE_TEX_SIZE, QImage::Format_RGBA8888);
     const QRect r(QPoint(0, 0), CUBE_TEX_SIZE);
     QPainter p(&image);
     p.fillRect(r, QGradient::DeepBlue);
-    QFont font;
-    font.setPointSize(24);
-    p.setFont(font);
-    p.drawText(r, itemData.cubeText);
+    if (!text.isEmpty()) {
+        p.setFont(cubeTextFont());
+        p.drawText(r, text);
+    }
     p.end();
+    return image;
+}
 
+void ExampleRhiWidget::requestCubeTexture(const QString &text)
+{
+    m_textureProducer.produce([text] { return paintCubeTexture(text); });
+}
+
+// Uploads the most recent image completed by the producer, taken over in
+// synchronize(), if there is one.
+void ExampleRhiWidget::updateCubeTexture()
+{
+    if (synced.cubeImage.isNull())
+        return;
+
+    const QImage image = std::exchange(synced.cubeImage, QImage());
     if (!scene.resourceUpdates)
         scene.resourceUpdates = m_rhi->nextResourceUpdateBatch();
+    m_textUploadBytes += image.sizeInBytes();
     scene.resourceUpdates->uploadTexture(scene.cubeTex.data(), image);
 }
 
+// Only glyphs not seen before get rasterized and uploaded, the rest of a text
+// change is a copy of the background and a few quads, all on the GPU.
+QRhiResourceUpdateBatch *ExampleRhiWidget::updateCubeText()
+{
+    QRhiResourceUpdateBatch *u = m_rhi->nextResourceUpdateBatch();
+    u->copyTexture(scene.cubeTex.data(), scene.backgroundTex.data());
+
+    const qint64 glyphBytes = scene.glyphAtlas.statistics().uploadedBytes;
+    scene.glyphAtlas.layoutText(synced.itemData.cubeText, cubeTextFont(), u, &scene.textVertices);
+    m_textUploadBytes += scene.glyphAtlas.statistics().uploadedBytes - glyphBytes;
+
+    if (scene.textVertices.empty())
+        return u;
+
+    // from pixels to normalized device coordinates, with the first row of the
+    // texture on top, as with images uploaded to it
+    const float sx = 2.0f / CUBE_TEX_SIZE.width();
+    const float sy = 2.0f / CUBE_TEX_SIZE.height();
+    const bool flipY = m_rhi->isYUpInNDC() != m_rhi->isYUpInFramebuffer();
+    for (ExampleGlyphAtlas::Vertex &v : scene.textVertices) {
+        v.x = v.x * sx - 1.0f;
+        v.y = flipY ? 1.0f - v.y * sy : v.y * sy - 1.0f;
+    }
+
+    const quint32 size = quint32(scene.textVertices.size() * sizeof(ExampleGlyphAtlas::Vertex));
+    if (scene.textVbuf->size() < size) {
+        scene.textVbuf->setSize(qMax(size, scene.textVbuf->size() * 2));
+        scene.textVbuf->create();
+    }
+    u->updateDynamicBuffer(scene.textVbuf.data(), 0, size, scene.textVertices.data());
+    m_textUploadBytes += size;
+    return u;
+}
+
+void ExampleRhiWidget::renderCubeText(QRhiCommandBuffer *cb, QRhiResourceUpdateBatch *u)
+{
+    // the copy of the background is in u, the pass loads it instead of clearing
+    cb->beginPass(scene.textRt.data(), Qt::black, { 1.0f, 0 }, u);
+    if (!scene.textVertices.empty()) {
+        cb->setGraphicsPipeline(scene.textPs.data());
+        cb->setViewport(QRhiViewport(0, 0, CUBE_TEX_SIZE.width(), CUBE_TEX_SIZE.height()));
+        cb->setShaderResources();
+        const QRhiCommandBuffer::VertexInput vbufBinding(scene.textVbuf.data(), 0);
+        cb->setVertexInput(0, 1, &vbufBinding);
+        cb->draw(quint32(scene.textVertices.size()));
+    }
+    cb->endPass();
+}
+
+// Only called with threaded rendering, when the render thread's QRhi goes away.
+void ExampleRhiWidget::releaseResources()
+{
+    if (scene.resourceUpdates) {
+        scene.resourceUpdates->release();
+        scene.resourceUpdates = nullptr;
+    }
+    scene.objectSrbs.clear();
+    scene.objectUniforms.clear();
+    m_transient.releaseResources();
+    scene.textPs.reset();
+    scene.textRp.reset();
+    scene.textRt.reset();
+    scene.textSrb.reset();
+    scene.textSampler.reset();
+    scene.textVbuf.reset();
+    scene.glyphAtlas.releaseResources();
+    scene.backgroundTex.reset();
+    scene.objectPs.reset();
+    scene.objectLayoutSrb.reset();
+    scene.ps.reset();
+    scene.srb.reset();
+    scene.sampler.reset();
+    scene.cubeTex.reset();
+    scene.ubuf.reset();
+    scene.instanceBuf.reset();
+    scene.ibuf.reset();
+    scene.vbuf.reset();
+    m_rhi = nullptr;
+    m_output = nullptr;
+}
+
 static QShader getShader(const QString &name)
 {
     QFile f(name);
@@ -89,19 +324,37 @@ static QShader getShader(const QString &name)
 
 void ExampleRhiWidget::initScene()
 {
-    scene.vbuf.reset(m_rhi->newBuffer(QRhiBuffer::Immutable, QRhiBuffer::VertexBuffer, sizeof(cube)));
+    // cube.h has 36 positions followed by 36 texture coordinates
+    scene.mesh = ExampleGeometry::prepare(cube, cube + 36 * 3, 36, m_quantization, &m_geometryStats);
+
+    scene.vbuf.reset(m_rhi->newBuffer(QRhiBuffer::Immutable, QRhiBuffer::VertexBuffer, scene.mesh.vertexData.size()));
     scene.vbuf->create();
+    scene.vbufBindings[0] = { scene.vbuf.data(), 0 };
+
+    scene.ibuf.reset(m_rhi->newBuffer(QRhiBuffer::Immutable, QRhiBuffer::IndexBuffer, scene.mesh.indexData.size()));
+    scene.ibuf->create();
 
     scene.resourceUpdates = m_rhi->nextResourceUpdateBatch();
-    scene.resourceUpdates->uploadStaticBuffer(scene.vbuf.data(), cube);
+    scene.resourceUpdates->uploadStaticBuffer(scene.vbuf.data(), scene.mesh.vertexData.constData());
+    scene.resourceUpdates->uploadStaticBuffer(scene.ibuf.data(), scene.mesh.indexData.constData());
+    // the batch has its own copy
+    scene.mesh.vertexData.clear();
+    scene.mesh.indexData.clear();
+
+    scene.instanceBuf.reset(m_rhi->newBuffer(QRhiBuffer::Static, QRhiBuffer::VertexBuffer,
+                                             quint32(synced.instances.data.size() * sizeof(InstanceData))));
+    scene.instanceBuf->create();
+    scene.vbufBindings[1] = { scene.instanceBuf.data(), 0 };
+    synced.instances.dirtyBegin = 0;
+    synced.instances.dirtyEnd = int(synced.instances.data.size());
 
-    scene.ubuf.reset(m_rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::UniformBuffer, 68));
+    scene.ubuf.reset(m_rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::UniformBuffer, UNIFORM_SIZE));
     scene.ubuf->create();
 
     const qint32 flip = 0;
     scene.resourceUpdates->updateDynamicBuffer(scene.ubuf.data(), 64, 4, &flip);
 
-    scene.cubeTex.reset(m_rhi->newTexture(QRhiTexture::RGBA8, CUBE_TEX_SIZE));
+    scene.cubeTex.reset(m_rhi->newTexture(QRhiTexture::RGBA8, CUBE_TEX_SIZE, 1, QRhiTexture::RenderTarget));
     scene.cubeTex->create();
 
     scene.sampler.reset(m_rhi->newSampler(QRhiSampler::Linear, QRhiSampler::Linear, QRhiSampler::None,
@@ -115,65 +368,255 @@ void ExampleRhiWidget::initScene()
     });
     scene.srb->create();
 
-    scene.ps.reset(m_rhi->newGraphicsPipeline());
-    scene.ps->setDepthTest(true);
-    scene.ps->setDepthWrite(true);
-    scene.ps->setDepthOp(QRhiGraphicsPipeline::Less);
-    scene.ps->setCullMode(QRhiGraphicsPipeline::Back);
-    scene.ps->setFrontFace(QRhiGraphicsPipeline::CCW);
+    // only for creating the pipeline, the bindings used with it are per
+    // block of the transient allocator
+    scene.objectSrbs.clear();
+    m_transient.releaseResources();
+    scene.objectLayoutSrb.reset(m_rhi->newShaderResourceBindings());
+    scene.objectLayoutSrb->setBindings({
+        QRhiShaderResourceBinding::uniformBufferWithDynamicOffset(0, QRhiShaderResourceBinding::VertexStage | QRhiShaderResourceBinding::FragmentStage, scene.ubuf.data(), UNIFORM_SIZE),
+        QRhiShaderResourceBinding::sampledTexture(1, QRhiShaderResourceBinding::FragmentStage, scene.cubeTex.data(), scene.sampler.data())
+    });
+    scene.objectLayoutSrb->create();
+
+    initTextScene();
+}
+
+void ExampleRhiWidget::initTextScene()
+{
+    const QImage background = paintCubeTexture(QString());
+    scene.backgroundTex.reset(m_rhi->newTexture(QRhiTexture::RGBA8, CUBE_TEX_SIZE, 1, QRhiTexture::UsedAsTransferSource));
+    scene.backgroundTex->create();
+    scene.resourceUpdates->uploadTexture(scene.backgroundTex.data(), background);
+
+    scene.glyphAtlas.create(m_rhi);
+
+    // room for 64 glyphs to start with
+    scene.textVbuf.reset(m_rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::VertexBuffer,
+                                          64 * 6 * sizeof(ExampleGlyphAtlas::Vertex)));
+    scene.textVbuf->create();
+
+    // the quads map atlas texels 1:1 to texture pixels
+    scene.textSampler.reset(m_rhi->newSampler(QRhiSampler::Nearest, QRhiSampler::Nearest, QRhiSampler::None,
+                                              QRhiSampler::ClampToEdge, QRhiSampler::ClampToEdge));
+    scene.textSampler->create();
+
+    scene.textSrb.reset(m_rhi->newShaderResourceBindings());
+    scene.textSrb->setBindings({
+        QRhiShaderResourceBinding::sampledTexture(0, QRhiShaderResourceBinding::FragmentStage,
+                                                  scene.glyphAtlas.texture(), scene.textSampler.data())
+    });
+    scene.textSrb->create();
+
+    scene.textRt.reset(m_rhi->newTextureRenderTarget({ scene.cubeTex.data() },
+                                                     QRhiTextureRenderTarget::PreserveColorContents));
+    scene.textRp.reset(scene.textRt->newCompatibleRenderPassDescriptor());
+    scene.textRt->setRenderPassDescriptor(scene.textRp.data());
+    scene.textRt->create();
+
+    scene.textPs.reset(m_rhi->newGraphicsPipeline());
+    QRhiGraphicsPipeline::TargetBlend blend;
+    blend.enable = true; // premultiplied alpha
+    scene.textPs->setTargetBlends({ blend });
+    QShader vs = getShader(QLatin1String(":/text.vert.qsb"));
+    Q_ASSERT(vs.isValid());
+    QShader fs = getShader(QLatin1String(":/text.frag.qsb"));
+    Q_ASSERT(fs.isValid());
+    scene.textPs->setShaderStages({
+        { QRhiShaderStage::Vertex, vs },
+        { QRhiShaderStage::Fragment, fs }
+    });
+    QRhiVertexInputLayout inputLayout;
+    inputLayout.setBindings({
+        { sizeof(ExampleGlyphAtlas::Vertex) }
+    });
+    inputLayout.setAttributes({
+        { 0, 0, QRhiVertexInputAttribute::Float2, 0 },
+        { 0, 1, QRhiVertexInputAttribute::Float2, 2 * sizeof(float) }
+    });
+    scene.textPs->setVertexInputLayout(inputLayout);
+    scene.textPs->setShaderResourceBindings(scene.textSrb.data());
+    scene.textPs->setRenderPassDescriptor(scene.textRp.data());
+    scene.textPs->create();
+}
+
+void ExampleRhiWidget::initPipeline()
+{
+    scene.ps.reset(newCubePipeline(scene.srb.data()));
+    scene.objectPs.reset(newCubePipeline(scene.objectLayoutSrb.data()));
+}
+
+QRhiGraphicsPipeline *ExampleRhiWidget::newCubePipeline(QRhiShaderResourceBindings *srb)
+{
+    QRhiGraphicsPipeline *ps = m_rhi->newGraphicsPipeline();
+    ps->setDepthTest(true);
+    ps->setDepthWrite(true);
+    ps->setDepthOp(QRhiGraphicsPipeline::Less);
+    ps->setCullMode(QRhiGraphicsPipeline::Back);
+    ps->setFrontFace(QRhiGraphicsPipeline::CCW);
     QShader vs = getShader(QLatin1String(":/texture.vert.qsb"));
     Q_ASSERT(vs.isValid());
     QShader fs = getShader(QLatin1String(":/texture.frag.qsb"));
     Q_ASSERT(fs.isValid());
-    scene.ps->setShaderStages({
+    ps->setShaderStages({
         { QRhiShaderStage::Vertex, vs },
         { QRhiShaderStage::Fragment, fs }
     });
     QRhiVertexInputLayout inputLayout;
     inputLayout.setBindings({
-        { 3 * sizeof(float) },
-        { 2 * sizeof(float) }
+        { scene.mesh.stride },
+        { sizeof(InstanceData), QRhiVertexInputBinding::PerInstance }
     });
     inputLayout.setAttributes({
-        { 0, 0, QRhiVertexInputAttribute::Float3, 0 },
-        { 1, 1, QRhiVertexInputAttribute::Float2, 0 }
+        { 0, 0, scene.mesh.positionFormat, 0 },
+        { 0, 1, scene.mesh.texcoordFormat, scene.mesh.texcoordOffset },
+        { 1, 2, QRhiVertexInputAttribute::Float4, 0 },
+        { 1, 3, QRhiVertexInputAttribute::Float4, 4 * sizeof(float) }
     });
-    scene.ps->setVertexInputLayout(inputLayout);
-    scene.ps->setShaderResourceBindings(scene.srb.data());
-    scene.ps->setRenderPassDescriptor(m_rp.data());
-    scene.ps->create();
+    ps->setVertexInputLayout(inputLayout);
+    ps->setShaderResourceBindings(srb);
+    ps->setSampleCount(renderTarget()->sampleCount());
+    ps->setRenderPassDescriptor(renderTarget()->renderPassDescriptor());
+    ps->create();
+    return ps;
+}
+
+void ExampleRhiWidget::updateObjectUniforms()
+{
+    m_transient.beginFrame(m_rhi);
+
+    // with more than one view, each looks at the scene from its own angle,
+    // around the vertical axis
+    const QList<View> &viewList = views();
+    const int viewCount = int(viewList.size());
+    const int count = synced.perObjectUniforms ? int(synced.instances.data.size()) : 1;
+    scene.objectUniforms.resize(viewCount * count);
+    char data[UNIFORM_SIZE];
+    const qint32 flip = 0;
+    std::memcpy(data + 64, &flip, 4);
+    for (int v = 0; v < viewCount; ++v) {
+        QMatrix4x4 viewProjection = scene.mvp;
+        if (viewCount > 1) {
+            const QRect &rect(viewList[v].rect);
+            viewProjection = m_rhi->clipSpaceCorrMatrix();
+            viewProjection.perspective(45.0f, rect.width() / float(rect.height()), 0.01f, 1000.0f);
+            viewProjection.translate(0, 0, -4);
+            viewProjection.rotate(360.0f * viewList[v].index / float(viewCount), 0, 1, 0);
+        }
+        viewProjection *= QMatrix4x4(QQuaternion::fromEulerAngles(QVector3D(30, synced.itemData.cubeRotation, 0)).toRotationMatrix());
+        for (int i = 0; i < count; ++i) {
+            QMatrix4x4 mvp = viewProjection;
+            if (synced.perObjectUniforms) {
+                // spin each cube around its own center, at its own angle
+                const float *t = synced.instances.data[i].translationScale;
+                mvp.translate(t[0], t[1], t[2]);
+                mvp.rotate(float(i % 360), 0, 1, 0);
+                mvp.translate(-t[0], -t[1], -t[2]);
+            }
+            std::memcpy(data, mvp.constData(), 64);
+            scene.objectUniforms[v * count + i] = m_transient.allocate(QRhiBuffer::UniformBuffer, UNIFORM_SIZE, data);
+        }
+    }
+
+    // one set of bindings per block, they stay valid as long as the block
+    for (const QRhiWidgetTransientAllocator::Allocation &a : scene.objectUniforms) {
+        while (a.block >= int(scene.objectSrbs.size())) {
+            QRhiShaderResourceBindings *srb = m_rhi->newShaderResourceBindings();
+            srb->setBindings({
+                QRhiShaderResourceBinding::uniformBufferWithDynamicOffset(0, QRhiShaderResourceBinding::VertexStage | QRhiShaderResourceBinding::FragmentStage,
+                                                                          m_transient.blockBuffer(QRhiBuffer::UniformBuffer, int(scene.objectSrbs.size())),
+                                                                          UNIFORM_SIZE),
+                QRhiShaderResourceBinding::sampledTexture(1, QRhiShaderResourceBinding::FragmentStage, scene.cubeTex.data(), scene.sampler.data())
+            });
+            srb->create();
+            scene.objectSrbs.emplace_back(srb);
+        }
+    }
+
+    if (!scene.resourceUpdates)
+        scene.resourceUpdates = m_rhi->nextResourceUpdateBatch();
+    m_transient.endFrame(scene.resourceUpdates);
+}
+
+void ExampleRhiWidget::renderObjects(QRhiCommandBuffer *cb)
+{
+    cb->setGraphicsPipeline(scene.objectPs.data());
+    const QList<View> &viewList = views();
+    const int viewCount = int(viewList.size());
+    const int count = viewCount ? int(scene.objectUniforms.size()) / viewCount : 0;
+    // all instances in one draw call, unless each has its own uniforms
+    const quint32 instanceCount = synced.perObjectUniforms ? 1 : quint32(synced.instances.data.size());
+    QRhiCommandBuffer::VertexInput bindings[2] = { scene.vbufBindings[0], scene.vbufBindings[1] };
+    for (int v = 0; v < viewCount; ++v) {
+        cb->setViewport(viewList[v].viewport);
+        for (int i = 0; i < count; ++i) {
+            const QRhiWidgetTransientAllocator::Allocation &a(scene.objectUniforms[v * count + i]);
+            if (a.isNull())
+                continue;
+            const QRhiCommandBuffer::DynamicOffset offset(0, a.offset);
+            cb->setShaderResources(scene.objectSrbs[a.block].get(), 1, &offset);
+            bindings[1] = { scene.instanceBuf.data(), quint32(i * sizeof(InstanceData)) };
+            cb->setVertexInput(0, 2, bindings, scene.ibuf.data(), 0, scene.mesh.indexFormat);
+            cb->drawIndexed(quint32(scene.mesh.indexCount), instanceCount);
+        }
+    }
 }
 
 void ExampleRhiWidget::render(QRhiCommandBuffer *cb)
 {
-    if (itemData.cubeRotationDirty) {
-        itemData.cubeRotationDirty = false;
+    if (synced.itemData.cubeRotationDirty) {
+        synced.itemData.cubeRotationDirty = false;
         updateMvp();
     }
 
-    if (itemData.cubeTextDirty) {
-        itemData.cubeTextDirty = false;
-        updateCubeTexture();
+    QRhiResourceUpdateBatch *textUpdates = nullptr;
+    if (synced.itemData.cubeTextDirty) {
+        synced.itemData.cubeTextDirty = false;
+        if (synced.textRendering == GlyphAtlasText)
+            textUpdates = updateCubeText();
+        else
+            requestCubeTexture(synced.itemData.cubeText);
     }
 
+    if (synced.textRendering == PainterText)
+        updateCubeTexture();
+
+    if (synced.instances.dirtyBegin < synced.instances.dirtyEnd)
+        updateInstances();
+
+    const bool transientUniforms = synced.perObjectUniforms || views().size() > 1;
+    if (transientUniforms)
+        updateObjectUniforms();
+    synced.perObjectUniformsDirty = false;
+
     QRhiResourceUpdateBatch *rub = scene.resourceUpdates;
     if (rub)
         scene.resourceUpdates = nullptr;
 
-    const QColor clearColor = QColor::fromRgbF(0.4f, 0.7f, 0.0f, 1.0f);
+    if (textUpdates) {
+        // the background and the new glyphs may still be in rub, which
+        // belongs before the text pass
+        if (rub) {
+            rub->merge(textUpdates);
+            textUpdates->release();
+            textUpdates = rub;
+            rub = nullptr;
+        }
+        renderCubeText(cb, textUpdates);
+    }
 
-    cb->beginPass(m_rt.data(), clearColor, { 1.0f, 0 }, rub);
+    cb->beginPass(renderTarget(), CLEAR_COLOR, { 1.0f, 0 }, rub);
 
-    cb->setGraphicsPipeline(scene.ps.data());
-    const QSize outputSize = m_output->pixelSize();
-    cb->setViewport(QRhiViewport(0, 0, outputSize.width(), outputSize.height()));
-    cb->setShaderResources();
-    const QRhiCommandBuffer::VertexInput vbufBindings[] = {
-        { scene.vbuf.data(), 0 },
-        { scene.vbuf.data(), quint32(36 * 3 * sizeof(float)) }
-    };
-    cb->setVertexInput(0, 2, vbufBindings);
-    cb->draw(36);
+    if (transientUniforms) {
+        renderObjects(cb);
+    } else {
+        cb->setGraphicsPipeline(scene.ps.data());
+        const QSize outputSize = m_output->pixelSize();
+        cb->setViewport(QRhiViewport(0, 0, outputSize.width(), outputSize.height()));
+        cb->setShaderResources();
+        cb->setVertexInput(0, 2, scene.vbufBindings, scene.ibuf.data(), 0, scene.mesh.indexFormat);
+        cb->drawIndexed(quint32(scene.mesh.indexCount), quint32(synced.instances.data.size()));
+    }
 
     cb->endPass();
 }
@@ -2,23 +2,39 @@
 #define EXAMPLEWIDGET_H
 
 #include "rhiwidget.h"
+#include "examplegeometry.h"
+#include "exampleglyphatlas.h"
+#include "rhiwidgetproducer.h"
+#include "rhiwidgetallocator.h"
 #include <QtGui/private/qrhi_p.h>
+#include <QQuaternion>
+#include <memory>
+#include <vector>
 
 class ExampleRhiWidget : public QRhiWidget
 {
 public:
     ExampleRhiWidget(QWidget *parent = nullptr, Qt::WindowFlags f = {});
+    ~ExampleRhiWidget();
 
+    void synchronize() override;
+    bool needsRender() const override;
     void initialize(QRhi *rhi, QRhiTexture *outputTexture) override;
     void render(QRhiCommandBuffer *cb) override;
+    void releaseResources() override;
 
     void setCubeTextureText(const QString &s)
     {
         if (itemData.cubeText == s)
             return;
         itemData.cubeText = s;
-        itemData.cubeTextDirty = true;
-        update();
+        if (m_textRendering == PainterText) {
+            // start rasterizing right away, the update comes when it is done
+            requestCubeTexture(s);
+        } else {
+            itemData.cubeTextDirty = true;
+            update();
+        }
     }
 
     void setCubeRotation(float r)
@@ -30,34 +46,138 @@ public:
         update();
     }
 
+    enum TextRendering {
+        // redraws the whole texture with QPainter and uploads it
+        PainterText,
+        // draws quads from a glyph atlas into the texture, on the GPU
+        GlyphAtlasText
+    };
+
+    TextRendering textRendering() const { return m_textRendering; }
+    void setTextRendering(TextRendering mode)
+    {
+        if (m_textRendering == mode)
+            return;
+        m_textRendering = mode;
+        itemData.cubeTextDirty = true;
+        update();
+    }
+
+    // bytes uploaded for text changes since the widget was created
+    qint64 textUploadBytes() const { return m_textUploadBytes; }
+    // rasterizes the texture for PainterText
+    QRhiWidgetImageProducer *textureProducer() { return &m_textureProducer; }
+    ExampleGlyphAtlas::Statistics glyphAtlasStatistics() const { return scene.glyphAtlas.statistics(); }
+
+    static const int MAX_INSTANCE_COUNT = 1000000;
+
+    int instanceCount() const { return int(instances.data.size()); }
+    void setInstanceCount(int count);
+    void setInstanceTransform(int index, const QVector3D &translation, float scale, const QQuaternion &rotation);
+
+    // Draws every instance with a draw call of its own, spinning around its
+    // own axis, with the transform in uniform data suballocated per frame
+    // instead of per-instance vertex data.
+    bool perObjectUniforms() const { return m_perObjectUniforms; }
+    void setPerObjectUniforms(bool enable)
+    {
+        if (m_perObjectUniforms == enable)
+            return;
+        m_perObjectUniforms = enable;
+        update();
+    }
+    QRhiWidgetTransientAllocator::Statistics transientAllocatorStatistics() const { return m_transient.statistics(); }
+
+    // must be called before the widget is rendered for the first time
+    void setGeometryQuantization(ExampleGeometry::Quantization quantization) { m_quantization = quantization; }
+    ExampleGeometry::Statistics geometryStatistics() const { return m_geometryStats; }
+
 private:
     QRhi *m_rhi = nullptr;
+    ExampleGeometry::Quantization m_quantization = ExampleGeometry::NoQuantization;
+    ExampleGeometry::Statistics m_geometryStats;
+    TextRendering m_textRendering = GlyphAtlasText;
+    qint64 m_textUploadBytes = 0;
+    QRhiWidgetImageProducer m_textureProducer { this };
+    bool m_perObjectUniforms = false;
+    QRhiWidgetTransientAllocator m_transient;
     QRhiTexture *m_output = nullptr;
-    QScopedPointer<QRhiRenderBuffer> m_ds;
-    QScopedPointer<QRhiTextureRenderTarget> m_rt;
-    QScopedPointer<QRhiRenderPassDescriptor> m_rp;
 
     struct {
         QRhiResourceUpdateBatch *resourceUpdates = nullptr;
         QScopedPointer<QRhiBuffer> vbuf;
+        QScopedPointer<QRhiBuffer> ibuf;
+        QScopedPointer<QRhiBuffer> instanceBuf;
+        QRhiCommandBuffer::VertexInput vbufBindings[2];
+        ExampleGeometry::Mesh mesh;
         QScopedPointer<QRhiBuffer> ubuf;
         QScopedPointer<QRhiShaderResourceBindings> srb;
         QScopedPointer<QRhiGraphicsPipeline> ps;
+        // the same as srb and ps, with a dynamic offset for the uniform buffer
+        QScopedPointer<QRhiShaderResourceBindings> objectLayoutSrb;
+        QScopedPointer<QRhiGraphicsPipeline> objectPs;
+        std::vector<std::unique_ptr<QRhiShaderResourceBindings>> objectSrbs; // per uniform block
+        std::vector<QRhiWidgetTransientAllocator::Allocation> objectUniforms;
         QScopedPointer<QRhiSampler> sampler;
         QScopedPointer<QRhiTexture> cubeTex;
         QMatrix4x4 mvp;
+
+        // text drawn into cubeTex on top of a copy of backgroundTex
+        QScopedPointer<QRhiTexture> backgroundTex;
+        ExampleGlyphAtlas glyphAtlas;
+        std::vector<ExampleGlyphAtlas::Vertex> textVertices;
+        QScopedPointer<QRhiBuffer> textVbuf;
+        QScopedPointer<QRhiSampler> textSampler;
+        QScopedPointer<QRhiShaderResourceBindings> textSrb;
+        QScopedPointer<QRhiTextureRenderTarget> textRt;
+        QScopedPointer<QRhiRenderPassDescriptor> textRp;
+        QScopedPointer<QRhiGraphicsPipeline> textPs;
     } scene;
 
     void initScene();
+    void initTextScene();
+    void initPipeline();
+    QRhiGraphicsPipeline *newCubePipeline(QRhiShaderResourceBindings *srb);
+    void updateObjectUniforms();
+    void renderObjects(QRhiCommandBuffer *cb);
     void updateMvp();
+    void requestCubeTexture(const QString &text);
     void updateCubeTexture();
+    QRhiResourceUpdateBatch *updateCubeText();
+    void renderCubeText(QRhiCommandBuffer *cb, QRhiResourceUpdateBatch *u);
+    void updateInstances();
 
-    struct {
+    struct ItemData {
         QString cubeText;
         bool cubeTextDirty = false;
         float cubeRotation = 0.0f;
         bool cubeRotationDirty = false;
-    } itemData;
+    };
+    ItemData itemData;
+
+    // per-instance translation and scale (xyz, w), and rotation (x, y, z, scalar)
+    struct InstanceData {
+        float translationScale[4];
+        float rotation[4];
+    };
+
+    struct Instances {
+        std::vector<InstanceData> data = { { { 0, 0, 0, 1 }, { 0, 0, 0, 1 } } };
+        int dirtyBegin = 0;
+        int dirtyEnd = 1;
+    };
+    Instances instances;
+
+    // What render() works with, copied from the above in synchronize(), so
+    // that the widget works with threaded rendering too.
+    struct {
+        ItemData itemData;
+        TextRendering textRendering = GlyphAtlasText;
+        bool perObjectUniforms = false;
+        bool perObjectUniformsDirty = false;
+        Instances instances;
+        QImage cubeImage; // completed by the producer, not yet uploaded
+    } synced;
 };
 
 #endif
@@ -10,6 +10,8 @@
 #include "examplewidget.h"
 
 static const bool TEST_OFFSCREEN_GRAB = false;
+// needs a graphics API other than OpenGL, see setApi()
+static const bool TEST_THREADED_RENDERING = false;
 
 int main(int argc, char **argv)
 {
@@ -21,6 +23,8 @@ int main(int argc, char **argv)
     QLineEdit *edit = new QLineEdit(QLatin1String("Text on cube"));
     QSlider *slider = new QSlider(Qt::Horizontal);
     ExampleRhiWidget *rw = new ExampleRhiWidget;
+    if (TEST_THREADED_RENDERING)
+        rw->setThreadedRendering(true);
 
     QObject::connect(edit, &QLineEdit::textChanged, edit, [edit, rw] {
         rw->setCubeTextureText(edit->text());
@@ -34,16 +38,17 @@ int main(int argc, char **argv)
 
     QPushButton *btn = new QPushButton(QLatin1String("Grab to image"));
     QObject::connect(btn, &QPushButton::clicked, btn, [rw] {
-        QImage image = rw->grabTexture();
-        qDebug() << image;
-        if (!image.isNull()) {
-            QFileDialog fd(rw->parentWidget());
-            fd.setAcceptMode(QFileDialog::AcceptSave);
-            fd.setDefaultSuffix("png");
-            fd.selectFile("test.png");
-            if (fd.exec() == QDialog::Accepted)
-                image.save(fd.selectedFiles().first());
-        }
+        rw->grabTextureAsync().then(rw, [rw](const QImage &image) {
+            qDebug() << image;
+            if (!image.isNull()) {
+                QFileDialog fd(rw->parentWidget());
+                fd.setAcceptMode(QFileDialog::AcceptSave);
+                fd.setDefaultSuffix("png");
+                fd.selectFile("test.png");
+                if (fd.exec() == QDialog::Accepted)
+                    image.save(fd.selectedFiles().first());
+            }
+        });
     });
     QHBoxLayout *btnLayout = new QHBoxLayout;
     btnLayout->addWidget(btn);
@@ -55,6 +60,22 @@ int main(int argc, char **argv)
             rw->setExplicitSize(QSize());
     });
     btnLayout->addWidget(cbExplicitSize);
+    QCheckBox *cbHalfResolution = new QCheckBox(QLatin1String("Half resolution"));
+    QObject::connect(cbHalfResolution, &QCheckBox::stateChanged, cbHalfResolution, [cbHalfResolution, rw] {
+        rw->setResolutionScale(cbHalfResolution->isChecked() ? 0.5 : 1.0);
+    });
+    btnLayout->addWidget(cbHalfResolution);
+    QCheckBox *cbPerObject = new QCheckBox(QLatin1String("1000 cubes with per-object uniforms"));
+    QObject::connect(cbPerObject, &QCheckBox::stateChanged, cbPerObject, [cbPerObject, rw] {
+        rw->setInstanceCount(cbPerObject->isChecked() ? 1000 : 1);
+        rw->setPerObjectUniforms(cbPerObject->isChecked());
+    });
+    btnLayout->addWidget(cbPerObject);
+    QCheckBox *cbViews = new QCheckBox(QLatin1String("Four views"));
+    QObject::connect(cbViews, &QCheckBox::stateChanged, cbViews, [cbViews, rw] {
+        rw->setViewGrid(cbViews->isChecked() ? 2 : 1, cbViews->isChecked() ? 2 : 1);
+    });
+    btnLayout->addWidget(cbViews);
     QPushButton *btnMakeWindow = new QPushButton(QLatin1String("Make top-level window"));
     QObject::connect(btnMakeWindow, &QPushButton::clicked, btnMakeWindow, [rw, btnMakeWindow, layout] {
         if (rw->parentWidget()) {
@@ -1,8 +1,14 @@
 #include "rhiwidget_p.h"
+#include "rhiwidgetformats_p.h"
+#include "rhiwidgetpool_p.h"
+#include "rhiwidgetpipelinecache_p.h"
 
 #include <private/qguiapplication_p.h>
 #include <qpa/qplatformintegration.h>
 #include <private/qwidgetrepaintmanager_p.h>
+#include <QScreen>
+
+#include <algorithm>
 
 /*!
     \class QRhiWidget
@@ -60,8 +66,16 @@ QRhiWidget::QRhiWidget(QWidget *parent, Qt::WindowFlags f)
 QRhiWidget::~QRhiWidget()
 {
     Q_D(QRhiWidget);
+    if (d->scheduler)
+        d->scheduler->removeWidget(this);
     // rhi resources must be destroyed here, cannot be left to the private dtor
-    delete d->t;
+    // (the render thread releases what belongs to its QRhi when stopping,
+    // after the window has let go of a texture imported from it)
+    d->releaseCompositeTexture();
+    d->renderThread.reset();
+    d->capture.reset();
+    d->resetRenderTarget();
+    d->releaseTexture();
     d->offscreenRhiResources.reset();
 }
 
@@ -69,6 +83,9 @@ QRhiWidget::~QRhiWidget()
     Handles resize events that are passed in the \a e event parameter. Calls
     the virtual function initialize().
 
+    When textureResizeDelay is set, the texture and initialize() are only
+    updated once the resizing has settled.
+
     \note Avoid overriding this function in derived classes. If that is not
     feasible, make sure that QRhiWidget's implementation is invoked too.
     Otherwise the underlying texture object and related resources will not get
@@ -84,6 +101,11 @@ void QRhiWidget::resizeEvent(QResizeEvent *e)
     }
     d->noSize = false;
 
+    // while resizing interactively, keep using the existing texture and only
+    // reallocate once no further resize arrived within the delay
+    if (d->resizeDelay > 0 && (d->threaded ? d->compositeTexture : d->t) && d->explicitSize.isEmpty())
+        d->resizeTimer.start(d->resizeDelay, this);
+
     d->sendPaintEvent(QRect(QPoint(0, 0), size()));
 }
 
@@ -100,26 +122,59 @@ void QRhiWidget::resizeEvent(QResizeEvent *e)
 void QRhiWidget::paintEvent(QPaintEvent *)
 {
     Q_D(QRhiWidget);
-    if (!updatesEnabled() || d->noSize)
+    if (!updatesEnabled() || d->noSize) {
+        d->failPendingGrabs();
+        return;
+    }
+
+    if (d->threaded && d->ensureRenderThread()) {
+        d->paintThreaded();
         return;
+    }
 
     d->ensureRhi();
     if (!d->rhi) {
         qWarning("QRhiWidget: No QRhi");
+        d->failPendingGrabs();
+        return;
+    }
+
+    if (d->paintBatched())
+        return;
+
+    bool needed = false;
+    if (!d->preparePaintFrame(&needed)) {
+        d->failPendingGrabs();
         return;
     }
 
-    const QSize prevSize = d->t ? d->t->pixelSize() : QSize();
-    d->ensureTexture();
-    if (!d->t)
+    // Expose events, showing, and repaints of siblings all end up here. When
+    // the contents are the same, the window composites the texture as it is.
+    if (!needed) {
+        ++d->stats.skippedFrameCount;
         return;
-    if (d->t->pixelSize() != prevSize)
-        initialize(d->rhi, d->t);
+    }
+
+    QElapsedTimer frameTimer;
+    frameTimer.start();
 
     QRhiCommandBuffer *cb = nullptr;
     d->rhi->beginOffscreenFrame(&cb);
     render(cb);
+    const qint64 renderTime = frameTimer.nsecsElapsed();
+    if (!d->pendingGrabs.empty())
+        d->enqueueAsyncGrab(cb);
+    const qint64 droppedCaptureFrame = d->capture && d->capture->isFrameDue()
+            ? d->enqueueCaptureReadback(cb) : -1;
+    const qint64 endFrameStart = frameTimer.nsecsElapsed();
     d->rhi->endOffscreenFrame();
+    const qint64 frameTime = frameTimer.nsecsElapsed();
+
+    d->recordFrameTimings(renderTime, frameTime - endFrameStart);
+    d->frameRendered(frameTime);
+
+    if (droppedCaptureFrame >= 0)
+        emit captureFrameDropped(droppedCaptureFrame);
 }
 
 /*!
@@ -133,10 +188,28 @@ bool QRhiWidget::event(QEvent *e)
         // the QRhi will almost certainly change, prevent texture() from
         // returning the existing QRhiTexture in the meantime
         d->textureInvalid = true;
+        d->rhiResolved = false;
+        d->updateScheduling();
         break;
     case QEvent::Show:
+        // the top-level may have got a new QRhi while hidden
+        d->rhiResolved = false;
         if (isVisible())
             d->sendPaintEvent(QRect(QPoint(0, 0), size()));
+        d->updateScheduling();
+        break;
+    case QEvent::Hide:
+    case QEvent::ParentChange:
+        d->updateScheduling();
+        break;
+    case QEvent::Timer:
+        if (static_cast<QTimerEvent *>(e)->timerId() == d->resizeTimer.timerId()) {
+            d->resizeTimer.stop();
+            update();
+            return true;
+        }
+        break;
+    default:
         break;
     }
     return QWidget::event(e);
@@ -147,16 +220,24 @@ QPlatformBackingStoreRhiConfig QRhiWidgetPrivate::rhiConfig() const
     return config;
 }
 
-void QRhiWidgetPrivate::ensureRhi()
+QRhi *QRhiWidgetPrivate::windowRhi() const
 {
-    Q_Q(QRhiWidget);
+    Q_Q(const QRhiWidget);
     // the QRhi and infrastructure belongs to the top-level widget, not to this widget
-    QWidget *tlw = q->window();
-    QWidgetPrivate *wd = get(tlw);
-
-    QRhi *currentRhi = nullptr;
+    QWidgetPrivate *wd = get(q->window());
     if (QWidgetRepaintManager *repaintManager = wd->maybeRepaintManager())
-        currentRhi = repaintManager->rhi();
+        return repaintManager->rhi();
+    return nullptr;
+}
+
+void QRhiWidgetPrivate::ensureRhi()
+{
+    // Once found, the top-level's QRhi is used until the widget is moved into
+    // another window, no need to walk up to the top-level in every frame.
+    if (rhiResolved)
+        return;
+
+    QRhi *currentRhi = windowRhi();
 
     if (currentRhi && currentRhi->backend() != QBackingStoreRhiSupport::apiToRhiBackend(config.api())) {
         qWarning("The top-level window is already using another graphics API for composition, "
@@ -168,44 +249,776 @@ void QRhiWidgetPrivate::ensureRhi()
     if (currentRhi && rhi && rhi != currentRhi) {
         // the texture belongs to the old rhi, drop it, this will also lead to
         // initialize() being called again
-        delete t;
-        t = nullptr;
+        resetRenderTarget();
+        releaseTexture();
         // if previously we created our own but now get a QRhi from the
         // top-level, then drop what we have and start using the top-level's
         if (rhi == offscreenRhiResources.rhi)
             offscreenRhiResources.reset();
     }
 
-    rhi = currentRhi;
+    if (currentRhi) {
+        rhi = currentRhi;
+        rhiResolved = true;
+    } else {
+        // not composited (yet), keep using the QRhi of the offscreen
+        // renderer or the one created for grabs, if any
+        rhi = offscreenRendererRhi ? offscreenRendererRhi : offscreenRhiResources.rhi;
+    }
 }
 
-void QRhiWidgetPrivate::ensureTexture()
+void QRhiWidgetPrivate::syncSettings()
 {
     Q_Q(QRhiWidget);
+    settings.pixelSize = explicitSize;
+    if (settings.pixelSize.isEmpty()) {
+        const qreal scale = q->devicePixelRatio() * effectiveResolutionScale();
+        settings.pixelSize = QSize(qMax(1, qRound(q->width() * scale)), qMax(1, qRound(q->height() * scale)));
+    }
+    settings.format = format;
+    settings.pipelineCacheFile = pipelineCacheFile;
+    settings.samples = samples;
+    settings.autoRenderTarget = autoRenderTarget;
+    settings.renderTargetDirty = settings.renderTargetDirty || renderTargetDirty;
+    renderTargetDirty = false;
+    settings.resizePending = resizeTimer.isActive();
+    settings.viewsChanged = viewLayoutDirty;
+    if (viewLayoutDirty) {
+        settings.viewLayout = viewLayout;
+        viewLayoutDirty = false;
+    }
+}
+
+// Views are snapped to whole pixels, so that neighbouring views neither
+// overlap nor leave gaps. QRhiViewport and QRhiScissor have their origin at
+// the bottom-left with all backends. Computed from the size of the texture,
+// which lags behind settings.pixelSize while a resize is delayed.
+void QRhiWidgetPrivate::updateViews()
+{
+    const QSize size = t->pixelSize();
+    settings.viewsPixelSize = size;
+    settings.views.clear();
+    if (settings.viewLayout.isEmpty()) {
+        QRhiWidget::View view;
+        view.rect = QRect(QPoint(0, 0), size);
+        view.viewport = QRhiViewport(0, 0, size.width(), size.height());
+        view.scissor = QRhiScissor(0, 0, size.width(), size.height());
+        settings.views.append(view);
+        return;
+    }
+    for (int i = 0; i < settings.viewLayout.size(); ++i) {
+        const QRectF &r(settings.viewLayout[i]);
+        const int x0 = qBound(0, qRound(r.left() * size.width()), size.width());
+        const int x1 = qBound(0, qRound(r.right() * size.width()), size.width());
+        const int y0 = qBound(0, qRound(r.top() * size.height()), size.height());
+        const int y1 = qBound(0, qRound(r.bottom() * size.height()), size.height());
+        if (x1 <= x0 || y1 <= y0)
+            continue;
+        QRhiWidget::View view;
+        view.index = i;
+        view.rect = QRect(x0, y0, x1 - x0, y1 - y0);
+        view.viewport = QRhiViewport(x0, size.height() - y1, x1 - x0, y1 - y0);
+        view.scissor = QRhiScissor(x0, size.height() - y1, x1 - x0, y1 - y0);
+        settings.views.append(view);
+    }
+}
 
-    QSize newSize = explicitSize;
-    if (newSize.isEmpty())
-        newSize = q->size() * q->devicePixelRatio();
+void QRhiWidgetPrivate::ensureTexture(bool *changed)
+{
+    const QSize newSize = settings.pixelSize;
+    const QRhiTexture::Format format = settings.format;
 
     if (!t) {
+        // first time with this QRhi, before initialize() creates pipelines
+        if (!settings.pipelineCacheFile.isEmpty())
+            QRhiWidgetPipelineCache::attach(rhi, settings.pipelineCacheFile);
         if (!rhi->isTextureFormatSupported(format))
             qWarning("QRhiWidget: The requested texture format is not supported by the graphics API implementation");
-        t = rhi->newTexture(format, newSize, 1, QRhiTexture::RenderTarget | QRhiTexture::UsedAsTransferSource);
-        if (!t->create()) {
+        t = QRhiWidgetResourcePool::forRhi(rhi)->acquireTexture(format, newSize);
+        if (!t) {
             qWarning("Failed to create backing texture for QRhiWidget");
-            delete t;
-            t = nullptr;
             return;
         }
+        ++stats.textureReallocationCount;
+        *changed = true;
+    }
+
+    if (t->pixelSize() != newSize && !settings.resizePending) {
+        // prefer a texture of the new size given back by another widget,
+        // otherwise resize in place
+        QRhiWidgetResourcePool *pool = QRhiWidgetResourcePool::forRhi(rhi);
+        if (textureShared) {
+            // the window may still composite the old texture, which can
+            // neither be resized in place nor be given back yet
+            retiredTextures.push_back(t);
+            t = pool->acquireTexture(format, newSize);
+            if (!t) {
+                qWarning("Failed to create backing texture for QRhiWidget after resizing");
+                return;
+            }
+        } else if (QRhiTexture *freeTexture = pool->takeFreeTexture(format, newSize)) {
+            pool->releaseTexture(t);
+            t = freeTexture;
+        } else {
+            t->setPixelSize(newSize);
+            if (!t->create())
+                qWarning("Failed to rebuild texture for QRhiWidget after resizing");
+        }
+        ++stats.textureReallocationCount;
+        *changed = true;
+    }
+
+    if (*changed || settings.renderTargetDirty) {
+        ensureRenderTarget();
+        *changed = true;
+    }
+
+    // only reallocated when the layout or the size changes, not per frame
+    if (settings.viewsChanged || settings.viewsPixelSize != t->pixelSize())
+        updateViews();
+}
+
+void QRhiWidgetPrivate::ensureRenderTarget()
+{
+    settings.renderTargetDirty = false;
+
+    // the highest supported sample count not exceeding the requested one
+    int effectiveSamples = 1;
+    if (settings.samples > 1) {
+        for (int supportedSamples : rhi->supportedSampleCounts()) {
+            if (supportedSamples <= settings.samples)
+                effectiveSamples = qMax(effectiveSamples, supportedSamples);
+        }
+    }
+
+    if (!settings.autoRenderTarget && effectiveSamples <= 1) {
+        resetRenderTarget();
+        return;
+    }
+
+    // a different sample count needs a new render pass descriptor as well,
+    // but otherwise the render pass descriptor is kept
+    if (depthStencil && depthStencil->sampleCount() != effectiveSamples)
+        resetRenderTarget();
+
+    // The depth-stencil and multisample color buffers come from the pool,
+    // shared with other widgets of the same size. Acquire first, then
+    // release, so that a buffer that stays the same is not destroyed in
+    // between.
+    QRhiWidgetResourcePool *pool = QRhiWidgetResourcePool::forRhi(rhi);
+    const QSize pixelSize = t->pixelSize();
+    QRhiRenderBuffer *newMsaaColorBuffer = nullptr;
+    if (effectiveSamples > 1) {
+        newMsaaColorBuffer = pool->acquireRenderBuffer(QRhiRenderBuffer::Color, pixelSize, effectiveSamples, settings.format);
+        if (!newMsaaColorBuffer)
+            qWarning("Failed to build multisample color buffer for QRhiWidget");
+    }
+    QRhiRenderBuffer *newDepthStencil = pool->acquireRenderBuffer(QRhiRenderBuffer::DepthStencil, pixelSize,
+                                                                  effectiveSamples, QRhiTexture::UnknownFormat);
+    if (!newDepthStencil)
+        qWarning("Failed to build depth-stencil buffer for QRhiWidget");
+    releaseRenderBuffers();
+    msaaColorBuffer = newMsaaColorBuffer;
+    depthStencil = newDepthStencil;
+    if (!depthStencil || (effectiveSamples > 1 && !msaaColorBuffer)) {
+        resetRenderTarget();
+        return;
+    }
+
+    QRhiColorAttachment color0;
+    if (msaaColorBuffer) {
+        color0.setRenderBuffer(msaaColorBuffer);
+        color0.setResolveTexture(t);
+    } else {
+        color0.setTexture(t);
+    }
+    const QRhiTextureRenderTargetDescription desc(color0, depthStencil);
+    if (!renderTarget) {
+        renderTarget = rhi->newTextureRenderTarget(desc);
+        rp = renderTarget->newCompatibleRenderPassDescriptor();
+        renderTarget->setRenderPassDescriptor(rp);
+    } else {
+        // the attachments may be different objects now, but with the same
+        // formats and sample count, so the render pass descriptor stays valid
+        renderTarget->setDescription(desc);
+    }
+    if (!renderTarget->create())
+        qWarning("Failed to build render target for QRhiWidget");
+}
+
+void QRhiWidgetPrivate::resetRenderTarget()
+{
+    delete renderTarget;
+    renderTarget = nullptr;
+    delete rp;
+    rp = nullptr;
+    releaseRenderBuffers();
+}
+
+void QRhiWidgetPrivate::releaseRenderBuffers()
+{
+    // if the pool is gone, the QRhi is gone too, and the pool has taken the
+    // buffers down with it
+    QRhiWidgetResourcePool *pool = rhi ? QRhiWidgetResourcePool::forRhi(rhi, false) : nullptr;
+    if (pool) {
+        if (msaaColorBuffer)
+            pool->releaseRenderBuffer(msaaColorBuffer);
+        if (depthStencil)
+            pool->releaseRenderBuffer(depthStencil);
+    }
+    msaaColorBuffer = nullptr;
+    depthStencil = nullptr;
+}
+
+void QRhiWidgetPrivate::releaseTexture()
+{
+    if (!t)
+        return;
+    if (QRhiWidgetResourcePool *pool = rhi ? QRhiWidgetResourcePool::forRhi(rhi, false) : nullptr)
+        pool->releaseTexture(t);
+    else
+        delete t;
+    t = nullptr;
+}
+
+// Starts the render thread on first use. The thread creates its QRhi when
+// the first frame is requested.
+bool QRhiWidgetPrivate::ensureRenderThread()
+{
+    Q_Q(QRhiWidget);
+    if (renderThread)
+        return true;
+
+    if (config.api() == QPlatformBackingStoreRhiConfig::OpenGL) {
+        // the window's OpenGL context is bound to the GUI thread, and the
+        // texture contents would need flipping as well
+        qWarning("QRhiWidget: Threaded rendering is not supported with OpenGL, rendering on the GUI thread");
+        threaded = false;
+        emit q->threadedRenderingChanged(false);
+        return false;
+    }
+
+    rhi = nullptr;
+    rhiResolved = false;
+    renderThread.reset(new QRhiWidgetRenderThread(q, this, config));
+    renderThread->start();
+    return true;
+}
+
+void QRhiWidgetPrivate::waitForRenderThread() const
+{
+    if (renderThread)
+        renderThread->waitForIdle();
+}
+
+void QRhiWidgetPrivate::paintThreaded()
+{
+    // The update() made when handing back a frame comes here too. It needs
+    // no new frame by itself, startThreadedFrame() skips it unless the
+    // application changed something, which needsRender() has to tell, as an
+    // update() the application requested meanwhile is folded into it.
+    //
+    // one frame in flight at most, the updates requested meanwhile are
+    // served by one frame started once the current one is handed back
+    if (renderThread->isReady())
+        startThreadedFrame(false);
+    else
+        threadedFramePending = true;
+}
+
+// The sync point: the render thread is idle, so both the subclass and the
+// widget can copy the state of the GUI thread over to the render side.
+void QRhiWidgetPrivate::startThreadedFrame(bool forceRender)
+{
+    Q_Q(QRhiWidget);
+    q->synchronize();
+    syncSettings();
+    threadedFramePending = false;
+
+    // as in paintEvent(), with the texture the window composites standing in
+    // for the one the render thread would reallocate
+    if (!forceRender && compositeTexture && !textureInvalid && pendingGrabs.empty()
+            && (compositeTexture->pixelSize() == settings.pixelSize || settings.resizePending)
+            && !settings.renderTargetDirty && !settings.viewsChanged && !q->needsRender())
+    {
+        ++stats.skippedFrameCount;
+        return;
+    }
+
+    const quint64 sequence = ++threadedFrameSequence;
+    QRhi *currentRhi = windowRhi();
+    // the render thread creates its QRhi for the first frame
+    if (sequence == 1 && currentRhi && renderThread->shareDevice(currentRhi))
+        textureShareRhi = currentRhi;
+    // Grabs need the contents in system memory, and so does a window that
+    // cannot import the texture, such as after moving to another window.
+    const bool readBack = forceRender || !pendingGrabs.empty()
+            || !textureShareRhi || currentRhi != textureShareRhi;
+    if (!pendingGrabs.empty()) {
+        inFlightGrabs.push_back({ sequence, std::move(pendingGrabs) });
+        pendingGrabs.clear();
+    }
+    renderThread->requestFrame(sequence, readBack);
+}
+
+// Called on the render thread, the QRhi is the render thread's own.
+void QRhiWidgetPrivate::renderThreadFrame(QRhiWidgetThreadedFrame *frame)
+{
+    Q_Q(QRhiWidget);
+    // Textures replaced before this frame were composited by the window at
+    // most until it got the previous frame. What the window submitted until
+    // then completes before this frame does, on the shared queue.
+    std::vector<QRhiTexture *> replacedTextures;
+    replacedTextures.swap(retiredTextures);
+    bool changed = false;
+    ensureTexture(&changed);
+    if (!t) {
+        retiredTextures.insert(retiredTextures.end(), replacedTextures.begin(), replacedTextures.end());
+        return;
+    }
+    if (changed)
+        invokeInitialize();
+
+    QElapsedTimer frameTimer;
+    frameTimer.start();
+
+    QRhiCommandBuffer *cb = nullptr;
+    rhi->beginOffscreenFrame(&cb);
+    q->render(cb);
+    const qint64 renderTime = frameTimer.nsecsElapsed();
+    // for grabs, and for a window that cannot import the texture, the
+    // contents travel to the window's QRhi through system memory
+    if (frame->readBack) {
+        QRhiResourceUpdateBatch *readbackBatch = rhi->nextResourceUpdateBatch();
+        readbackBatch->readBackTexture(t, &frame->readback);
+        cb->resourceUpdate(readbackBatch);
+    }
+    frame->droppedCaptureFrame = capture && capture->isFrameDue() ? enqueueCaptureReadback(cb) : -1;
+    const qint64 endFrameStart = frameTimer.nsecsElapsed();
+    rhi->endOffscreenFrame();
+    frame->frameNsecs = frameTimer.nsecsElapsed();
+
+    recordFrameTimings(renderTime, frame->frameNsecs - endFrameStart);
+    releaseRetiredTextures(&replacedTextures);
+    if (frame->sharesTexture) {
+        frame->texture = t->nativeTexture();
+        frame->format = t->format();
+        frame->pixelSize = t->pixelSize();
+    }
+    frame->rendered = true;
+}
+
+// Queued from the render thread when a frame has completed.
+void QRhiWidgetPrivate::threadedFrameCompleted()
+{
+    Q_Q(QRhiWidget);
+    if (!renderThread)
+        return;
+
+    // a synchronous grab may have taken the frames already
+    std::vector<QRhiWidgetThreadedFrame> frames;
+    if (renderThread->takeFrames(&frames))
+        presentThreadedFrames(&frames);
+
+    // Updates were requested meanwhile, let the next paint event start the
+    // frame, after the window got what was just handed back.
+    if (threadedFramePending && q->isVisible())
+        q->update();
+}
+
+// Called on the GUI thread with the frames taken from the render thread,
+// oldest first, while the render thread is idle. Only the most recent frame
+// rendered is handed to the window to composite, but each frame serves its
+// own grabs.
+void QRhiWidgetPrivate::presentThreadedFrames(std::vector<QRhiWidgetThreadedFrame> *frames)
+{
+    Q_Q(QRhiWidget);
+    auto newest = std::find_if(frames->rbegin(), frames->rend(), [](const QRhiWidgetThreadedFrame &f) {
+        return f.rendered;
+    });
+
+    // Before the grabs, which may take over the data.
+    QRhi *currentRhi = newest != frames->rend() ? windowRhi() : nullptr;
+    if (currentRhi) {
+        if (currentRhi != compositeRhi) {
+            releaseCompositeTexture();
+            compositeRhi = currentRhi;
+        }
+        if (newest->sharesTexture && compositeRhi == textureShareRhi) {
+            importCompositeTexture(*newest);
+        } else if (!newest->readback.pixelSize.isEmpty()) {
+            uploadCompositeTexture(newest->readback);
+        } else {
+            // Nothing the window can use, the render thread did not get the
+            // window's device after all, or the widget is in another window
+            // now. The next frame is read back.
+            if (!newest->sharesTexture)
+                textureShareRhi = nullptr;
+            q->update();
+        }
+    }
+
+    for (QRhiWidgetThreadedFrame &frame : *frames) {
+        if (frame.rendered) {
+            frameRendered(frame.frameNsecs);
+            if (frame.droppedCaptureFrame >= 0)
+                emit q->captureFrameDropped(frame.droppedCaptureFrame);
+        }
+        const bool readBack = frame.rendered && !frame.readback.pixelSize.isEmpty();
+        auto it = inFlightGrabs.begin();
+        for (; it != inFlightGrabs.end() && it->sequence <= frame.sequence; ++it) {
+            if (readBack) {
+                ++stats.grabCount;
+                finishGrabs(&it->grabs, &frame.readback);
+            } else {
+                // nothing rendered, the grabs get a null image
+                for (PendingGrab &pendingGrab : it->grabs) {
+                    pendingGrab.promise.addResult(QImage());
+                    pendingGrab.promise.finish();
+                }
+            }
+        }
+        inFlightGrabs.erase(inFlightGrabs.begin(), it);
     }
+}
 
-    if (t->pixelSize() != newSize) {
-        t->setPixelSize(newSize);
-        if (!t->create())
-            qWarning("Failed to rebuild texture for QRhiWidget after resizing");
+// The window composites the render thread's texture itself, nothing is
+// copied and nothing is waited for.
+void QRhiWidgetPrivate::importCompositeTexture(const QRhiWidgetThreadedFrame &frame)
+{
+    Q_Q(QRhiWidget);
+    if (compositeTexture && (!compositeTextureImported
+                             || compositeTexture->nativeTexture().object != frame.texture.object
+                             || compositeTexture->pixelSize() != frame.pixelSize
+                             || compositeTexture->format() != frame.format))
+    {
+        releaseCompositeTexture();
+    }
+    if (!compositeTexture) {
+        QRhiTexture *texture = compositeRhi->newTexture(frame.format, frame.pixelSize, 1,
+                                                        QRhiTexture::RenderTarget | QRhiTexture::UsedAsTransferSource);
+        if (!texture->createFrom(frame.texture)) {
+            qWarning("Failed to import the render thread's texture for QRhiWidget");
+            delete texture;
+            return;
+        }
+        compositeTexture = texture;
+        compositeTextureImported = true;
     }
+    textureInvalid = false;
+    q->update();
+}
 
+// Uploads the contents read back on the render thread to a texture of the
+// window's QRhi. This is a short frame of its own on the window's QRhi, and
+// the GUI thread waits for the copy.
+void QRhiWidgetPrivate::uploadCompositeTexture(const QRhiReadbackResult &readback)
+{
+    Q_Q(QRhiWidget);
+    if (compositeTexture && (compositeTextureImported
+                             || compositeTexture->pixelSize() != readback.pixelSize
+                             || compositeTexture->format() != readback.format))
+    {
+        releaseCompositeTexture();
+    }
+    if (!compositeTexture)
+        compositeTexture = QRhiWidgetResourcePool::forRhi(compositeRhi)->acquireTexture(readback.format, readback.pixelSize);
+    if (!compositeTexture) {
+        qWarning("Failed to create composited texture for QRhiWidget");
+        return;
+    }
+    QRhiResourceUpdateBatch *u = compositeRhi->nextResourceUpdateBatch();
+    u->uploadTexture(compositeTexture,
+                     QRhiTextureUploadDescription({ 0, 0, QRhiTextureSubresourceUploadDescription(readback.data) }));
+    QRhiCommandBuffer *cb = nullptr;
+    compositeRhi->beginOffscreenFrame(&cb);
+    cb->resourceUpdate(u);
+    compositeRhi->endOffscreenFrame();
     textureInvalid = false;
+    q->update();
+}
+
+void QRhiWidgetPrivate::releaseCompositeTexture()
+{
+    if (!compositeTexture)
+        return;
+    // an imported texture is a wrapper only, the render thread owns the
+    // native texture
+    QRhiWidgetResourcePool *pool = compositeRhi && !compositeTextureImported
+            ? QRhiWidgetResourcePool::forRhi(compositeRhi, false) : nullptr;
+    if (pool)
+        pool->releaseTexture(compositeTexture);
+    else
+        delete compositeTexture;
+    compositeTexture = nullptr;
+    compositeTextureImported = false;
+}
+
+// Called on the render thread.
+void QRhiWidgetPrivate::releaseRetiredTextures(std::vector<QRhiTexture *> *textures)
+{
+    QRhiWidgetResourcePool *pool = rhi ? QRhiWidgetResourcePool::forRhi(rhi, false) : nullptr;
+    for (QRhiTexture *texture : *textures) {
+        if (pool)
+            pool->releaseTexture(texture);
+        else
+            delete texture;
+    }
+    textures->clear();
+}
+
+static QRhiWidgetFormats::AlphaConversion toAlphaConversion(QRhiWidget::GrabAlphaMode alphaMode)
+{
+    switch (alphaMode) {
+    case QRhiWidget::GrabPremultiplyAlpha:
+        return QRhiWidgetFormats::PremultiplyAlpha;
+    case QRhiWidget::GrabUnpremultiplyAlpha:
+        return QRhiWidgetFormats::UnpremultiplyAlpha;
+    default:
+        return QRhiWidgetFormats::NoAlphaConversion;
+    }
+}
+
+void QRhiWidgetPrivate::updateScheduling()
+{
+    Q_Q(QRhiWidget);
+    QRhiWidgetScheduler *newScheduler = nullptr;
+    if (updateBehavior != QRhiWidget::OnDemandUpdates && q->isVisible())
+        newScheduler = QRhiWidgetScheduler::forWindow(q->window());
+
+    if (scheduler && scheduler != newScheduler)
+        scheduler->removeWidget(q);
+    scheduler = newScheduler;
+    if (!scheduler)
+        return;
+
+    qreal fps = 0;
+    if (updateBehavior == QRhiWidget::ContinuousUpdates)
+        fps = q->screen() ? q->screen()->refreshRate() : 0;
+    else
+        fps = maximumFrameRate;
+    if (fps <= 0)
+        fps = 60;
+    scheduler->setWidget(q, qint64(1000000000.0 / fps));
+}
+
+void QRhiWidgetPrivate::frameRendered(qint64 costNsecs)
+{
+    Q_Q(QRhiWidget);
+    if (scheduler)
+        scheduler->reportFrameCost(q, costNsecs);
+
+    ++stats.renderedFrameCount;
+
+    if (resolution.isEnabled()) {
+        const qreal oldScale = resolution.scale();
+        if (resolution.addFrame(costNsecs))
+            updateResolution(oldScale);
+    }
+    ++frameRateFrameCount;
+    if (!frameRateTimer.isValid()) {
+        frameRateTimer.start();
+        return;
+    }
+    const qint64 elapsed = frameRateTimer.elapsed();
+    if (elapsed >= 1000) {
+        frameRate = frameRateFrameCount * 1000.0 / elapsed;
+        frameRateFrameCount = 0;
+        frameRateTimer.restart();
+        emit q->frameRateChanged(frameRate);
+        QMutexLocker lock(&stats.mutex);
+        if (stats.enabled) {
+            // with threaded rendering, the samples are added on the render
+            // thread, under the same lock
+            stats.current.initializeTime = stats.initializeTime.statistics();
+            stats.current.renderTime = stats.renderTime.statistics();
+            stats.current.endFrameWaitTime = stats.endFrameWaitTime.statistics();
+            stats.current.textureReallocationCount = stats.textureReallocationCount.loadRelaxed();
+            stats.current.grabCount = stats.grabCount.loadRelaxed();
+            stats.current.renderedFrameCount = stats.renderedFrameCount.loadRelaxed();
+            stats.current.skippedFrameCount = stats.skippedFrameCount.loadRelaxed();
+            const QRhiWidget::FrameStatistics current = stats.current;
+            lock.unlock();
+            emit q->frameStatisticsChanged(current);
+        }
+    }
+}
+
+qreal QRhiWidgetPrivate::effectiveResolutionScale() const
+{
+    return resolution.isEnabled() ? resolution.scale() : resolutionScale;
+}
+
+// Called after anything affecting the effective scale was changed.
+void QRhiWidgetPrivate::updateResolution(qreal oldScale)
+{
+    Q_Q(QRhiWidget);
+    const qreal newScale = effectiveResolutionScale();
+    if (qFuzzyCompare(oldScale, newScale))
+        return;
+    emit q->effectiveResolutionScaleChanged(newScale);
+    // render at the new size, the window keeps compositing the old texture
+    // stretched until then
+    if (explicitSize.isEmpty())
+        q->update();
+}
+
+void QRhiWidgetPrivate::invokeInitialize()
+{
+    Q_Q(QRhiWidget);
+    QElapsedTimer timer;
+    timer.start();
+    q->initialize(rhi, t);
+    const qint64 nsecs = timer.nsecsElapsed();
+    QMutexLocker lock(&stats.mutex);
+    if (stats.enabled)
+        stats.initializeTime.add(nsecs);
+}
+
+void QRhiWidgetPrivate::recordFrameTimings(qint64 renderNsecs, qint64 endFrameNsecs)
+{
+    QMutexLocker lock(&stats.mutex);
+    if (!stats.enabled)
+        return;
+    stats.renderTime.add(renderNsecs);
+    stats.endFrameWaitTime.add(endFrameNsecs);
+}
+
+// enough for a few seconds at 60 frames per second
+static const size_t MAX_TIMING_SAMPLES = 256;
+
+void QRhiWidgetPrivate::TimingSamples::add(qint64 nsecs)
+{
+    if (samples.size() < MAX_TIMING_SAMPLES) {
+        samples.push_back(nsecs);
+    } else {
+        samples[next] = nsecs;
+        next = (next + 1) % MAX_TIMING_SAMPLES;
+    }
+}
+
+void QRhiWidgetPrivate::TimingSamples::clear()
+{
+    samples.clear();
+    // no allocations while recording later on
+    samples.reserve(MAX_TIMING_SAMPLES);
+    next = 0;
+}
+
+QRhiWidget::TimingStatistics QRhiWidgetPrivate::TimingSamples::statistics() const
+{
+    QRhiWidget::TimingStatistics result;
+    if (samples.empty())
+        return result;
+
+    std::vector<qint64> sorted = samples;
+    std::sort(sorted.begin(), sorted.end());
+    qint64 sum = 0;
+    for (qint64 v : sorted)
+        sum += v;
+    const size_t p99Index = qMin(sorted.size() - 1, (sorted.size() * 99) / 100);
+    result.min = sorted.front() / 1000000.0;
+    result.avg = sum / qreal(sorted.size()) / 1000000.0;
+    result.p99 = sorted[p99Index] / 1000000.0;
+    result.sampleCount = int(sorted.size());
+    return result;
+}
+
+QImage QRhiWidgetPrivate::imageFromReadback(QRhiReadbackResult &&result, QRhiWidget::GrabAlphaMode alphaMode) const
+{
+    Q_Q(const QRhiWidget);
+    if (result.data.isEmpty() || result.pixelSize.isEmpty())
+        return QImage();
+
+    const qsizetype bytesPerLine = result.data.size() / result.pixelSize.height();
+    QImage image = QRhiWidgetFormats::imageFromTextureData(std::move(result.data), result.pixelSize,
+                                                           bytesPerLine, result.format,
+                                                           toAlphaConversion(alphaMode));
+    image.setDevicePixelRatio(q->devicePixelRatio());
+    return image;
+}
+
+QImage QRhiWidgetPrivate::imageFromReadback(const QRhiReadbackResult &result, QRhiWidget::GrabAlphaMode alphaMode) const
+{
+    Q_Q(const QRhiWidget);
+    if (result.data.isEmpty() || result.pixelSize.isEmpty())
+        return QImage();
+
+    // the data is tightly packed
+    const qsizetype bytesPerLine = result.data.size() / result.pixelSize.height();
+    QImage image = QRhiWidgetFormats::imageFromTextureData(reinterpret_cast<const uchar *>(result.data.constData()),
+                                                           result.pixelSize, bytesPerLine, result.format,
+                                                           toAlphaConversion(alphaMode));
+    image.setDevicePixelRatio(q->devicePixelRatio());
+    return image;
+}
+
+void QRhiWidgetPrivate::enqueueAsyncGrab(QRhiCommandBuffer *cb)
+{
+    // The readback is recorded into the frame paintEvent() is submitting
+    // anyway. The result and the promises waiting for it must stay alive
+    // until the backend reports completion, so they live on the heap and
+    // clean up after themselves.
+    struct AsyncGrab {
+        QRhiReadbackResult result;
+        std::vector<PendingGrab> grabs;
+    };
+    AsyncGrab *grab = new AsyncGrab;
+    grab->grabs = std::move(pendingGrabs);
+    pendingGrabs.clear();
+    ++stats.grabCount;
+    grab->result.completed = [this, grab] {
+        finishGrabs(&grab->grabs, &grab->result);
+        delete grab;
+    };
+
+    QRhiResourceUpdateBatch *readbackBatch = rhi->nextResourceUpdateBatch();
+    readbackBatch->readBackTexture(t, &grab->result);
+    cb->resourceUpdate(readbackBatch);
+}
+
+// For a paint event that cannot render a frame, there is no readback for
+// the asynchronous grabs waiting for one either.
+void QRhiWidgetPrivate::failPendingGrabs()
+{
+    for (PendingGrab &pendingGrab : pendingGrabs) {
+        pendingGrab.promise.addResult(QImage());
+        pendingGrab.promise.finish();
+    }
+    pendingGrabs.clear();
+}
+
+void QRhiWidgetPrivate::finishGrabs(std::vector<PendingGrab> *grabs, QRhiReadbackResult *result)
+{
+    const QRhiWidget::GrabAlphaMode firstAlphaMode = grabs->front().alphaMode;
+    const bool sameAlphaMode = std::all_of(grabs->cbegin(), grabs->cend(),
+                                           [firstAlphaMode](const PendingGrab &pendingGrab) {
+                                               return pendingGrab.alphaMode == firstAlphaMode;
+                                           });
+    QImage images[3];
+    if (sameAlphaMode) // the common case, the image can take over the data
+        images[firstAlphaMode] = imageFromReadback(std::move(*result), firstAlphaMode);
+    for (PendingGrab &pendingGrab : *grabs) {
+        QImage &image(images[pendingGrab.alphaMode]);
+        if (image.isNull())
+            image = imageFromReadback(*result, pendingGrab.alphaMode);
+        pendingGrab.promise.addResult(image);
+        pendingGrab.promise.finish();
+    }
+}
+
+// Returns the number of the captured frame when it had to be dropped, -1 otherwise.
+qint64 QRhiWidgetPrivate::enqueueCaptureReadback(QRhiCommandBuffer *cb)
+{
+    qint64 frameNumber = 0;
+    QRhiReadbackResult *result = capture->acquireSlot(&frameNumber);
+    if (!result)
+        return frameNumber;
+
+    QRhiResourceUpdateBatch *readbackBatch = rhi->nextResourceUpdateBatch();
+    readbackBatch->readBackTexture(t, result);
+    cb->resourceUpdate(readbackBatch);
+    return -1;
 }
 
 /*!
@@ -336,6 +1149,53 @@ void QRhiWidget::setTextureFormat(QRhiTexture::Format format)
     d->format = format;
 }
 
+/*!
+    \return the pipeline cache file name, or an empty string if none is set.
+
+    \sa setPipelineCacheFile()
+ */
+QString QRhiWidget::pipelineCacheFile() const
+{
+    Q_D(const QRhiWidget);
+    return d->pipelineCacheFile;
+}
+
+/*!
+    Sets the file the graphics pipeline cache is loaded from and saved to.
+
+    When set, the contents of \a fileName are passed to
+    QRhi::setPipelineCacheData() when the widget first gets to use a QRhi,
+    before initialize() is called, and QRhi::pipelineCacheData() is written
+    back to the file when the QRhi is destroyed. With graphics APIs such as
+    Vulkan or OpenGL this avoids compiling shaders again when creating the
+    same graphics pipelines in subsequent runs of the application.
+
+    The file is replaced atomically. It is tagged with the graphics API, the
+    device, and the driver version, and contents created with a different
+    graphics API, GPU, or driver are ignored. The driver version comes from
+    the graphics API with Vulkan and OpenGL. With Direct 3D and Metal, where
+    the driver is updated with the operating system, the operating system's
+    version is used instead.
+
+    The QRhi, and with it the pipeline cache, is shared by all widgets in the
+    same top-level window. The cache file of the first widget using the QRhi
+    is used, the setting of other widgets is ignored.
+
+    \note Saving requires the QRhi to be created with
+    QRhi::EnablePipelineCacheDataSave, otherwise the file is only read and
+    never written.
+
+    \note This function must be called early enough, before the widget is added
+    to a widget hierarchy and displayed on screen.
+
+    \sa pipelineCacheFile()
+ */
+void QRhiWidget::setPipelineCacheFile(const QString &fileName)
+{
+    Q_D(QRhiWidget);
+    d->pipelineCacheFile = fileName;
+}
+
 /*!
     \property QRhiWidget::explicitSize
 
@@ -366,86 +1226,1351 @@ void QRhiWidget::setExplicitSize(const QSize &pixelSize)
 }
 
 /*!
-    Renders a new frame, reads the contents of the texture back, and returns it
-    as a QImage.
+    \property QRhiWidget::textureResizeDelay
 
-    When an error occurs, a null QImage is returned.
+    The time in milliseconds to wait, after the widget got resized, before the
+    associated texture is reallocated to follow the new size.
 
-    \note This function only supports reading back QRhiTexture::RGBA8 textures
-    at the moment. For other formats, the implementer of render() should
-    implement their own readback logic as they see fit.
+    By default the value is 0, meaning the texture is resized, and so
+    initialize() is called, whenever the widget's size changes. During an
+    interactive resize of the window this can mean a reallocation of the
+    texture and the subclass' dependent resources for each and every pixel of
+    size change.
 
-    The returned QImage will have a format of QImage::Format_RGBA8888.
-    QRhiWidget does not know the renderer's approach to blending and
-    composition, and therefore cannot know if the output has alpha
-    premultiplied.
+    With a positive value, the widget keeps rendering into the existing
+    texture, which gets stretched to the widget's current size when
+    composited, until no further resize happened within the given time. Only
+    then is the texture reallocated and initialize() called. A value of around
+    100 - 200 milliseconds is a good choice in practice.
 
-    This function can also be called when the QRhiWidget is not added to a
-    widget hierarchy belonging to an on-screen top-level window. This allows
+    The value has no effect when an explicitSize is set. grabTexture() always
+    works with the current size.
+ */
+
+int QRhiWidget::textureResizeDelay() const
+{
+    Q_D(const QRhiWidget);
+    return d->resizeDelay;
+}
+
+void QRhiWidget::setTextureResizeDelay(int msec)
+{
+    Q_D(QRhiWidget);
+    msec = qMax(0, msec);
+    if (d->resizeDelay != msec) {
+        d->resizeDelay = msec;
+        if (msec == 0 && d->resizeTimer.isActive()) {
+            d->resizeTimer.stop();
+            update();
+        }
+        emit textureResizeDelayChanged(msec);
+    }
+}
+
+/*!
+    \property QRhiWidget::resolutionScale
+
+    The fraction of the native resolution the widget renders at.
+
+    By default the value is 1.0, and the texture has the size of the widget in
+    native pixels. With a lower value, for example 0.5, the texture is
+    smaller, and the window upscales it when compositing. This trades
+    sharpness for rendering fewer pixels, which can help with content that is
+    expensive to render per pixel on high resolution screens. The value is
+    clamped to the range 0.1 - 1.0.
+
+    When a targetFrameTime is set, the resolution is adjusted automatically,
+    and this value is the upper limit for the adjustment.
+
+    The value has no effect when an explicitSize is set.
+
+    \sa effectiveResolutionScale, targetFrameTime
+ */
+
+qreal QRhiWidget::resolutionScale() const
+{
+    Q_D(const QRhiWidget);
+    return d->resolutionScale;
+}
+
+void QRhiWidget::setResolutionScale(qreal scale)
+{
+    Q_D(QRhiWidget);
+    scale = qBound<qreal>(0.1, scale, 1.0);
+    if (qFuzzyCompare(d->resolutionScale, scale))
+        return;
+
+    const qreal oldScale = d->effectiveResolutionScale();
+    d->resolutionScale = scale;
+    d->resolution.setRange(qMin(d->minimumResolutionScale, scale), scale);
+    emit resolutionScaleChanged(scale);
+    d->updateResolution(oldScale);
+}
+
+/*!
+    \property QRhiWidget::targetFrameTime
+
+    The frame time, in milliseconds, the adaptive resolution aims for.
+
+    By default the value is 0, and the widget renders at resolutionScale. With
+    a positive value, the time each frame takes, including waiting for the GPU
+    to finish, is measured, and the resolution is adjusted between
+    minimumResolutionScale and resolutionScale so that the frames fit into the
+    target, with some headroom.
+
+    When the frames are over the target, the resolution is lowered right away,
+    to the scale expected to fit, as the cost of a frame is assumed to be
+    proportional to the number of pixels rendered. It is raised again only in
+    small steps, after a longer period of frames that are expected to stay
+    within the target at the higher resolution as well. The scale changes in
+    steps of 0.05. This keeps the resolution from oscillating and the texture
+    from being reallocated on every frame. Each change reallocates the texture
+    and calls initialize().
+
+    A typical value is somewhat below the refresh interval of the screen, for
+    example 12 for a 60 Hz screen, leaving time for the rest of the window.
+    Setting the value starts over at resolutionScale.
+
+    \sa effectiveResolutionScale, minimumResolutionScale
+ */
+
+qreal QRhiWidget::targetFrameTime() const
+{
+    Q_D(const QRhiWidget);
+    return d->targetFrameTime;
+}
+
+void QRhiWidget::setTargetFrameTime(qreal msec)
+{
+    Q_D(QRhiWidget);
+    msec = qMax<qreal>(0, msec);
+    if (qFuzzyCompare(d->targetFrameTime, msec))
+        return;
+
+    const qreal oldScale = d->effectiveResolutionScale();
+    d->targetFrameTime = msec;
+    d->resolution.setRange(qMin(d->minimumResolutionScale, d->resolutionScale), d->resolutionScale);
+    d->resolution.setTargetFrameTime(qint64(msec * 1000000.0));
+    emit targetFrameTimeChanged(msec);
+    d->updateResolution(oldScale);
+}
+
+/*!
+    \property QRhiWidget::minimumResolutionScale
+
+    The lowest scale the adaptive resolution goes down to. The default is 0.5.
+
+    \sa targetFrameTime
+ */
+
+qreal QRhiWidget::minimumResolutionScale() const
+{
+    Q_D(const QRhiWidget);
+    return d->minimumResolutionScale;
+}
+
+void QRhiWidget::setMinimumResolutionScale(qreal scale)
+{
+    Q_D(QRhiWidget);
+    scale = qBound<qreal>(0.1, scale, 1.0);
+    if (qFuzzyCompare(d->minimumResolutionScale, scale))
+        return;
+
+    const qreal oldScale = d->effectiveResolutionScale();
+    d->minimumResolutionScale = scale;
+    d->resolution.setRange(qMin(scale, d->resolutionScale), d->resolutionScale);
+    emit minimumResolutionScaleChanged(scale);
+    d->updateResolution(oldScale);
+}
+
+/*!
+    \property QRhiWidget::effectiveResolutionScale
+
+    The scale the widget currently renders at. This is resolutionScale, unless
+    a targetFrameTime is set, in which case it is the scale chosen by the
+    adaptive resolution.
+
+    effectiveResolutionScaleChanged() is emitted whenever the value changes.
+
+    \sa resolutionScale, targetFrameTime
+ */
+
+qreal QRhiWidget::effectiveResolutionScale() const
+{
+    Q_D(const QRhiWidget);
+    return d->effectiveResolutionScale();
+}
+
+/*!
+    \property QRhiWidget::sampleCount
+
+    The number of samples per pixel used for multisample antialiasing (MSAA).
+
+    By default the value is 1, meaning no multisampling. With a value larger
+    than 1, QRhiWidget creates and manages a multisample color buffer, a
+    matching depth-stencil buffer, and a render target that renders into them
+    and resolves into the texture at the end of each render pass. The
+    implementation of initialize() and render() should then use renderTarget()
+    instead of creating a render target for the texture on its own, and
+    create its graphics pipelines with the render target's
+    \l{QRhiRenderTarget::sampleCount()}{sample count} and render pass
+    descriptor.
+
+    When the requested sample count is not supported by the graphics API
+    implementation, the highest supported count below it is used instead.
+
+    Changing the value leads to initialize() being called before rendering the
+    next frame.
+
+    \sa autoRenderTarget, renderTarget(), msaaColorBuffer(), depthStencilBuffer()
+ */
+
+int QRhiWidget::sampleCount() const
+{
+    Q_D(const QRhiWidget);
+    return d->samples;
+}
+
+void QRhiWidget::setSampleCount(int samples)
+{
+    Q_D(QRhiWidget);
+    samples = qMax(1, samples);
+    if (d->samples != samples) {
+        d->samples = samples;
+        d->renderTargetDirty = true;
+        emit sampleCountChanged(samples);
+        update();
+    }
+}
+
+/*!
+    \property QRhiWidget::autoRenderTarget
+
+    Controls if the widget creates and manages a depth-stencil buffer and a
+    render target for its texture.
+
+    By default the value is false, and it is up to the implementation of
+    initialize() to create a render target for the texture, unless
+    multisampling is used. When set to true, the widget owns a depth-stencil
+    buffer, a QRhiTextureRenderTarget, and its render pass descriptor, which
+    are all accessible via renderTarget() and depthStencilBuffer() from the
+    first initialize() call on. This is always the case when sampleCount is
+    larger than 1.
+
+    The render pass descriptor is created once and survives resizes of the
+    widget, only the render target is rebuilt. Graphics pipelines created
+    with it therefore do not need to be recreated when the widget's size
+    changes. This does not apply to changing the sampleCount, which leads to
+    a new render pass descriptor.
+
+    Changing the value leads to initialize() being called before rendering the
+    next frame.
+
+    \sa renderTarget(), sampleCount
+ */
+
+bool QRhiWidget::isAutoRenderTargetEnabled() const
+{
+    Q_D(const QRhiWidget);
+    return d->autoRenderTarget;
+}
+
+void QRhiWidget::setAutoRenderTarget(bool enabled)
+{
+    Q_D(QRhiWidget);
+    if (d->autoRenderTarget != enabled) {
+        d->autoRenderTarget = enabled;
+        d->renderTargetDirty = true;
+        emit autoRenderTargetChanged(enabled);
+        update();
+    }
+}
+
+/*!
+    \return the render target managed by the widget, or null if there is
+    none.
+
+    When autoRenderTarget is enabled, or sampleCount is larger than 1, the
+    widget provides a render target, together with a depth-stencil buffer,
+    that renders into the texture passed to initialize(), resolving
+    multisample content when applicable. The object is valid from the
+    initialize() call on. Its render pass descriptor stays the same when the
+    widget is resized, but can change between invocations of initialize()
+    otherwise, such as when the QRhi or the sample count changes.
+
+    \sa autoRenderTarget, sampleCount
+ */
+QRhiRenderTarget *QRhiWidget::renderTarget() const
+{
+    Q_D(const QRhiWidget);
+    return d->renderTarget;
+}
+
+/*!
+    \return the multisample color buffer managed by the widget, or null if
+    there is none.
+
+    \note The buffer is shared with other QRhiWidget instances in the same
+    top-level window that use the same size, format, and sample count. Its
+    contents are therefore undefined at the start of each frame.
+
+    \sa renderTarget(), resourcePoolStatistics()
+ */
+QRhiRenderBuffer *QRhiWidget::msaaColorBuffer() const
+{
+    Q_D(const QRhiWidget);
+    return d->msaaColorBuffer;
+}
+
+/*!
+    \return the depth-stencil buffer managed by the widget, or null if there
+    is none.
+
+    \note The buffer is shared with other QRhiWidget instances in the same
+    top-level window that use the same size and sample count. Its contents are
+    therefore undefined at the start of each frame.
+
+    \sa renderTarget(), resourcePoolStatistics()
+ */
+QRhiRenderBuffer *QRhiWidget::depthStencilBuffer() const
+{
+    Q_D(const QRhiWidget);
+    return d->depthStencil;
+}
+
+/*!
+    \class QRhiWidget::ResourcePoolStatistics
+    \brief Describes the graphics resources managed on behalf of QRhiWidget instances.
+
+    \c textureCount and \c textureBytes describe the backing textures currently
+    used by widgets. \c freeTextureCount and \c freeTextureBytes describe
+    textures no longer used by any widget, that are kept around for reuse.
+    \c renderBufferCount and \c renderBufferBytes describe the depth-stencil
+    and multisample color buffers, while \c renderBufferReferenceCount is the
+    number of uses of them by widgets. \c sharedBytesSaved is the amount of
+    memory that would be needed in addition if the render buffers were not
+    shared.
+
+    Byte sizes are estimates based on the size and format of the resources, as
+    the actual memory usage depends on the graphics API and the driver.
+ */
+
+/*!
+    \return statistics about the resource pool this widget takes its graphics
+    resources from.
+
+    All QRhiWidget instances using the same QRhi, meaning all widgets in the
+    same top-level window, share a pool. Backing textures given back by
+    widgets, for example because a widget was destroyed, are kept in the pool
+    for a while and are then reused by widgets asking for a texture of the same
+    format and size. Depth-stencil and multisample color buffers are only
+    needed while a widget is rendering, and are shared between all widgets
+    that use the same size, format, and sample count.
+
+    Returns default-constructed statistics when the widget has not been
+    rendered yet.
+
+    \sa msaaColorBuffer(), depthStencilBuffer()
+ */
+QRhiWidget::ResourcePoolStatistics QRhiWidget::resourcePoolStatistics() const
+{
+    Q_D(const QRhiWidget);
+    d->waitForRenderThread();
+    if (!d->rhi)
+        return {};
+    QRhiWidgetResourcePool *pool = QRhiWidgetResourcePool::forRhi(d->rhi, false);
+    return pool ? pool->statistics() : ResourcePoolStatistics();
+}
+
+/*!
+    \return the current update behavior.
+
+    \sa setUpdateBehavior()
+ */
+QRhiWidget::UpdateBehavior QRhiWidget::updateBehavior() const
+{
+    Q_D(const QRhiWidget);
+    return d->updateBehavior;
+}
+
+/*!
+    Sets the update behavior of the widget to \a behavior.
+
+    With the default OnDemandUpdates the widget only renders a new frame when
+    an update() is requested. Animating content then typically involves
+    calling update() from render().
+
+    ContinuousUpdates renders a new frame at the refresh rate of the screen
+    the widget is on, while CappedUpdates renders at most as many frames per
+    second as set by setMaximumFrameRate(). Calling update() from render() is
+    then not necessary.
+
+    The updates for all non-on-demand QRhiWidgets within a top-level window
+    are driven by a single timer belonging to the window, so that they all get
+    rendered and composited in one go. Widgets that are hidden or are fully
+    obscured by other widgets are not rendered. When a frame budget is set for
+    the window via setFrameBudget(), widgets that would exceed the budget in a
+    given tick are deferred to the next one.
+
+    \sa frameRate(), setFrameBudget()
+ */
+void QRhiWidget::setUpdateBehavior(UpdateBehavior behavior)
+{
+    Q_D(QRhiWidget);
+    if (d->updateBehavior == behavior)
+        return;
+
+    d->updateBehavior = behavior;
+    d->updateScheduling();
+}
+
+/*!
+    \return the frame rate cap used with CappedUpdates.
+
+    \sa setMaximumFrameRate()
+ */
+qreal QRhiWidget::maximumFrameRate() const
+{
+    Q_D(const QRhiWidget);
+    return d->maximumFrameRate;
+}
+
+/*!
+    Sets the maximum number of frames per second rendered with CappedUpdates
+    to \a fps. The default is 60.
+
+    \sa setUpdateBehavior()
+ */
+void QRhiWidget::setMaximumFrameRate(qreal fps)
+{
+    Q_D(QRhiWidget);
+    if (qFuzzyCompare(d->maximumFrameRate, fps))
+        return;
+
+    d->maximumFrameRate = fps;
+    d->updateScheduling();
+}
+
+/*!
+    \property QRhiWidget::frameRate
+
+    The number of frames per second the widget has rendered, measured over
+    one second periods. The value is updated, and frameRateChanged() is
+    emitted, roughly once per second while the widget is rendering.
+ */
+
+qreal QRhiWidget::frameRate() const
+{
+    Q_D(const QRhiWidget);
+    return d->frameRate;
+}
+
+/*!
+    \property QRhiWidget::threadedRendering
+
+    Controls if initialize() and render() are called on a dedicated render
+    thread instead of the GUI thread.
+
+    By default the value is false. When enabled, the widget renders with a
+    QRhi of its own, created on the render thread, and the GUI thread does not
+    wait for the GPU to finish a frame: a paint event only starts a frame, and
+    the window composites the results once the frame is handed back. Updates
+    requested while a frame is being rendered are coalesced into one frame
+    started after it.
+
+    Before each frame, with the render thread idle, synchronize() is called on
+    the GUI thread. This is the only place where a subclass may access both
+    the state of its GUI thread and the data render() works with. render() and
+    initialize() must not touch anything else the GUI thread may change, and
+    must not call update() or other QWidget functions.
+
+    A subclass enabling threaded rendering must reimplement needsRender().
+    Handing a frame back to the window leads to a paint event, which only
+    renders a new frame when needsRender() returns true. With the default
+    implementation, which always returns true, the widget therefore renders
+    continuously. Updates requested by the application between two frames
+    are folded into these paint events, and so are also only rendered when
+    needsRender() reports a change.
+
+    With Metal, and with the Null backend, the render thread's QRhi is
+    created on the device and command queue of the window's QRhi, when the
+    widget is shown before its first frame. The window then composites the
+    texture the render thread rendered to, without copying it, and the GUI
+    thread never waits for the GPU.
+
+    Vulkan and Direct 3D 11 devices cannot be used from two threads this way.
+    There, and when the widget is moved to another window, the contents of
+    each frame are read back on the render thread and uploaded to a texture
+    belonging to the window's QRhi on the GUI thread. The GUI thread waits
+    for this upload, in every frame: it is a frame of its own on the window's
+    QRhi, ending with QRhi::endOffscreenFrame(). With a 3840x2160 RGBA8
+    texture that is about 33 MB read back and then uploaded again per frame,
+    which can cost more than rendering on the GUI thread would. With these
+    graphics APIs, threaded rendering is therefore best suited for content
+    that is expensive to render, but is not too large.
+
+    A subclass enabling threaded rendering must call stopRenderThread() at the
+    beginning of its destructor, and release its graphics resources in
+    releaseResources().
+
+    Threaded rendering is not supported with OpenGL, the window's context
+    cannot be shared with a render thread. In that case a warning is printed
+    when the widget renders for the first time, and the property reverts to
+    false, the widget then renders on the GUI thread. The value cannot be
+    changed once the widget has rendered a frame.
+
+    \sa synchronize(), needsRender(), releaseResources()
+ */
+
+bool QRhiWidget::isThreadedRenderingEnabled() const
+{
+    Q_D(const QRhiWidget);
+    return d->threaded;
+}
+
+void QRhiWidget::setThreadedRendering(bool enable)
+{
+    Q_D(QRhiWidget);
+    if (d->threaded == enable)
+        return;
+
+    if (d->t || d->renderThread) {
+        qWarning("QRhiWidget: Threaded rendering cannot be changed after the widget has rendered");
+        return;
+    }
+    d->threaded = enable;
+    emit threadedRenderingChanged(enable);
+}
+
+/*!
+    \return the view layout, or an empty list when the widget renders a
+    single view covering the whole texture.
+
+    \sa setViewLayout(), views()
+ */
+QList<QRectF> QRhiWidget::viewLayout() const
+{
+    Q_D(const QRhiWidget);
+    return d->viewLayout;
+}
+
+/*!
+    Splits the texture into views, for example to show the same scene from
+    several cameras. Each rectangle in \a layout is in normalized
+    coordinates, with (0, 0) at the top-left and (1, 1) at the bottom-right of
+    the texture. An empty list, the default, means a single view covering the
+    whole texture.
+
+    All views are rendered by a single render() call, in one render pass over
+    the same resources. render() is expected to iterate over views(), set the
+    viewport and, when the views overlap or the content is not clipped by the
+    viewport, the scissor rectangle for each, and draw the scene with the
+    camera for that view. Pipelines using the scissor need the
+    QRhiGraphicsPipeline::UsesScissor flag.
+
+    Compared to a separate QRhiWidget per view, there is one texture, one
+    render target, and one set of scene resources to keep updated, and with
+    the widget not being threaded, one frame on the GPU instead of one per
+    view.
+
+    Schedules an update. The next frame is rendered even if needsRender()
+    returns false.
+
+    \sa setViewGrid(), views()
+ */
+void QRhiWidget::setViewLayout(const QList<QRectF> &layout)
+{
+    Q_D(QRhiWidget);
+    if (d->viewLayout == layout)
+        return;
+    d->viewLayout = layout;
+    d->viewLayoutDirty = true;
+    update();
+}
+
+/*!
+    Sets a view layout of \a columns times \a rows views of equal size, in
+    rows from the top-left. A grid of a single view is the same as an empty
+    layout.
+
+    \sa setViewLayout()
+ */
+void QRhiWidget::setViewGrid(int columns, int rows)
+{
+    columns = qMax(1, columns);
+    rows = qMax(1, rows);
+    QList<QRectF> layout;
+    if (columns > 1 || rows > 1) {
+        layout.reserve(columns * rows);
+        for (int y = 0; y < rows; ++y) {
+            for (int x = 0; x < columns; ++x)
+                layout.append(QRectF(x / qreal(columns), y / qreal(rows), 1 / qreal(columns), 1 / qreal(rows)));
+        }
+    }
+    setViewLayout(layout);
+}
+
+/*!
+    \return the views to render in the current frame, with their rectangle
+    in pixels and the matching viewport and scissor rectangle. There is
+    always at least one view, unless all rectangles of the layout are empty
+    in pixels.
+
+    The list is only valid in initialize() and render(), and stays the same
+    from one frame to the next as long as the layout and the size of the
+    texture do not change. With threaded rendering it is the layout that was
+    set when the frame started.
+
+    \sa setViewLayout()
+ */
+const QList<QRhiWidget::View> &QRhiWidget::views() const
+{
+    Q_D(const QRhiWidget);
+    return d->settings.views;
+}
+
+/*!
+    Waits for the frame being rendered on the render thread, if any, then
+    calls releaseResources() on the render thread and destroys the render
+    thread together with its QRhi.
+
+    A subclass enabling threadedRendering must call this function at the
+    beginning of its destructor, as the render thread may otherwise be in the
+    middle of calling render() while the subclass is being destroyed. Does
+    nothing when there is no render thread.
+
+    \sa releaseResources()
+ */
+void QRhiWidget::stopRenderThread()
+{
+    Q_D(QRhiWidget);
+    if (!d->renderThread)
+        return;
+    // the window lets go of a texture imported from the render thread first
+    d->releaseCompositeTexture();
+    d->renderThread.reset();
+    d->textureShareRhi = nullptr;
+    d->threadedFramePending = false;
+}
+
+/*!
+    \property QRhiWidget::frameStatisticsEnabled
+
+    Controls if the widget collects timing statistics about its frames.
+
+    By default the value is false, and nothing is measured. When enabled,
+    frameStatistics is updated, and frameStatisticsChanged() emitted, once per
+    second while the widget renders frames.
+
+    Enabling the statistics again discards the samples collected previously.
+
+    \sa frameStatistics
+ */
+
+bool QRhiWidget::isFrameStatisticsEnabled() const
+{
+    Q_D(const QRhiWidget);
+    return d->stats.enabled;
+}
+
+void QRhiWidget::setFrameStatisticsEnabled(bool enabled)
+{
+    Q_D(QRhiWidget);
+    if (d->stats.enabled == enabled)
+        return;
+
+    {
+        QMutexLocker lock(&d->stats.mutex);
+        d->stats.enabled = enabled;
+        if (enabled) {
+            d->stats.initializeTime.clear();
+            d->stats.renderTime.clear();
+            d->stats.endFrameWaitTime.clear();
+            d->stats.current = {};
+        }
+    }
+    emit frameStatisticsEnabledChanged(enabled);
+}
+
+/*!
+    \class QRhiWidget::TimingStatistics
+    \brief Minimum, average, and 99th percentile of a duration, in milliseconds.
+
+    The values are calculated from the most recent 256 samples. \c sampleCount
+    is the number of samples the values are based on, and is 0 when nothing
+    was measured.
+ */
+
+/*!
+    \class QRhiWidget::FrameStatistics
+    \brief Describes where the time of a QRhiWidget's frames is spent.
+
+    \c initializeTime is the CPU time spent in initialize(), while
+    \c renderTime is the CPU time spent in render(). \c endFrameWaitTime is
+    the time spent waiting for QRhi::endOffscreenFrame(), which includes
+    submitting the commands and waiting for the GPU to finish them.
+
+    There is no separate GPU time. It would need a QRhi created with
+    QRhi::EnableTimestamps, but the widget renders with the QRhi of its
+    window, which the backing store creates, and with QRhis created the same
+    way for grabs, threaded rendering, and QRhiWidgetOffscreenRenderer, none
+    of which enable timestamps. As QRhi::endOffscreenFrame() waits for the
+    GPU, \c endFrameWaitTime is the closest measure of the GPU's share.
+
+    \c textureReallocationCount is the number of times the backing texture was
+    created or resized, and \c grabCount is the number of texture readbacks
+    made for grabTexture(), grabTextureData(), and grabTextureAsync().
+    \c renderedFrameCount is the number of frames rendered for paint events,
+    while \c skippedFrameCount is the number of paint events that did not
+    render because needsRender() returned false. These counters are counted
+    regardless of frameStatisticsEnabled, from the creation of the widget.
+
+    Frames rendered for synchronous grabs are included in the timings.
+ */
+
+/*!
+    \property QRhiWidget::frameStatistics
+
+    Rolling statistics about the widget's recent frames.
+
+    Only collected when frameStatisticsEnabled is true. The value is updated,
+    and frameStatisticsChanged() is emitted, once per second while the widget
+    renders frames.
+
+    \sa frameStatisticsEnabled, frameRate()
+ */
+
+QRhiWidget::FrameStatistics QRhiWidget::frameStatistics() const
+{
+    Q_D(const QRhiWidget);
+    QMutexLocker lock(&d->stats.mutex);
+    return d->stats.current;
+}
+
+/*!
+    \return the number of paint events that did not render a frame, because
+    needsRender() returned false, since the widget was created.
+
+    Unlike FrameStatistics::skippedFrameCount, the value is always up to date.
+
+    \sa needsRender()
+ */
+qint64 QRhiWidget::skippedFrameCount() const
+{
+    Q_D(const QRhiWidget);
+    return d->stats.skippedFrameCount.loadRelaxed();
+}
+
+/*!
+    \return the number of times the backing texture was created or resized
+    since the widget was created.
+
+    Unlike FrameStatistics::textureReallocationCount, the value is always up
+    to date.
+
+    \sa textureResizeDelay
+ */
+qint64 QRhiWidget::textureReallocationCount() const
+{
+    Q_D(const QRhiWidget);
+    return d->stats.textureReallocationCount.loadRelaxed();
+}
+
+/*!
+    \return the frame budget in milliseconds for the QRhiWidgets in the
+    top-level \a window, or 0 if there is none.
+
+    \sa setFrameBudget()
+ */
+int QRhiWidget::frameBudget(QWidget *window)
+{
+    QRhiWidgetScheduler *scheduler = QRhiWidgetScheduler::forWindow(window->window(), false);
+    return scheduler ? int(scheduler->frameBudget() / 1000000) : 0;
+}
+
+/*!
+    Sets the frame budget for the QRhiWidgets in the top-level \a window to
+    \a msec milliseconds.
+
+    The budget is the time to spend at most with rendering the QRhiWidgets
+    with non-on-demand updates in one tick of the window. When exceeded,
+    widgets are rendered in a round-robin manner in subsequent ticks instead,
+    which effectively lowers their frame rate. The cost of each widget is the
+    time its last frame took. The default value 0 means no budget.
+
+    \sa setUpdateBehavior()
+ */
+void QRhiWidget::setFrameBudget(QWidget *window, int msec)
+{
+    QRhiWidgetScheduler::forWindow(window->window())->setFrameBudget(qint64(qMax(0, msec)) * 1000000);
+}
+
+/*!
+    \return true if the QRhiWidgets in the top-level \a window are rendered
+    in batches.
+
+    \sa setBatchedRendering()
+ */
+bool QRhiWidget::isBatchedRenderingEnabled(QWidget *window)
+{
+    QRhiWidgetScheduler *scheduler = QRhiWidgetScheduler::forWindow(window->window(), false);
+    return scheduler && scheduler->isBatchedRenderingEnabled();
+}
+
+/*!
+    Enables or disables batched rendering for the QRhiWidgets in the top-level
+    \a window, depending on \a enable. It is disabled by default.
+
+    By default each QRhiWidget renders in its own paint event, in an offscreen
+    frame of its own, and waits for the GPU to finish that frame. With many
+    widgets in a window, the window pays for as many submissions and waits
+    on every repaint.
+
+    With batched rendering, right before the window repaints, every visible
+    QRhiWidget of the window that was updated, with QWidget::update(),
+    QWidget::repaint(), or by Qt itself, and needs a new frame, as reported
+    by needsRender() or because of a texture, render target, or view layout
+    change, or a pending asynchronous grab, is rendered. The rendering is
+    recorded into a single command buffer, submitted once, and waited for
+    once. The widgets then skip rendering when they get painted.
+    synchronize() and render() are called as usual, just not from the
+    widget's own paint event. A widget painted without having been updated
+    itself, for example because it was exposed or overlaps another widget
+    being repainted, renders on its own as it would without batching.
+
+    Widgets with threadedRendering enabled are not part of the batch. Neither
+    are widgets using another QRhi than the window.
+
+    The batch is recorded before the window composites, not within the
+    composition frame of the backing store, as that is not accessible to
+    QRhiWidget.
+
+    \sa needsRender()
+ */
+void QRhiWidget::setBatchedRendering(QWidget *window, bool enable)
+{
+    QRhiWidgetScheduler::forWindow(window->window())->setBatchedRendering(enable);
+}
+
+static bool isGrabSupported(QRhiTexture::Format format)
+{
+    if (QRhiWidgetFormats::imageFormat(format) == QImage::Format_Invalid) {
+        qWarning("QRhiWidget::grabTexture() does not support texture format %d", int(format));
+        return false;
+    }
+    return true;
+}
+
+/*!
+    Renders a new frame, reads the contents of the texture back, and returns it
+    as a QImage.
+
+    When an error occurs, a null QImage is returned.
+
+    All color formats that can be set via setTextureFormat() are supported.
+    The returned QImage will have the closest matching format: for example,
+    QImage::Format_RGBA8888 for QRhiTexture::RGBA8, QImage::Format_Grayscale8
+    for QRhiTexture::R8, QImage::Format_RGBX64 for QRhiTexture::RG16, or
+    QImage::Format_RGBA16FPx4 for QRhiTexture::RGBA16F. Formats without a
+    direct equivalent are expanded with zeroes for the missing color
+    components and an opaque alpha.
+
+    QRhiWidget does not know the renderer's approach to blending and
+    composition, and therefore cannot know if the output has alpha
+    premultiplied. By default, with \a alphaMode set to GrabAlphaAsIs, the
+    data is returned unmodified in a non-premultiplied QImage format.
+    GrabPremultiplyAlpha premultiplies the data and returns it in a
+    premultiplied format, while GrabUnpremultiplyAlpha treats the data as
+    premultiplied and converts it to a non-premultiplied one. For
+    QRhiTexture::RGB10A2 the data is always treated as premultiplied.
+
+    Where no conversion is needed, the returned QImage takes over the data
+    read back from the texture, no additional copy is made. To avoid
+    allocating a new image on every call, use the overload taking an existing
+    QImage, or grabTextureData() when the raw data is sufficient.
+
+    This function can also be called when the QRhiWidget is not added to a
+    widget hierarchy belonging to an on-screen top-level window. This allows
     generating an image from a 3D rendering off-screen.
 
     \sa setTextureFormat()
  */
-QImage QRhiWidget::grabTexture()
+QImage QRhiWidget::grabTexture(GrabAlphaMode alphaMode)
 {
     Q_D(QRhiWidget);
-    if (d->noSize)
+    if (!isGrabSupported(d->format))
         return QImage();
 
-    if (d->format != QRhiTexture::RGBA8) {
-        qWarning("QRhiWidget::grabTexture() only supports RGBA8 textures");
+    QRhiReadbackResult readResult;
+    if (!d->renderAndReadBack(&readResult))
         return QImage();
+
+    // the image takes over the readback data, no copy is made
+    return d->imageFromReadback(std::move(readResult), alphaMode);
+}
+
+/*!
+    \overload
+
+    Renders a new frame and reads the contents of the texture back into the
+    existing \a image.
+
+    When \a image already has the size and format grabTexture() would return,
+    the data is written into its existing storage, so repeated grabs perform
+    no allocations apart from those done by the graphics API. Otherwise
+    \a image is reallocated. Keep no other copies of \a image around, as
+    writing into a shared image makes it detach.
+
+    Returns false when an error occurs.
+ */
+bool QRhiWidget::grabTexture(QImage *image, GrabAlphaMode alphaMode)
+{
+    Q_D(QRhiWidget);
+    if (!image || !isGrabSupported(d->format))
+        return false;
+
+    // reuse the same readback buffer on every call, it is never shared
+    // with the outside world so the backend can write into it as-is
+    if (!d->renderAndReadBack(&d->grabReadback))
+        return false;
+
+    const QRhiReadbackResult &result(d->grabReadback);
+    if (result.data.isEmpty() || result.pixelSize.isEmpty())
+        return false;
+
+    const qsizetype bytesPerLine = result.data.size() / result.pixelSize.height();
+    if (!QRhiWidgetFormats::convertTextureData(image, reinterpret_cast<const uchar *>(result.data.constData()),
+                                               result.pixelSize, bytesPerLine, result.format,
+                                               toAlphaConversion(alphaMode)))
+    {
+        return false;
     }
+    image->setDevicePixelRatio(devicePixelRatio());
+    return true;
+}
 
-    d->ensureRhi();
-    if (!d->rhi) {
+/*!
+    Renders a new frame, reads the contents of the texture back, and returns
+    the raw data without any conversion.
+
+    This is the cheapest way of grabbing when the data is consumed as-is, for
+    example when it is written to a file or uploaded somewhere else. The data
+    is in the texture's format, and each row of the image starts at
+    RawTextureData::bytesPerLine bytes after the previous one. Any texture
+    format is supported.
+
+    When an error occurs, the returned RawTextureData has empty data.
+
+    \sa grabTexture()
+ */
+QRhiWidget::RawTextureData QRhiWidget::grabTextureData()
+{
+    Q_D(QRhiWidget);
+    QRhiReadbackResult readResult;
+    if (!d->renderAndReadBack(&readResult) || readResult.pixelSize.isEmpty())
+        return {};
+
+    RawTextureData result;
+    result.pixelSize = readResult.pixelSize;
+    result.bytesPerLine = readResult.data.size() / readResult.pixelSize.height();
+    result.format = readResult.format;
+    result.data = std::move(readResult.data);
+    return result;
+}
+
+// Everything before render() in a paint event. Returns false when there is
+// no texture to render into, otherwise needed tells if the contents may have
+// changed since the last frame.
+bool QRhiWidgetPrivate::preparePaintFrame(bool *needed)
+{
+    Q_Q(QRhiWidget);
+    q->synchronize();
+    syncSettings();
+    bool changed = false;
+    ensureTexture(&changed);
+    if (!t)
+        return false;
+    textureInvalid = false;
+    if (changed)
+        invokeInitialize();
+
+    *needed = changed || !pendingGrabs.empty() || settings.viewsChanged || q->needsRender();
+    return true;
+}
+
+// With batched rendering, a widget rendered by the batch of its window is
+// only composited by its paint event. Returns false when the widget is to be
+// painted as usual.
+bool QRhiWidgetPrivate::paintBatched()
+{
+    Q_Q(QRhiWidget);
+    QRhiWidgetScheduler *batchScheduler = QRhiWidgetScheduler::forWindow(q->window(), false);
+    return batchScheduler && batchScheduler->takeFromRenderedBatch(q);
+}
+
+// Called by the scheduler when the window is about to repaint. Renders all of
+// the window's widgets that were marked dirty and need a new frame, in one
+// offscreen frame, instead of each of them waiting for the GPU in a frame of
+// its own in its paint event. Being marked dirty is what the repaint manager
+// itself goes by, so this covers update() and repaint() through any pointer,
+// as well as the updates Qt makes internally. Widgets only painted because
+// they are exposed, or are in the area of another widget being repainted,
+// render on their own in their paint events.
+void QRhiWidgetPrivate::renderBatch(QWidget *window, QRhiWidgetScheduler *scheduler)
+{
+    QWidgetRepaintManager *repaintManager = QWidgetPrivate::get(window)->maybeRepaintManager();
+    QRhi *rhi = repaintManager ? repaintManager->rhi() : nullptr;
+    if (!rhi)
+        return;
+
+    QList<QRhiWidget *> candidates = window->findChildren<QRhiWidget *>();
+    if (QRhiWidget *rhiWindow = qobject_cast<QRhiWidget *>(window))
+        candidates.prepend(rhiWindow);
+
+    // the widgets that need no new frame are handled as well, so that their
+    // paint events do not synchronize a second time
+    QList<QRhiWidget *> handled;
+    QList<QRhiWidget *> batch;
+    for (QRhiWidget *widget : std::as_const(candidates)) {
+        QRhiWidgetPrivate *wd = get(widget);
+        if (!wd->inDirtyList)
+            continue;
+        if (!widget->isVisible() || !widget->updatesEnabled() || wd->noSize || wd->threaded)
+            continue;
+        wd->ensureRhi();
+        if (wd->rhi != rhi)
+            continue;
+        bool needed = false;
+        if (!wd->preparePaintFrame(&needed))
+            continue; // fails again in the paint event, which fails the grabs
+        handled.append(widget);
+        if (needed)
+            batch.append(widget);
+        else
+            ++wd->stats.skippedFrameCount;
+    }
+
+    struct Timings {
+        qint64 renderTime;
+        qint64 droppedCaptureFrame;
+    };
+    std::vector<Timings> timings(batch.size());
+    QElapsedTimer frameTimer;
+    frameTimer.start();
+
+    if (!batch.isEmpty()) {
+        QRhiCommandBuffer *cb = nullptr;
+        rhi->beginOffscreenFrame(&cb);
+        for (qsizetype i = 0; i < batch.size(); ++i) {
+            QRhiWidgetPrivate *wd = get(batch[i]);
+            const qint64 renderStart = frameTimer.nsecsElapsed();
+            batch[i]->render(cb);
+            timings[i].renderTime = frameTimer.nsecsElapsed() - renderStart;
+            if (!wd->pendingGrabs.empty())
+                wd->enqueueAsyncGrab(cb);
+            timings[i].droppedCaptureFrame = wd->capture && wd->capture->isFrameDue()
+                    ? wd->enqueueCaptureReadback(cb) : -1;
+        }
+        const qint64 endFrameStart = frameTimer.nsecsElapsed();
+        rhi->endOffscreenFrame();
+        const qint64 endFrameTime = frameTimer.nsecsElapsed() - endFrameStart;
+
+        // each widget's share of the frame is what it recorded, plus an equal
+        // part of the wait for the GPU
+        for (qsizetype i = 0; i < batch.size(); ++i) {
+            QRhiWidgetPrivate *wd = get(batch[i]);
+            wd->recordFrameTimings(timings[i].renderTime, endFrameTime);
+            wd->frameRendered(timings[i].renderTime + endFrameTime / batch.size());
+        }
+    }
+
+    for (qsizetype i = 0; i < batch.size(); ++i) {
+        if (timings[i].droppedCaptureFrame >= 0)
+            emit batch[i]->captureFrameDropped(timings[i].droppedCaptureFrame);
+    }
+
+    scheduler->markBatchRendered(handled);
+}
+
+// Everything before render() for a frame that is not triggered by a paint
+// event, shared by grabs and QRhiWidgetOffscreenRenderer. rhi must be valid.
+bool QRhiWidgetPrivate::prepareOffscreenFrame()
+{
+    Q_Q(QRhiWidget);
+    // always reflects the current size, even in the middle of a resize
+    resizeTimer.stop();
+
+    q->synchronize();
+    syncSettings();
+    bool changed = false;
+    ensureTexture(&changed);
+    if (!t)
+        return false;
+    textureInvalid = false;
+    if (changed)
+        invokeInitialize();
+    return true;
+}
+
+bool QRhiWidgetPrivate::renderAndReadBack(QRhiReadbackResult *result)
+{
+    Q_Q(QRhiWidget);
+    if (noSize)
+        return false;
+
+    if (threaded && ensureRenderThread()) {
+        // a grab always reflects the current size, even in the middle of a resize
+        resizeTimer.stop();
+        // hand back the frames in flight first, so that frames stay in order
+        renderThread->waitForIdle();
+        std::vector<QRhiWidgetThreadedFrame> frames;
+        if (renderThread->takeFrames(&frames))
+            presentThreadedFrames(&frames);
+        startThreadedFrame(true);
+        renderThread->waitForIdle();
+        if (!renderThread->takeFrames(&frames))
+            return false;
+        const QRhiWidgetThreadedFrame &frame(frames.back());
+        const bool rendered = frame.rendered;
+        if (rendered) {
+            // the data is shared, not copied
+            result->data = frame.readback.data;
+            result->pixelSize = frame.readback.pixelSize;
+            result->format = frame.readback.format;
+            ++stats.grabCount;
+        }
+        presentThreadedFrames(&frames);
+        return rendered;
+    }
+
+    ensureRhi();
+    if (!rhi) {
         // The widget (and its parent chain, if any) may not be shown at
         // all, yet one may still want to use it for grabs. This is
         // ridiculous of course because the rendering infrastructure is
         // tied to the top-level widget that initializes upon expose, but
         // it has to be supported.
         QBackingStoreRhiSupport rhiSupport;
-        rhiSupport.setConfig(d->config);
+        rhiSupport.setConfig(config);
         // no window passed in, so no swapchain, but we get a functional QRhi which we own
-        d->offscreenRhiResources = rhiSupport.create();
-        d->rhi = d->offscreenRhiResources.rhi;
-        if (!d->rhi) {
+        offscreenRhiResources = rhiSupport.create();
+        rhi = offscreenRhiResources.rhi;
+        if (!rhi) {
             qWarning("QRhiWidget: Failed to create dedicated QRhi for grabbing");
-            return QImage();
+            return false;
         }
     }
 
-    const QSize prevSize = d->t ? d->t->pixelSize() : QSize();
-    d->ensureTexture();
-    if (!d->t)
-        return QImage();
-    if (d->t->pixelSize() != prevSize)
-        initialize(d->rhi, d->t);
+    if (!prepareOffscreenFrame())
+        return false;
 
-    QRhiReadbackResult readResult;
     bool readCompleted = false;
-    readResult.completed = [&readCompleted] { readCompleted = true; };
+    result->completed = [&readCompleted] { readCompleted = true; };
+
+    QElapsedTimer frameTimer;
+    frameTimer.start();
 
     QRhiCommandBuffer *cb = nullptr;
-    d->rhi->beginOffscreenFrame(&cb);
-    render(cb);
-    QRhiResourceUpdateBatch *readbackBatch = d->rhi->nextResourceUpdateBatch();
-    readbackBatch->readBackTexture(d->t, &readResult);
+    rhi->beginOffscreenFrame(&cb);
+    q->render(cb);
+    const qint64 renderTime = frameTimer.nsecsElapsed();
+    QRhiResourceUpdateBatch *readbackBatch = rhi->nextResourceUpdateBatch();
+    readbackBatch->readBackTexture(t, result);
     cb->resourceUpdate(readbackBatch);
-    d->rhi->endOffscreenFrame();
+    const qint64 endFrameStart = frameTimer.nsecsElapsed();
+    rhi->endOffscreenFrame();
 
-    if (readCompleted) {
-        QImage wrapperImage(reinterpret_cast<const uchar *>(readResult.data.constData()),
-                            readResult.pixelSize.width(), readResult.pixelSize.height(),
-                            QImage::Format_RGBA8888);
-        QImage result = wrapperImage.copy();
-        result.setDevicePixelRatio(devicePixelRatio());
-        return result;
-    } else {
+    ++stats.grabCount;
+    recordFrameTimings(renderTime, frameTimer.nsecsElapsed() - endFrameStart);
+
+    result->completed = nullptr;
+    if (!readCompleted)
         Q_UNREACHABLE();
+
+    return true;
+}
+
+/*!
+    Requests the contents of the texture to be read back with the next regular
+    frame of the widget, and returns a QFuture that becomes ready with the
+    resulting QImage once the readback has completed.
+
+    Unlike grabTexture(), this function does not render a frame of its own. It
+    merely schedules an update() and records the readback as part of the frame
+    the next paintEvent() renders anyway. Multiple requests made before that
+    frame is rendered are served by a single readback. That frame still waits
+    for the GPU in QRhi::endOffscreenFrame(), which is also where the readback
+    completes, so what is saved is the cost of an extra frame, not the wait.
+    With threadedRendering, the frame and the readback complete on the render
+    thread, and the GUI thread does not wait for either.
+
+    When an error occurs, the future will have a null QImage as its result.
+    This is also the case when the next paint event cannot render a frame,
+    for example because the widget has no size or there is no QRhi. If the
+    widget is destroyed before the next frame, the future is canceled.
+    \a alphaMode is handled as in grabTexture().
+
+    \note When the widget is not visible or its updates are disabled, there
+    are no regular frames to piggyback on, and the function falls back to
+    calling grabTexture(), which renders a frame and waits for it before
+    returning.
+
+    The same texture formats are supported as by grabTexture().
+
+    \sa grabTexture()
+ */
+QFuture<QImage> QRhiWidget::grabTextureAsync(GrabAlphaMode alphaMode)
+{
+    Q_D(QRhiWidget);
+    QPromise<QImage> promise;
+    QFuture<QImage> future = promise.future();
+    promise.start();
+
+    if (!isVisible() || !updatesEnabled() || d->noSize || QRhiWidgetFormats::imageFormat(d->format) == QImage::Format_Invalid) {
+        promise.addResult(grabTexture(alphaMode));
+        promise.finish();
+        return future;
     }
 
-    return QImage();
+    d->pendingGrabs.push_back({ std::move(promise), alphaMode });
+    update();
+    return future;
+}
+
+/*!
+    Starts capturing the contents of every \a frameInterval th frame rendered
+    by the widget and streaming them to \a sink.
+
+    The texture is read back as part of the widget's regular frames into a
+    ring of \a bufferCount reusable buffers. The completed buffers are handed
+    to \a sink on a worker thread, the GUI thread never waits for the sink.
+    When the sink falls behind and all buffers are still in use, the frame is
+    dropped and captureFrameDropped() is emitted, rendering is not stalled.
+
+    Capturing only happens when the widget renders a frame, so with the
+    default on-demand updates only changes are recorded. Call update() from
+    render() to capture continuously.
+
+    \a sink is not owned by the widget and must stay valid until stopCapture()
+    returns. Any capture in progress is stopped first.
+
+    \note The sink cannot change size on the fly. Frames with a size different
+    from the first captured frame are dropped. Set an explicit size to keep the
+    output size fixed regardless of the widget's size.
+
+    Returns false if \a sink is null.
+
+    \sa stopCapture(), droppedCaptureFrameCount(), QRhiWidgetY4MCaptureSink
+ */
+bool QRhiWidget::startCapture(QRhiWidgetCaptureSink *sink, int frameInterval, int bufferCount)
+{
+    Q_D(QRhiWidget);
+    stopCapture();
+    if (!sink)
+        return false;
+
+    d->capture.reset(new QRhiWidgetCapture(sink, frameInterval, bufferCount));
+    update();
+    return true;
+}
+
+/*!
+    Stops capturing. Frames already read back are still delivered to the sink,
+    and the sink is closed, before this function returns.
+
+    \sa startCapture()
+ */
+void QRhiWidget::stopCapture()
+{
+    Q_D(QRhiWidget);
+    // with threaded rendering the capture is fed from the render thread
+    d->waitForRenderThread();
+    d->capture.reset();
+}
+
+/*!
+    \return true if a capture started with startCapture() is in progress.
+ */
+bool QRhiWidget::isCapturing() const
+{
+    Q_D(const QRhiWidget);
+    return !d->capture.isNull();
+}
+
+/*!
+    \return the number of frames dropped by the current capture, either
+    because the sink was not able to keep up, or because it reported an error.
+
+    \sa captureFrameDropped()
+ */
+qint64 QRhiWidget::droppedCaptureFrameCount() const
+{
+    Q_D(const QRhiWidget);
+    return d->capture ? d->capture->droppedFrameCount() : 0;
+}
+
+/*!
+    Called on the GUI thread before a frame is rendered, in order to copy the
+    state of the GUI thread over to what initialize() and render() work with.
+
+    With threadedRendering the render thread is guaranteed to be idle while
+    this function runs, and this is the only time data shared between the two
+    threads may be accessed without further synchronization. Without threaded
+    rendering the function is called right before initialize() and render(),
+    on the same thread, and there is no need to reimplement it.
+
+    The default implementation does nothing.
+
+    \sa render(), threadedRendering
+ */
+void QRhiWidget::synchronize()
+{
+}
+
+/*!
+    Called on the GUI thread after synchronize(), to find out if a paint event
+    needs to render a new frame.
+
+    A QRhiWidget gets paint events for reasons unrelated to its contents, such
+    as expose events, being shown, or repaints of overlapping sibling widgets.
+    Reimplement this function and return false when the contents of the
+    texture would be the same as what the previous frame rendered. The frame
+    is then skipped entirely, render() is not called, and the window
+    composites the existing texture. Skipped frames are counted in
+    skippedFrameCount().
+
+    The widget renders regardless of the return value when the texture or the
+    render target was (re)created, meaning initialize() was called, when the
+    view layout changed, and when an asynchronous grab is pending. Synchronous grabs always render.
+
+    The default implementation returns true, rendering on every paint event.
+    Subclasses enabling threadedRendering must reimplement it, as every frame
+    handed back by the render thread leads to a paint event.
+
+    \sa synchronize(), skippedFrameCount()
+ */
+bool QRhiWidget::needsRender() const
+{
+    return true;
+}
+
+/*!
+    Called when the graphics resources created with the QRhi passed to
+    initialize() must be released, because the QRhi is about to be destroyed.
+
+    This happens when the render thread of a widget with threadedRendering
+    goes away, and the function is then called on the render thread. It is
+    also called when a QRhiWidgetOffscreenRenderer that rendered the widget is
+    destroyed or releases the widget. Otherwise the QRhi belongs to the
+    top-level window, and the resources are released in the subclass'
+    destructor as usual.
+
+    The default implementation does nothing.
+
+    \sa stopRenderThread()
+ */
+void QRhiWidget::releaseResources()
+{
 }
 
 /*!
@@ -507,9 +2632,28 @@ QImage QRhiWidget::grabTexture()
     The above snippet is also prepared for \a rhi and \a outputTexture changing
     between invocations, via the checks at the beginning of the function.
 
+    When autoRenderTarget is enabled, or multisampling is used via
+    setSampleCount(), none of this is necessary: the widget manages the
+    depth-stencil buffer and the render target rendering (or resolving) into
+    \a outputTexture, and they are all ready by the time this function is
+    called. Use renderTarget() to access the render target. As its render
+    pass descriptor survives resizes, an implementation then only needs to
+    recreate its graphics pipelines when the render pass descriptor is
+    different from the one the pipelines were created with:
+
+    \code
+    if (!m_pipeline || m_pipeline->renderPassDescriptor() != renderTarget()->renderPassDescriptor()) {
+        // (re)create the pipeline with renderTarget()->renderPassDescriptor()
+        // and renderTarget()->sampleCount()
+    }
+    \endcode
+
     The created resources are expected to be released in the destructor
-    implementation of the subclass. \a rhi and \a outputTexture are not owned
-    by, and are guaranteed to outlive the QRhiWidget.
+    implementation of the subclass, or in releaseResources() with
+    threadedRendering. \a rhi and \a outputTexture are not owned by, and are
+    guaranteed to outlive the QRhiWidget.
+
+    With threadedRendering this function is called on the render thread.
 
     \sa render()
  */
@@ -533,7 +2677,12 @@ void QRhiWidget::initialize(QRhi *rhi, QRhiTexture *outputTexture)
     scenegraph. The function is called with a frame being recorded, but without
     an active render pass.
 
-    \sa initialize()
+    With threadedRendering this function is called on the render thread, and
+    the data it needs must be copied over from the GUI thread in
+    synchronize(). Request updates from synchronize() then, instead of calling
+    update() here.
+
+    \sa initialize(), synchronize()
  */
 void QRhiWidget::render(QRhiCommandBuffer *cb)
 {
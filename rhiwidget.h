@@ -2,15 +2,28 @@
 #define RHIWIDGET_H
 
 #include <QWidget>
+#include <QFuture>
 #include <QtGui/private/qrhi_p.h>
 
 class QRhiWidgetPrivate;
+class QRhiWidgetCaptureSink;
 
 class QRhiWidget : public QWidget
 {
     Q_OBJECT
     Q_DECLARE_PRIVATE(QRhiWidget)
     Q_PROPERTY(QSize explicitSize READ explicitSize WRITE setExplicitSize NOTIFY explicitSizeChanged)
+    Q_PROPERTY(int textureResizeDelay READ textureResizeDelay WRITE setTextureResizeDelay NOTIFY textureResizeDelayChanged)
+    Q_PROPERTY(qreal resolutionScale READ resolutionScale WRITE setResolutionScale NOTIFY resolutionScaleChanged)
+    Q_PROPERTY(qreal targetFrameTime READ targetFrameTime WRITE setTargetFrameTime NOTIFY targetFrameTimeChanged)
+    Q_PROPERTY(qreal minimumResolutionScale READ minimumResolutionScale WRITE setMinimumResolutionScale NOTIFY minimumResolutionScaleChanged)
+    Q_PROPERTY(qreal effectiveResolutionScale READ effectiveResolutionScale NOTIFY effectiveResolutionScaleChanged)
+    Q_PROPERTY(qreal frameRate READ frameRate NOTIFY frameRateChanged)
+    Q_PROPERTY(int sampleCount READ sampleCount WRITE setSampleCount NOTIFY sampleCountChanged)
+    Q_PROPERTY(bool autoRenderTarget READ isAutoRenderTargetEnabled WRITE setAutoRenderTarget NOTIFY autoRenderTargetChanged)
+    Q_PROPERTY(bool frameStatisticsEnabled READ isFrameStatisticsEnabled WRITE setFrameStatisticsEnabled NOTIFY frameStatisticsEnabledChanged)
+    Q_PROPERTY(FrameStatistics frameStatistics READ frameStatistics NOTIFY frameStatisticsChanged)
+    Q_PROPERTY(bool threadedRendering READ isThreadedRenderingEnabled WRITE setThreadedRendering NOTIFY threadedRenderingChanged)
 
 public:
     QRhiWidget(QWidget *parent = nullptr, Qt::WindowFlags f = {});
@@ -24,6 +37,18 @@ public:
         Null
     };
 
+    enum UpdateBehavior {
+        OnDemandUpdates,
+        ContinuousUpdates,
+        CappedUpdates
+    };
+
+    enum GrabAlphaMode {
+        GrabAlphaAsIs,
+        GrabPremultiplyAlpha,
+        GrabUnpremultiplyAlpha
+    };
+
     Api api() const;
     void setApi(Api api);
 
@@ -33,18 +58,148 @@ public:
     QRhiTexture::Format textureFormat() const;
     void setTextureFormat(QRhiTexture::Format format);
 
+    QString pipelineCacheFile() const;
+    void setPipelineCacheFile(const QString &fileName);
+
     QSize explicitSize() const;
     void setExplicitSize(const QSize &pixelSize);
 
+    int sampleCount() const;
+    void setSampleCount(int samples);
+
+    bool isAutoRenderTargetEnabled() const;
+    void setAutoRenderTarget(bool enabled);
+
+    int textureResizeDelay() const;
+    void setTextureResizeDelay(int msec);
+
+    qreal resolutionScale() const;
+    void setResolutionScale(qreal scale);
+
+    qreal targetFrameTime() const;
+    void setTargetFrameTime(qreal msec);
+
+    qreal minimumResolutionScale() const;
+    void setMinimumResolutionScale(qreal scale);
+
+    qreal effectiveResolutionScale() const;
+
+    UpdateBehavior updateBehavior() const;
+    void setUpdateBehavior(UpdateBehavior behavior);
+
+    qreal maximumFrameRate() const;
+    void setMaximumFrameRate(qreal fps);
+
+    qreal frameRate() const;
+
+    bool isThreadedRenderingEnabled() const;
+    void setThreadedRendering(bool enable);
+
+
+    struct View {
+        int index = 0; // in the layout
+        QRect rect; // in pixels, with the origin at the top-left of the texture
+        QRhiViewport viewport;
+        QRhiScissor scissor;
+    };
+
+    QList<QRectF> viewLayout() const;
+    void setViewLayout(const QList<QRectF> &layout);
+    void setViewGrid(int columns, int rows);
+    const QList<View> &views() const;
+
+    struct TimingStatistics {
+        qreal min = 0;
+        qreal avg = 0;
+        qreal p99 = 0;
+        int sampleCount = 0;
+    };
+
+    struct FrameStatistics {
+        TimingStatistics initializeTime;
+        TimingStatistics renderTime;
+        TimingStatistics endFrameWaitTime;
+        qint64 textureReallocationCount = 0;
+        qint64 grabCount = 0;
+        qint64 renderedFrameCount = 0;
+        qint64 skippedFrameCount = 0;
+    };
+
+    bool isFrameStatisticsEnabled() const;
+    void setFrameStatisticsEnabled(bool enabled);
+    FrameStatistics frameStatistics() const;
+    qint64 skippedFrameCount() const;
+    qint64 textureReallocationCount() const;
+
+    static int frameBudget(QWidget *window);
+    static void setFrameBudget(QWidget *window, int msec);
+
+    static bool isBatchedRenderingEnabled(QWidget *window);
+    static void setBatchedRendering(QWidget *window, bool enable);
+
+    virtual void synchronize();
+    virtual bool needsRender() const;
     virtual void initialize(QRhi *rhi, QRhiTexture *outputTexture);
     virtual void render(QRhiCommandBuffer *cb);
+    virtual void releaseResources();
 
-    QImage grabTexture();
+    QRhiRenderTarget *renderTarget() const;
+    QRhiRenderBuffer *msaaColorBuffer() const;
+    QRhiRenderBuffer *depthStencilBuffer() const;
+
+    struct RawTextureData {
+        QByteArray data;
+        QSize pixelSize;
+        qsizetype bytesPerLine = 0;
+        QRhiTexture::Format format = QRhiTexture::UnknownFormat;
+
+        const uchar *scanLine(int y) const
+        {
+            return reinterpret_cast<const uchar *>(data.constData()) + y * bytesPerLine;
+        }
+    };
+
+    struct ResourcePoolStatistics {
+        int textureCount = 0;
+        qint64 textureBytes = 0;
+        int freeTextureCount = 0;
+        qint64 freeTextureBytes = 0;
+        int renderBufferCount = 0;
+        int renderBufferReferenceCount = 0;
+        qint64 renderBufferBytes = 0;
+        qint64 sharedBytesSaved = 0;
+    };
+
+    ResourcePoolStatistics resourcePoolStatistics() const;
+
+    QImage grabTexture(GrabAlphaMode alphaMode = GrabAlphaAsIs);
+    bool grabTexture(QImage *image, GrabAlphaMode alphaMode = GrabAlphaAsIs);
+    RawTextureData grabTextureData();
+    QFuture<QImage> grabTextureAsync(GrabAlphaMode alphaMode = GrabAlphaAsIs);
+
+    bool startCapture(QRhiWidgetCaptureSink *sink, int frameInterval = 1, int bufferCount = 3);
+    void stopCapture();
+    bool isCapturing() const;
+    qint64 droppedCaptureFrameCount() const;
 
 Q_SIGNALS:
     void explicitSizeChanged(const QSize &pixelSize);
+    void textureResizeDelayChanged(int msec);
+    void resolutionScaleChanged(qreal scale);
+    void targetFrameTimeChanged(qreal msec);
+    void minimumResolutionScaleChanged(qreal scale);
+    void effectiveResolutionScaleChanged(qreal scale);
+    void frameRateChanged(qreal fps);
+    void sampleCountChanged(int samples);
+    void autoRenderTargetChanged(bool enabled);
+    void frameStatisticsEnabledChanged(bool enabled);
+    void frameStatisticsChanged(const QRhiWidget::FrameStatistics &statistics);
+    void captureFrameDropped(qint64 frameNumber);
+    void threadedRenderingChanged(bool enabled);
 
 protected:
+    void stopRenderThread();
+
     void resizeEvent(QResizeEvent *e) override;
     void paintEvent(QPaintEvent *e) override;
     bool event(QEvent *e) override;
@@ -2,28 +2,181 @@
 #define RHIWIDGET_P_H
 
 #include "rhiwidget.h"
+#include "rhiwidgetcapture_p.h"
+#include "rhiwidgetrenderthread_p.h"
+#include "rhiwidgetresolution_p.h"
+#include "rhiwidgetscheduler_p.h"
 
 #include <private/qwidget_p.h>
 #include <private/qbackingstorerhisupport_p.h>
+#include <QPromise>
+#include <QBasicTimer>
+#include <QElapsedTimer>
+#include <QAtomicInteger>
+#include <QMutex>
+#include <QPointer>
+#include <vector>
 
 class QRhiWidgetPrivate : public QWidgetPrivate
 {
     Q_DECLARE_PUBLIC(QRhiWidget)
 public:
-    QRhiTexture *texture() const override { return textureInvalid ? nullptr : t; }
+    QRhiTexture *texture() const override
+    {
+        if (textureInvalid)
+            return nullptr;
+        return threaded ? compositeTexture : t;
+    }
     QPlatformBackingStoreRhiConfig rhiConfig() const override;
 
+    using QWidgetPrivate::get;
+    static QRhiWidgetPrivate *get(QRhiWidget *widget)
+    {
+        return static_cast<QRhiWidgetPrivate *>(QWidgetPrivate::get(widget));
+    }
+
+    struct PendingGrab {
+        QPromise<QImage> promise;
+        QRhiWidget::GrabAlphaMode alphaMode;
+    };
+
+    // served by the threaded frame with the given sequence number
+    struct InFlightGrabs {
+        quint64 sequence;
+        std::vector<PendingGrab> grabs;
+    };
+
+    QRhi *windowRhi() const;
     void ensureRhi();
-    void ensureTexture();
+    void syncSettings();
+    void updateViews();
+    void ensureTexture(bool *changed);
+    void ensureRenderTarget();
+    void resetRenderTarget();
+    void releaseRenderBuffers();
+    void releaseTexture();
+    bool preparePaintFrame(bool *needed);
+    bool paintBatched();
+    static void renderBatch(QWidget *window, QRhiWidgetScheduler *scheduler);
+    bool prepareOffscreenFrame();
+    bool renderAndReadBack(QRhiReadbackResult *result);
+    QImage imageFromReadback(QRhiReadbackResult &&result, QRhiWidget::GrabAlphaMode alphaMode) const;
+    QImage imageFromReadback(const QRhiReadbackResult &result, QRhiWidget::GrabAlphaMode alphaMode) const;
+    void enqueueAsyncGrab(QRhiCommandBuffer *cb);
+    void failPendingGrabs();
+    void finishGrabs(std::vector<PendingGrab> *grabs, QRhiReadbackResult *result);
+    qint64 enqueueCaptureReadback(QRhiCommandBuffer *cb);
+    void updateScheduling();
+    void frameRendered(qint64 costNsecs);
+    void invokeInitialize();
+    void recordFrameTimings(qint64 renderNsecs, qint64 endFrameNsecs);
+    qreal effectiveResolutionScale() const;
+    void updateResolution(qreal oldScale);
+
+    bool ensureRenderThread();
+    void waitForRenderThread() const;
+    void paintThreaded();
+    void startThreadedFrame(bool forceRender);
+    void renderThreadFrame(QRhiWidgetThreadedFrame *frame);
+    void threadedFrameCompleted();
+    void presentThreadedFrames(std::vector<QRhiWidgetThreadedFrame> *frames);
+    void importCompositeTexture(const QRhiWidgetThreadedFrame &frame);
+    void uploadCompositeTexture(const QRhiReadbackResult &readback);
+    void releaseCompositeTexture();
+    void releaseRetiredTextures(std::vector<QRhiTexture *> *textures);
+
+    // the most recent samples, in nanoseconds
+    struct TimingSamples {
+        void add(qint64 nsecs);
+        void clear();
+        QRhiWidget::TimingStatistics statistics() const;
+        std::vector<qint64> samples;
+        size_t next = 0;
+    };
 
     QRhi *rhi = nullptr;
+    bool rhiResolved = false;
     QRhiTexture *t = nullptr;
     bool noSize = false;
     QPlatformBackingStoreRhiConfig config;
     QRhiTexture::Format format = QRhiTexture::RGBA8;
+    QString pipelineCacheFile;
     QSize explicitSize;
+    int samples = 1;
+    bool autoRenderTarget = false;
+    bool renderTargetDirty = false;
+    QList<QRectF> viewLayout; // normalized, empty means a single view
+    bool viewLayoutDirty = false;
+    // What the rendering side works with, copied from the above by
+    // syncSettings() before each frame, so that with threaded rendering the
+    // render thread never reads what the GUI thread may be changing.
+    struct {
+        QSize pixelSize;
+        QRhiTexture::Format format = QRhiTexture::RGBA8;
+        QString pipelineCacheFile;
+        int samples = 1;
+        bool autoRenderTarget = false;
+        bool renderTargetDirty = false;
+        bool resizePending = false;
+        QList<QRectF> viewLayout;
+        QList<QRhiWidget::View> views;
+        QSize viewsPixelSize;
+        bool viewsChanged = false; // by a new layout, the texture is the same
+    } settings;
+    QRhiRenderBuffer *msaaColorBuffer = nullptr;
+    QRhiRenderBuffer *depthStencil = nullptr;
+    QRhiTextureRenderTarget *renderTarget = nullptr;
+    QRhiRenderPassDescriptor *rp = nullptr;
+    int resizeDelay = 0;
+    QBasicTimer resizeTimer;
+    qreal resolutionScale = 1;
+    qreal targetFrameTime = 0;
+    qreal minimumResolutionScale = 0.5;
+    QRhiWidgetResolutionController resolution;
     QBackingStoreRhiSupport::RhiRenderResources offscreenRhiResources;
+    // set while a QRhiWidgetOffscreenRenderer renders the widget with its QRhi
+    QRhi *offscreenRendererRhi = nullptr;
     bool textureInvalid = false;
+    std::vector<PendingGrab> pendingGrabs;
+    QScopedPointer<QRhiWidgetCapture> capture;
+    QRhiReadbackResult grabReadback;
+    QRhiWidget::UpdateBehavior updateBehavior = QRhiWidget::OnDemandUpdates;
+    qreal maximumFrameRate = 60;
+    QPointer<QRhiWidgetScheduler> scheduler;
+    QElapsedTimer frameRateTimer;
+    int frameRateFrameCount = 0;
+    qreal frameRate = 0;
+    struct {
+        // the render thread adds samples while the GUI thread reads them
+        mutable QMutex mutex;
+        bool enabled = false;
+        TimingSamples initializeTime;
+        TimingSamples renderTime;
+        TimingSamples endFrameWaitTime;
+        // counted regardless of enabled, on either thread, without the mutex
+        QAtomicInteger<qint64> textureReallocationCount;
+        QAtomicInteger<qint64> grabCount;
+        QAtomicInteger<qint64> renderedFrameCount;
+        QAtomicInteger<qint64> skippedFrameCount;
+        QRhiWidget::FrameStatistics current;
+    } stats;
+    // With threaded rendering, rhi, t, and the render target belong to the
+    // render thread, and the window composites compositeTexture, which
+    // belongs to the window's QRhi. When the render thread's QRhi shares the
+    // device of textureShareRhi, compositeTexture is t imported into the
+    // window's QRhi, and textures t was replaced with are retired until the
+    // window cannot be using them anymore.
+    bool threaded = false;
+    QScopedPointer<QRhiWidgetRenderThread> renderThread;
+    bool textureShared = false;
+    std::vector<QRhiTexture *> retiredTextures;
+    QRhi *textureShareRhi = nullptr;
+    QRhi *compositeRhi = nullptr;
+    QRhiTexture *compositeTexture = nullptr;
+    bool compositeTextureImported = false;
+    bool threadedFramePending = false;
+    quint64 threadedFrameSequence = 0;
+    std::vector<InFlightGrabs> inFlightGrabs;
 };
 
 #endif
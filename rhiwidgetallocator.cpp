@@ -0,0 +1,169 @@
+#include "rhiwidgetallocator.h"
+#include <cstring>
+
+/*!
+    \class QRhiWidgetTransientAllocator
+    \inmodule QtWidgets
+    \since 6.x
+
+    \brief Sub-allocates per-frame uniform, vertex and index data from a few
+    large buffers.
+
+    Creating and updating one small QRhiBuffer per object does not scale to
+    thousands of objects. Instead, call beginFrame() at the start of
+    QRhiWidget::render(), allocate() the data for each object, and pass a
+    resource update batch to endFrame() before recording the pass that uses
+    it. The data of each block is written with a single
+    QRhiResourceUpdateBatch::updateDynamicBuffer() call.
+
+    Uniform data is aligned to QRhi::ubufAlignment(), so that it can be bound
+    with QRhiShaderResourceBinding::uniformBufferWithDynamicOffset(), using
+    the allocation's offset as the dynamic offset. The shader resource
+    bindings reference a specific buffer, Allocation::block identifies it
+    among the blocks for the same usage. Blocks are never freed or replaced
+    while the QRhi stays the same, so bindings created for a block can be
+    kept.
+
+    The buffers are of type QRhiBuffer::Dynamic, which QRhi already backs
+    with a native buffer per frame in flight where the backend needs that.
+    Therefore all allocations are recycled in every beginFrame(), without
+    overwriting data the GPU may still be reading.
+
+    The default block size of 64 KB is the largest uniform buffer range that
+    is guaranteed to be bindable with all backends. Larger allocations get a
+    block of their own.
+ */
+QRhiWidgetTransientAllocator::QRhiWidgetTransientAllocator(quint32 blockSize)
+    : m_blockSize(blockSize)
+{
+}
+
+QRhiWidgetTransientAllocator::~QRhiWidgetTransientAllocator()
+{
+    releaseResources();
+}
+
+QRhiWidgetTransientAllocator::Pool &QRhiWidgetTransientAllocator::pool(QRhiBuffer::UsageFlag usage)
+{
+    return m_pools[usage == QRhiBuffer::VertexBuffer ? 0 : usage == QRhiBuffer::IndexBuffer ? 1 : 2];
+}
+
+const QRhiWidgetTransientAllocator::Pool &QRhiWidgetTransientAllocator::pool(QRhiBuffer::UsageFlag usage) const
+{
+    return m_pools[usage == QRhiBuffer::VertexBuffer ? 0 : usage == QRhiBuffer::IndexBuffer ? 1 : 2];
+}
+
+/*!
+    Starts a new frame on \a rhi, making all previous allocations invalid.
+    Switching to a different QRhi releases all blocks.
+ */
+void QRhiWidgetTransientAllocator::beginFrame(QRhi *rhi)
+{
+    if (m_rhi != rhi) {
+        releaseResources();
+        m_rhi = rhi;
+    }
+    for (Pool &p : m_pools) {
+        for (Block &b : p.blocks)
+            b.used = 0;
+        p.current = 0;
+    }
+    m_stats.allocatedBytes = 0;
+    m_stats.paddingBytes = 0;
+    m_stats.allocationCount = 0;
+}
+
+/*!
+    Allocates \a size bytes in a buffer with the given \a usage, which must be
+    one of QRhiBuffer::VertexBuffer, QRhiBuffer::IndexBuffer, or
+    QRhiBuffer::UniformBuffer, and copies \a data there when not null.
+
+    Returns a null allocation on failure.
+ */
+QRhiWidgetTransientAllocator::Allocation QRhiWidgetTransientAllocator::allocate(QRhiBuffer::UsageFlag usage,
+                                                                                  quint32 size, const void *data)
+{
+    Allocation a;
+    if (!m_rhi)
+        return a;
+    if (usage != QRhiBuffer::VertexBuffer && usage != QRhiBuffer::IndexBuffer && usage != QRhiBuffer::UniformBuffer) {
+        qWarning("QRhiWidgetTransientAllocator: Unsupported buffer usage %d", int(usage));
+        return a;
+    }
+
+    Pool &p = pool(usage);
+    const quint32 alignment = usage == QRhiBuffer::UniformBuffer ? quint32(m_rhi->ubufAlignment()) : 16;
+    for (;;) {
+        if (p.current < int(p.blocks.size())) {
+            Block &b = p.blocks[p.current];
+            const quint32 offset = (b.used + alignment - 1) & ~(alignment - 1);
+            if (quint64(offset) + size <= b.data.size()) {
+                if (data)
+                    std::memcpy(b.data.data() + offset, data, size);
+                m_stats.paddingBytes += offset - b.used;
+                m_stats.allocatedBytes += size;
+                ++m_stats.allocationCount;
+                b.used = offset + size;
+                a.buffer = b.buffer;
+                a.offset = offset;
+                a.size = size;
+                a.block = p.current;
+                return a;
+            }
+            ++p.current;
+            continue;
+        }
+
+        const quint32 blockSize = qMax(m_blockSize, size);
+        Block b;
+        b.buffer = m_rhi->newBuffer(QRhiBuffer::Dynamic, usage, blockSize);
+        if (!b.buffer->create()) {
+            qWarning("QRhiWidgetTransientAllocator: Failed to create buffer of %u bytes", blockSize);
+            delete b.buffer;
+            return a;
+        }
+        b.data.resize(blockSize);
+        p.blocks.push_back(std::move(b));
+        ++m_stats.blockCount;
+        m_stats.capacityBytes += blockSize;
+    }
+}
+
+/*!
+    Enqueues the updates for all data allocated since beginFrame() on \a u.
+ */
+void QRhiWidgetTransientAllocator::endFrame(QRhiResourceUpdateBatch *u)
+{
+    for (Pool &p : m_pools) {
+        for (Block &b : p.blocks) {
+            if (b.used)
+                u->updateDynamicBuffer(b.buffer, 0, b.used, b.data.data());
+        }
+    }
+}
+
+/*!
+    Returns the buffer of the given \a block for \a usage, or null if there
+    is no such block.
+ */
+QRhiBuffer *QRhiWidgetTransientAllocator::blockBuffer(QRhiBuffer::UsageFlag usage, int block) const
+{
+    const Pool &p = pool(usage);
+    return block >= 0 && block < int(p.blocks.size()) ? p.blocks[block].buffer : nullptr;
+}
+
+/*!
+    Releases all blocks. Must be called before the QRhi is destroyed, when the
+    allocator is kept around longer than that.
+ */
+void QRhiWidgetTransientAllocator::releaseResources()
+{
+    for (Pool &p : m_pools) {
+        for (Block &b : p.blocks)
+            delete b.buffer;
+        p.blocks.clear();
+        p.current = 0;
+    }
+    m_stats = Statistics();
+    m_rhi = nullptr;
+}
@@ -0,0 +1,62 @@
+#ifndef RHIWIDGETALLOCATOR_H
+#define RHIWIDGETALLOCATOR_H
+
+#include <QtGui/private/qrhi_p.h>
+#include <vector>
+
+class QRhiWidgetTransientAllocator
+{
+public:
+    struct Allocation {
+        QRhiBuffer *buffer = nullptr;
+        quint32 offset = 0;
+        quint32 size = 0;
+        int block = -1;
+
+        bool isNull() const { return !buffer; }
+    };
+
+    struct Statistics {
+        int blockCount = 0;
+        qint64 capacityBytes = 0;
+        qint64 allocatedBytes = 0;
+        qint64 paddingBytes = 0;
+        int allocationCount = 0;
+    };
+
+    explicit QRhiWidgetTransientAllocator(quint32 blockSize = 65536);
+    ~QRhiWidgetTransientAllocator();
+
+    quint32 blockSize() const { return m_blockSize; }
+
+    void beginFrame(QRhi *rhi);
+    Allocation allocate(QRhiBuffer::UsageFlag usage, quint32 size, const void *data = nullptr);
+    void endFrame(QRhiResourceUpdateBatch *u);
+
+    QRhiBuffer *blockBuffer(QRhiBuffer::UsageFlag usage, int block) const;
+    Statistics statistics() const { return m_stats; }
+
+    void releaseResources();
+
+private:
+    struct Block {
+        QRhiBuffer *buffer = nullptr;
+        std::vector<char> data;
+        quint32 used = 0;
+    };
+
+    struct Pool {
+        std::vector<Block> blocks;
+        int current = 0;
+    };
+
+    Pool &pool(QRhiBuffer::UsageFlag usage);
+    const Pool &pool(QRhiBuffer::UsageFlag usage) const;
+
+    QRhi *m_rhi = nullptr;
+    quint32 m_blockSize;
+    Pool m_pools[3];
+    Statistics m_stats;
+};
+
+#endif
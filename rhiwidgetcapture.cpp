@@ -0,0 +1,251 @@
+#include "rhiwidgetcapture_p.h"
+
+/*!
+    \class QRhiWidgetCaptureSink
+    \inmodule QtWidgets
+    \since 6.x
+
+    \brief Interface for consumers of frames captured by QRhiWidget::startCapture().
+
+    All functions are invoked on the capture worker thread, never on the GUI
+    thread. open() is called with the size and format of the first captured
+    frame, followed by any number of writeFrame() calls, and finally close()
+    when the capture is stopped. The data passed to writeFrame() is only valid
+    during the call.
+
+    Returning false from open() or writeFrame() stops feeding the sink. Any
+    further frames are reported as dropped.
+ */
+
+QRhiWidgetCaptureSink::~QRhiWidgetCaptureSink()
+{
+}
+
+/*!
+    \class QRhiWidgetRawCaptureSink
+    \inmodule QtWidgets
+    \since 6.x
+
+    \brief Writes captured frames unmodified, one after another, into a file.
+
+    The rows of each frame are written tightly packed in the texture's format,
+    without any header. This is suitable for example for piping into tools that
+    accept raw video, such as \c{ffmpeg -f rawvideo -pix_fmt rgba}.
+ */
+QRhiWidgetRawCaptureSink::QRhiWidgetRawCaptureSink(const QString &fileName)
+    : m_file(fileName)
+{
+}
+
+bool QRhiWidgetRawCaptureSink::open(const QSize &pixelSize, QRhiTexture::Format format)
+{
+    Q_UNUSED(format);
+    m_pixelSize = pixelSize;
+    return m_file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+}
+
+bool QRhiWidgetRawCaptureSink::writeFrame(const uchar *data, qsizetype bytesPerLine, qint64 frameNumber)
+{
+    Q_UNUSED(frameNumber);
+    const qsizetype size = bytesPerLine * m_pixelSize.height();
+    return m_file.write(reinterpret_cast<const char *>(data), size) == size;
+}
+
+void QRhiWidgetRawCaptureSink::close()
+{
+    m_file.close();
+}
+
+/*!
+    \class QRhiWidgetY4MCaptureSink
+    \inmodule QtWidgets
+    \since 6.x
+
+    \brief Writes captured frames into a YUV4MPEG2 (Y4M) file.
+
+    Frames are converted to full range BT.601 YCbCr with 4:2:0 chroma
+    subsampling (\c C420jpeg). Only QRhiTexture::RGBA8 and QRhiTexture::BGRA8
+    textures are supported.
+ */
+QRhiWidgetY4MCaptureSink::QRhiWidgetY4MCaptureSink(const QString &fileName, int framesPerSecond)
+    : m_file(fileName),
+      m_fps(framesPerSecond)
+{
+}
+
+bool QRhiWidgetY4MCaptureSink::open(const QSize &pixelSize, QRhiTexture::Format format)
+{
+    if (format != QRhiTexture::RGBA8 && format != QRhiTexture::BGRA8) {
+        qWarning("QRhiWidgetY4MCaptureSink: Only RGBA8 and BGRA8 textures are supported");
+        return false;
+    }
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    m_pixelSize = pixelSize;
+    m_bgra = format == QRhiTexture::BGRA8;
+    const int chromaSize = ((pixelSize.width() + 1) / 2) * ((pixelSize.height() + 1) / 2);
+    m_planes.resize(pixelSize.width() * pixelSize.height() + 2 * chromaSize);
+
+    const QByteArray header = QByteArrayLiteral("YUV4MPEG2 W") + QByteArray::number(pixelSize.width())
+            + QByteArrayLiteral(" H") + QByteArray::number(pixelSize.height())
+            + QByteArrayLiteral(" F") + QByteArray::number(m_fps)
+            + QByteArrayLiteral(":1 Ip A1:1 C420jpeg\n");
+    return m_file.write(header) == header.size();
+}
+
+static inline uchar clampToByte(int v)
+{
+    return uchar(qBound(0, v, 255));
+}
+
+bool QRhiWidgetY4MCaptureSink::writeFrame(const uchar *data, qsizetype bytesPerLine, qint64 frameNumber)
+{
+    Q_UNUSED(frameNumber);
+    const int w = m_pixelSize.width();
+    const int h = m_pixelSize.height();
+    const int cw = (w + 1) / 2;
+    const int ch = (h + 1) / 2;
+    const int ri = m_bgra ? 2 : 0;
+    const int bi = m_bgra ? 0 : 2;
+    uchar *yPlane = reinterpret_cast<uchar *>(m_planes.data());
+    uchar *cbPlane = yPlane + w * h;
+    uchar *crPlane = cbPlane + cw * ch;
+
+    for (int y = 0; y < h; ++y) {
+        const uchar *src = data + y * bytesPerLine;
+        uchar *dst = yPlane + y * w;
+        for (int x = 0; x < w; ++x, src += 4)
+            dst[x] = uchar((77 * src[ri] + 150 * src[1] + 29 * src[bi] + 128) >> 8);
+    }
+
+    for (int cy = 0; cy < ch; ++cy) {
+        const uchar *row0 = data + (2 * cy) * bytesPerLine;
+        const uchar *row1 = data + qMin(2 * cy + 1, h - 1) * bytesPerLine;
+        for (int cx = 0; cx < cw; ++cx) {
+            const int x0 = 8 * cx;
+            const int x1 = qMin(2 * cx + 1, w - 1) * 4;
+            const int r = (row0[x0 + ri] + row0[x1 + ri] + row1[x0 + ri] + row1[x1 + ri] + 2) >> 2;
+            const int g = (row0[x0 + 1] + row0[x1 + 1] + row1[x0 + 1] + row1[x1 + 1] + 2) >> 2;
+            const int b = (row0[x0 + bi] + row0[x1 + bi] + row1[x0 + bi] + row1[x1 + bi] + 2) >> 2;
+            cbPlane[cy * cw + cx] = clampToByte((-43 * r - 85 * g + 128 * b + 32896) >> 8);
+            crPlane[cy * cw + cx] = clampToByte((128 * r - 107 * g - 21 * b + 32896) >> 8);
+        }
+    }
+
+    if (m_file.write("FRAME\n", 6) != 6)
+        return false;
+    return m_file.write(m_planes) == m_planes.size();
+}
+
+void QRhiWidgetY4MCaptureSink::close()
+{
+    m_file.close();
+}
+
+QRhiWidgetCapture::QRhiWidgetCapture(QRhiWidgetCaptureSink *sink, int frameInterval, int bufferCount)
+    : sink(sink),
+      interval(qMax(1, frameInterval)),
+      ring(qMax(1, bufferCount))
+{
+    for (Slot &slot : ring) {
+        Slot *s = &slot;
+        s->result.completed = [this, s] { frameReady(s); };
+    }
+    start();
+}
+
+QRhiWidgetCapture::~QRhiWidgetCapture()
+{
+    {
+        QMutexLocker lock(&mutex);
+        stopRequested = true;
+        cond.wakeOne();
+    }
+    wait();
+}
+
+bool QRhiWidgetCapture::isFrameDue()
+{
+    return frameCounter++ % interval == 0;
+}
+
+// Called on the thread rendering the widget's frames. Returns the readback
+// result to record the texture readback into, or null when all slots are
+// still busy, meaning the sink is behind and the frame must be dropped.
+QRhiReadbackResult *QRhiWidgetCapture::acquireSlot(qint64 *frameNumber)
+{
+    const qint64 number = capturedCounter++;
+    if (frameNumber)
+        *frameNumber = number;
+
+    QMutexLocker lock(&mutex);
+    if (failed.loadRelaxed()) {
+        dropped.fetchAndAddRelaxed(1);
+        return nullptr;
+    }
+    for (Slot &slot : ring) {
+        if (slot.state == Slot::Free) {
+            slot.state = Slot::InFlight;
+            slot.frameNumber = number;
+            return &slot.result;
+        }
+    }
+    dropped.fetchAndAddRelaxed(1);
+    return nullptr;
+}
+
+void QRhiWidgetCapture::frameReady(Slot *slot)
+{
+    QMutexLocker lock(&mutex);
+    slot->state = Slot::Queued;
+    queue.enqueue(slot);
+    cond.wakeOne();
+}
+
+void QRhiWidgetCapture::run()
+{
+    bool sinkOpen = false;
+    QSize sinkSize;
+    for (;;) {
+        Slot *slot = nullptr;
+        {
+            QMutexLocker lock(&mutex);
+            while (queue.isEmpty() && !stopRequested)
+                cond.wait(&mutex);
+            if (queue.isEmpty())
+                break;
+            slot = queue.dequeue();
+        }
+
+        // The slot is exclusively ours until it is marked Free again, so the
+        // data can be accessed without holding the lock. Only constData() is
+        // used, the QByteArray must not be shared as that would make the next
+        // readback into this slot reallocate.
+        const QRhiReadbackResult &result(slot->result);
+        bool ok = !failed.loadRelaxed();
+        if (ok && !sinkOpen) {
+            sinkSize = result.pixelSize;
+            ok = sinkOpen = sink->open(sinkSize, result.format);
+        }
+        if (ok && result.pixelSize != sinkSize) {
+            // the sink cannot change size on the fly, use an explicit size
+            // when capturing a widget that may get resized
+            dropped.fetchAndAddRelaxed(1);
+        } else if (ok && !result.data.isEmpty()) {
+            const qsizetype bytesPerLine = result.data.size() / result.pixelSize.height();
+            ok = sink->writeFrame(reinterpret_cast<const uchar *>(result.data.constData()),
+                                  bytesPerLine, slot->frameNumber);
+        }
+        if (!ok) {
+            failed.storeRelaxed(1);
+            dropped.fetchAndAddRelaxed(1);
+        }
+
+        QMutexLocker lock(&mutex);
+        slot->state = Slot::Free;
+    }
+
+    if (sinkOpen)
+        sink->close();
+}
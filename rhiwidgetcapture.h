@@ -0,0 +1,48 @@
+#ifndef RHIWIDGETCAPTURE_H
+#define RHIWIDGETCAPTURE_H
+
+#include <QFile>
+#include <QtGui/private/qrhi_p.h>
+
+class QRhiWidgetCaptureSink
+{
+public:
+    virtual ~QRhiWidgetCaptureSink();
+
+    virtual bool open(const QSize &pixelSize, QRhiTexture::Format format) = 0;
+    virtual bool writeFrame(const uchar *data, qsizetype bytesPerLine, qint64 frameNumber) = 0;
+    virtual void close() = 0;
+};
+
+class QRhiWidgetRawCaptureSink : public QRhiWidgetCaptureSink
+{
+public:
+    QRhiWidgetRawCaptureSink(const QString &fileName);
+
+    bool open(const QSize &pixelSize, QRhiTexture::Format format) override;
+    bool writeFrame(const uchar *data, qsizetype bytesPerLine, qint64 frameNumber) override;
+    void close() override;
+
+private:
+    QFile m_file;
+    QSize m_pixelSize;
+};
+
+class QRhiWidgetY4MCaptureSink : public QRhiWidgetCaptureSink
+{
+public:
+    QRhiWidgetY4MCaptureSink(const QString &fileName, int framesPerSecond = 60);
+
+    bool open(const QSize &pixelSize, QRhiTexture::Format format) override;
+    bool writeFrame(const uchar *data, qsizetype bytesPerLine, qint64 frameNumber) override;
+    void close() override;
+
+private:
+    QFile m_file;
+    int m_fps;
+    QSize m_pixelSize;
+    bool m_bgra = false;
+    QByteArray m_planes;
+};
+
+#endif
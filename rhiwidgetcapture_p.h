@@ -0,0 +1,55 @@
+#ifndef RHIWIDGETCAPTURE_P_H
+#define RHIWIDGETCAPTURE_P_H
+
+#include "rhiwidgetcapture.h"
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QQueue>
+#include <QAtomicInteger>
+#include <vector>
+
+class QRhiWidgetCapture : public QThread
+{
+public:
+    QRhiWidgetCapture(QRhiWidgetCaptureSink *sink, int frameInterval, int bufferCount);
+    ~QRhiWidgetCapture();
+
+    bool isFrameDue();
+    QRhiReadbackResult *acquireSlot(qint64 *frameNumber);
+
+    qint64 droppedFrameCount() const { return dropped.loadRelaxed(); }
+    bool hasFailed() const { return failed.loadRelaxed(); }
+
+protected:
+    void run() override;
+
+private:
+    struct Slot {
+        enum State {
+            Free,
+            InFlight,
+            Queued
+        };
+        QRhiReadbackResult result;
+        qint64 frameNumber = 0;
+        State state = Free;
+    };
+
+    void frameReady(Slot *slot);
+
+    QRhiWidgetCaptureSink *sink;
+    int interval;
+    qint64 frameCounter = 0;
+    qint64 capturedCounter = 0;
+    std::vector<Slot> ring;
+    QQueue<Slot *> queue;
+    QMutex mutex;
+    QWaitCondition cond;
+    bool stopRequested = false;
+    QAtomicInteger<qint64> dropped = 0;
+    QAtomicInt failed = 0;
+};
+
+#endif
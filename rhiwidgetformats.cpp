@@ -0,0 +1,527 @@
+#include "rhiwidgetformats_p.h"
+
+#include <private/qsimd_p.h>
+
+namespace QRhiWidgetFormats {
+
+// Readback data is tightly packed and in the texture's own layout. Formats
+// with an exact QImage equivalent are taken as-is, the others are expanded
+// to the closest four component QImage format by the kernels below. Each
+// kernel has a scalar version, an SSE2 version used whenever the compiler
+// targets SSE2 (always the case on x86-64), and, where it pays off, an AVX2
+// version selected at runtime.
+
+static void convertRG8ToRGBX8888_scalar(uchar *dst, const uchar *src, qsizetype count)
+{
+    for (qsizetype i = 0; i < count; ++i, src += 2, dst += 4) {
+        dst[0] = src[0];
+        dst[1] = src[1];
+        dst[2] = 0;
+        dst[3] = 0xFF;
+    }
+}
+
+static void convertRG16ToRGBX64_scalar(quint16 *dst, const quint16 *src, qsizetype count)
+{
+    for (qsizetype i = 0; i < count; ++i, src += 2, dst += 4) {
+        dst[0] = src[0];
+        dst[1] = src[1];
+        dst[2] = 0;
+        dst[3] = 0xFFFF;
+    }
+}
+
+static const quint16 HALF_ONE = 0x3C00;
+
+static void convertR16FToRGBX16F_scalar(quint16 *dst, const quint16 *src, qsizetype count)
+{
+    for (qsizetype i = 0; i < count; ++i, dst += 4) {
+        dst[0] = src[i];
+        dst[1] = 0;
+        dst[2] = 0;
+        dst[3] = HALF_ONE;
+    }
+}
+
+static void convertR32FToRGBX32F_scalar(float *dst, const float *src, qsizetype count)
+{
+    for (qsizetype i = 0; i < count; ++i, dst += 4) {
+        dst[0] = src[i];
+        dst[1] = 0.0f;
+        dst[2] = 0.0f;
+        dst[3] = 1.0f;
+    }
+}
+
+static inline uint premultiplyChannel(uint c, uint a)
+{
+    // same rounding as qPremultiply()
+    const uint t = c * a;
+    return (t + (t >> 8) + 0x80) >> 8;
+}
+
+static void premultiply8888_scalar(uchar *data, qsizetype count)
+{
+    for (qsizetype i = 0; i < count; ++i, data += 4) {
+        const uint a = data[3];
+        data[0] = uchar(premultiplyChannel(data[0], a));
+        data[1] = uchar(premultiplyChannel(data[1], a));
+        data[2] = uchar(premultiplyChannel(data[2], a));
+    }
+}
+
+#if defined(__SSE2__)
+static void convertRG8ToRGBX8888_sse2(uchar *dst, const uchar *src, qsizetype count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha = _mm_set1_epi32(int(0xFF000000));
+    qsizetype i = 0;
+    for (; i + 8 <= count; i += 8, src += 16, dst += 32) {
+        const __m128i rg = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _mm_or_si128(_mm_unpacklo_epi16(rg, zero), alpha));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 16), _mm_or_si128(_mm_unpackhi_epi16(rg, zero), alpha));
+    }
+    convertRG8ToRGBX8888_scalar(dst, src, count - i);
+}
+
+static void convertRG16ToRGBX64_sse2(quint16 *dst, const quint16 *src, qsizetype count)
+{
+    const __m128i alpha = _mm_set1_epi32(int(0xFFFF0000));
+    qsizetype i = 0;
+    for (; i + 4 <= count; i += 4, src += 8, dst += 16) {
+        const __m128i rg = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _mm_unpacklo_epi32(rg, alpha));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 8), _mm_unpackhi_epi32(rg, alpha));
+    }
+    convertRG16ToRGBX64_scalar(dst, src, count - i);
+}
+
+static void convertR16FToRGBX16F_sse2(quint16 *dst, const quint16 *src, qsizetype count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha = _mm_set1_epi32(int(HALF_ONE) << 16);
+    qsizetype i = 0;
+    for (; i + 8 <= count; i += 8, src += 8, dst += 32) {
+        const __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+        const __m128i lo = _mm_unpacklo_epi16(r, zero);
+        const __m128i hi = _mm_unpackhi_epi16(r, zero);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _mm_unpacklo_epi32(lo, alpha));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 8), _mm_unpackhi_epi32(lo, alpha));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 16), _mm_unpacklo_epi32(hi, alpha));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 24), _mm_unpackhi_epi32(hi, alpha));
+    }
+    convertR16FToRGBX16F_scalar(dst, src, count - i);
+}
+
+static void convertR32FToRGBX32F_sse2(float *dst, const float *src, qsizetype count)
+{
+    const __m128 gba = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+    qsizetype i = 0;
+    for (; i + 4 <= count; i += 4, src += 4, dst += 16) {
+        const __m128 r = _mm_loadu_ps(src);
+        _mm_storeu_ps(dst, _mm_move_ss(gba, r));
+        _mm_storeu_ps(dst + 4, _mm_move_ss(gba, _mm_shuffle_ps(r, r, _MM_SHUFFLE(1, 1, 1, 1))));
+        _mm_storeu_ps(dst + 8, _mm_move_ss(gba, _mm_shuffle_ps(r, r, _MM_SHUFFLE(2, 2, 2, 2))));
+        _mm_storeu_ps(dst + 12, _mm_move_ss(gba, _mm_shuffle_ps(r, r, _MM_SHUFFLE(3, 3, 3, 3))));
+    }
+    convertR32FToRGBX32F_scalar(dst, src, count - i);
+}
+
+static inline __m128i premultiply4x16_sse2(__m128i px, __m128i alphaMask, __m128i alphaMax, __m128i half)
+{
+    // px holds two pixels as 16-bit channels, the alpha lanes are multiplied
+    // with 255 which leaves them unchanged after the division
+    __m128i a = _mm_shufflelo_epi16(px, _MM_SHUFFLE(3, 3, 3, 3));
+    a = _mm_shufflehi_epi16(a, _MM_SHUFFLE(3, 3, 3, 3));
+    a = _mm_or_si128(_mm_andnot_si128(alphaMask, a), alphaMax);
+    __m128i t = _mm_mullo_epi16(px, a);
+    t = _mm_add_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), half);
+    return _mm_srli_epi16(t, 8);
+}
+
+static void premultiply8888_sse2(uchar *data, qsizetype count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alphaMask = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+    const __m128i alphaMax = _mm_set_epi16(0xFF, 0, 0, 0, 0xFF, 0, 0, 0);
+    const __m128i half = _mm_set1_epi16(0x80);
+    qsizetype i = 0;
+    for (; i + 4 <= count; i += 4, data += 16) {
+        const __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+        const __m128i lo = premultiply4x16_sse2(_mm_unpacklo_epi8(px, zero), alphaMask, alphaMax, half);
+        const __m128i hi = premultiply4x16_sse2(_mm_unpackhi_epi8(px, zero), alphaMask, alphaMax, half);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(data), _mm_packus_epi16(lo, hi));
+    }
+    premultiply8888_scalar(data, count - i);
+}
+#endif // __SSE2__
+
+#if defined(QT_COMPILER_SUPPORTS_AVX2)
+QT_FUNCTION_TARGET(AVX2)
+static void convertRG8ToRGBX8888_avx2(uchar *dst, const uchar *src, qsizetype count)
+{
+    const __m256i alpha = _mm256_set1_epi32(int(0xFF000000));
+    qsizetype i = 0;
+    for (; i + 8 <= count; i += 8, src += 16, dst += 32) {
+        const __m128i rg = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+        const __m256i rgbx = _mm256_or_si256(_mm256_cvtepu16_epi32(rg), alpha);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), rgbx);
+    }
+    convertRG8ToRGBX8888_scalar(dst, src, count - i);
+}
+
+QT_FUNCTION_TARGET(AVX2)
+static void convertRG16ToRGBX64_avx2(quint16 *dst, const quint16 *src, qsizetype count)
+{
+    const __m256i alpha = _mm256_set1_epi64x(qint64(0xFFFF000000000000ULL));
+    qsizetype i = 0;
+    for (; i + 4 <= count; i += 4, src += 8, dst += 16) {
+        const __m128i rg = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+        const __m256i rgbx = _mm256_or_si256(_mm256_cvtepu32_epi64(rg), alpha);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), rgbx);
+    }
+    convertRG16ToRGBX64_scalar(dst, src, count - i);
+}
+
+QT_FUNCTION_TARGET(AVX2)
+static void premultiply8888_avx2(uchar *data, qsizetype count)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i alphaMask = _mm256_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0);
+    const __m256i alphaMax = _mm256_set_epi16(0xFF, 0, 0, 0, 0xFF, 0, 0, 0, 0xFF, 0, 0, 0, 0xFF, 0, 0, 0);
+    const __m256i half = _mm256_set1_epi16(0x80);
+    qsizetype i = 0;
+    for (; i + 8 <= count; i += 8, data += 32) {
+        const __m256i px = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data));
+        __m256i results[2] = { _mm256_unpacklo_epi8(px, zero), _mm256_unpackhi_epi8(px, zero) };
+        for (__m256i &v : results) {
+            __m256i a = _mm256_shufflelo_epi16(v, _MM_SHUFFLE(3, 3, 3, 3));
+            a = _mm256_shufflehi_epi16(a, _MM_SHUFFLE(3, 3, 3, 3));
+            a = _mm256_or_si256(_mm256_andnot_si256(alphaMask, a), alphaMax);
+            __m256i t = _mm256_mullo_epi16(v, a);
+            t = _mm256_add_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), half);
+            v = _mm256_srli_epi16(t, 8);
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(data), _mm256_packus_epi16(results[0], results[1]));
+    }
+    premultiply8888_scalar(data, count - i);
+}
+#endif // QT_COMPILER_SUPPORTS_AVX2
+
+void convertRG8ToRGBX8888(uchar *dst, const uchar *src, qsizetype count)
+{
+#if defined(QT_COMPILER_SUPPORTS_AVX2)
+    if (qCpuHasFeature(AVX2))
+        return convertRG8ToRGBX8888_avx2(dst, src, count);
+#endif
+#if defined(__SSE2__)
+    convertRG8ToRGBX8888_sse2(dst, src, count);
+#else
+    convertRG8ToRGBX8888_scalar(dst, src, count);
+#endif
+}
+
+void convertRG16ToRGBX64(quint16 *dst, const quint16 *src, qsizetype count)
+{
+#if defined(QT_COMPILER_SUPPORTS_AVX2)
+    if (qCpuHasFeature(AVX2))
+        return convertRG16ToRGBX64_avx2(dst, src, count);
+#endif
+#if defined(__SSE2__)
+    convertRG16ToRGBX64_sse2(dst, src, count);
+#else
+    convertRG16ToRGBX64_scalar(dst, src, count);
+#endif
+}
+
+void convertR16FToRGBX16F(quint16 *dst, const quint16 *src, qsizetype count)
+{
+#if defined(__SSE2__)
+    convertR16FToRGBX16F_sse2(dst, src, count);
+#else
+    convertR16FToRGBX16F_scalar(dst, src, count);
+#endif
+}
+
+void convertR32FToRGBX32F(float *dst, const float *src, qsizetype count)
+{
+#if defined(__SSE2__)
+    convertR32FToRGBX32F_sse2(dst, src, count);
+#else
+    convertR32FToRGBX32F_scalar(dst, src, count);
+#endif
+}
+
+void convertBGRA8ToRGBA8(uchar *dst, const uchar *src, qsizetype count)
+{
+    // only needed on big endian, where there are no SIMD kernels
+    for (qsizetype i = 0; i < count; ++i, src += 4, dst += 4) {
+        dst[0] = src[2];
+        dst[1] = src[1];
+        dst[2] = src[0];
+        dst[3] = src[3];
+    }
+}
+
+void premultiply8888(uchar *data, qsizetype count)
+{
+#if defined(QT_COMPILER_SUPPORTS_AVX2)
+    if (qCpuHasFeature(AVX2))
+        return premultiply8888_avx2(data, count);
+#endif
+#if defined(__SSE2__)
+    premultiply8888_sse2(data, count);
+#else
+    premultiply8888_scalar(data, count);
+#endif
+}
+
+QList<KernelSet> kernelSets()
+{
+    QList<KernelSet> sets;
+    sets.append({ "scalar", convertRG8ToRGBX8888_scalar, convertRG16ToRGBX64_scalar,
+                  convertR16FToRGBX16F_scalar, convertR32FToRGBX32F_scalar, premultiply8888_scalar });
+#if defined(__SSE2__)
+    sets.append({ "sse2", convertRG8ToRGBX8888_sse2, convertRG16ToRGBX64_sse2,
+                  convertR16FToRGBX16F_sse2, convertR32FToRGBX32F_sse2, premultiply8888_sse2 });
+#endif
+#if defined(QT_COMPILER_SUPPORTS_AVX2) && defined(__SSE2__)
+    if (qCpuHasFeature(AVX2)) {
+        sets.append({ "avx2", convertRG8ToRGBX8888_avx2, convertRG16ToRGBX64_avx2,
+                      convertR16FToRGBX16F_sse2, convertR32FToRGBX32F_sse2, premultiply8888_avx2 });
+    }
+#endif
+    return sets;
+}
+
+int bytesPerPixel(QRhiTexture::Format format)
+{
+    switch (format) {
+    case QRhiTexture::R8:
+    case QRhiTexture::RED_OR_ALPHA8:
+        return 1;
+    case QRhiTexture::RG8:
+    case QRhiTexture::R16:
+    case QRhiTexture::R16F:
+    case QRhiTexture::D16:
+        return 2;
+    case QRhiTexture::RGBA16F:
+        return 8;
+    case QRhiTexture::RGBA32F:
+        return 16;
+    default:
+        return 4;
+    }
+}
+
+QImage::Format imageFormat(QRhiTexture::Format format)
+{
+    switch (format) {
+    case QRhiTexture::RGBA8:
+        return QImage::Format_RGBA8888;
+    case QRhiTexture::BGRA8:
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+        return QImage::Format_ARGB32;
+#else
+        return QImage::Format_RGBA8888;
+#endif
+    case QRhiTexture::R8:
+    case QRhiTexture::RED_OR_ALPHA8:
+        return QImage::Format_Grayscale8;
+    case QRhiTexture::RG8:
+        return QImage::Format_RGBX8888;
+    case QRhiTexture::R16:
+        return QImage::Format_Grayscale16;
+    case QRhiTexture::RG16:
+        return QImage::Format_RGBX64;
+    case QRhiTexture::RGBA16F:
+        return QImage::Format_RGBA16FPx4;
+    case QRhiTexture::RGBA32F:
+        return QImage::Format_RGBA32FPx4;
+    case QRhiTexture::R16F:
+        return QImage::Format_RGBX16FPx4;
+    case QRhiTexture::R32F:
+        return QImage::Format_RGBX32FPx4;
+    case QRhiTexture::RGB10A2:
+        return QImage::Format_A2BGR30_Premultiplied;
+    default:
+        return QImage::Format_Invalid;
+    }
+}
+
+static QImage::Format premultipliedImageFormat(QImage::Format format)
+{
+    switch (format) {
+    case QImage::Format_RGBA8888:
+        return QImage::Format_RGBA8888_Premultiplied;
+    case QImage::Format_ARGB32:
+        return QImage::Format_ARGB32_Premultiplied;
+    case QImage::Format_RGBA16FPx4:
+        return QImage::Format_RGBA16FPx4_Premultiplied;
+    case QImage::Format_RGBA32FPx4:
+        return QImage::Format_RGBA32FPx4_Premultiplied;
+    default:
+        return format;
+    }
+}
+
+QImage::Format imageFormat(QRhiTexture::Format format, AlphaConversion alphaConversion)
+{
+    const QImage::Format straightFormat = imageFormat(format);
+    return alphaConversion == PremultiplyAlpha ? premultipliedImageFormat(straightFormat) : straightFormat;
+}
+
+static bool isDirectFormat(QRhiTexture::Format format)
+{
+    switch (format) {
+    case QRhiTexture::RG8:
+    case QRhiTexture::RG16:
+    case QRhiTexture::R16F:
+    case QRhiTexture::R32F:
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+    case QRhiTexture::BGRA8:
+#endif
+        return false;
+    default:
+        return true;
+    }
+}
+
+// image must be allocated with the texture's size and non-premultiplied format
+static void copyTextureData(QImage *image, const uchar *data, qsizetype bytesPerLine, QRhiTexture::Format format)
+{
+    const int w = image->width();
+    const int h = image->height();
+    switch (format) {
+    case QRhiTexture::RG8:
+        for (int y = 0; y < h; ++y)
+            convertRG8ToRGBX8888(image->scanLine(y), data + y * bytesPerLine, w);
+        break;
+    case QRhiTexture::RG16:
+        for (int y = 0; y < h; ++y) {
+            convertRG16ToRGBX64(reinterpret_cast<quint16 *>(image->scanLine(y)),
+                                reinterpret_cast<const quint16 *>(data + y * bytesPerLine), w);
+        }
+        break;
+    case QRhiTexture::R16F:
+        for (int y = 0; y < h; ++y) {
+            convertR16FToRGBX16F(reinterpret_cast<quint16 *>(image->scanLine(y)),
+                                 reinterpret_cast<const quint16 *>(data + y * bytesPerLine), w);
+        }
+        break;
+    case QRhiTexture::R32F:
+        for (int y = 0; y < h; ++y) {
+            convertR32FToRGBX32F(reinterpret_cast<float *>(image->scanLine(y)),
+                                 reinterpret_cast<const float *>(data + y * bytesPerLine), w);
+        }
+        break;
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+    case QRhiTexture::BGRA8:
+        for (int y = 0; y < h; ++y)
+            convertBGRA8ToRGBA8(image->scanLine(y), data + y * bytesPerLine, w);
+        break;
+#endif
+    default: {
+        const qsizetype rowSize = qMin(bytesPerLine, image->bytesPerLine());
+        for (int y = 0; y < h; ++y)
+            memcpy(image->scanLine(y), data + y * bytesPerLine, rowSize);
+        break;
+    }
+    }
+}
+
+// image contains the texture data in the non-premultiplied format, convert
+// in place whenever possible
+static void convertAlpha(QImage *image, QImage::Format straightFormat, AlphaConversion alphaConversion)
+{
+    const QImage::Format premultipliedFormat = premultipliedImageFormat(straightFormat);
+    if (premultipliedFormat == straightFormat)
+        return;
+
+    switch (alphaConversion) {
+    case PremultiplyAlpha:
+        if (image->depth() == 32) {
+            // both RGBA and BGRA have alpha as the last byte
+            for (int y = 0, h = image->height(); y < h; ++y)
+                premultiply8888(image->scanLine(y), image->width());
+            image->reinterpretAsFormat(premultipliedFormat);
+        } else {
+            image->convertTo(premultipliedFormat);
+        }
+        break;
+    case UnpremultiplyAlpha:
+        // No kernel of our own here: an exact per-channel division has no
+        // cheap SIMD form matching qUnpremultiply(), and QImage's conversion
+        // already goes through QtGui's vectorized unpremultiply for the
+        // 8-bit formats.
+        image->reinterpretAsFormat(premultipliedFormat);
+        image->convertTo(straightFormat);
+        break;
+    default:
+        break;
+    }
+}
+
+QImage imageFromTextureData(const uchar *data, const QSize &pixelSize, qsizetype bytesPerLine,
+                            QRhiTexture::Format format, AlphaConversion alphaConversion)
+{
+    const QImage::Format straightFormat = imageFormat(format);
+    if (straightFormat == QImage::Format_Invalid)
+        return QImage();
+
+    QImage image(pixelSize, straightFormat);
+    if (image.isNull())
+        return image;
+
+    copyTextureData(&image, data, bytesPerLine, format);
+    convertAlpha(&image, straightFormat, alphaConversion);
+    return image;
+}
+
+static void releaseByteArray(void *data)
+{
+    delete static_cast<QByteArray *>(data);
+}
+
+QImage imageFromTextureData(QByteArray &&data, const QSize &pixelSize, qsizetype bytesPerLine,
+                            QRhiTexture::Format format, AlphaConversion alphaConversion)
+{
+    const QImage::Format straightFormat = imageFormat(format);
+    if (straightFormat == QImage::Format_Invalid)
+        return QImage();
+
+    // QImage wants 32-bit aligned scanlines, so only those can be adopted
+    if (!isDirectFormat(format) || bytesPerLine % 4 != 0) {
+        return imageFromTextureData(reinterpret_cast<const uchar *>(data.constData()),
+                                    pixelSize, bytesPerLine, format, alphaConversion);
+    }
+
+    // The image takes over the buffer, it gets released when the last copy
+    // of the image is destroyed. Alpha conversions then work on it in place.
+    QByteArray *buffer = new QByteArray(std::move(data));
+    QImage image(reinterpret_cast<uchar *>(buffer->data()), pixelSize.width(), pixelSize.height(),
+                 bytesPerLine, straightFormat, releaseByteArray, buffer);
+    convertAlpha(&image, straightFormat, alphaConversion);
+    return image;
+}
+
+bool convertTextureData(QImage *image, const uchar *data, const QSize &pixelSize, qsizetype bytesPerLine,
+                        QRhiTexture::Format format, AlphaConversion alphaConversion)
+{
+    const QImage::Format straightFormat = imageFormat(format);
+    if (straightFormat == QImage::Format_Invalid)
+        return false;
+
+    if (image->size() != pixelSize || image->format() != imageFormat(format, alphaConversion))
+        *image = QImage(pixelSize, straightFormat);
+    else
+        image->reinterpretAsFormat(straightFormat);
+    if (image->isNull())
+        return false;
+
+    copyTextureData(image, data, bytesPerLine, format);
+    convertAlpha(image, straightFormat, alphaConversion);
+    return true;
+}
+
+} // namespace QRhiWidgetFormats
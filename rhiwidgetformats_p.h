@@ -0,0 +1,49 @@
+#ifndef RHIWIDGETFORMATS_P_H
+#define RHIWIDGETFORMATS_P_H
+
+#include <QImage>
+#include <QList>
+#include <QtGui/private/qrhi_p.h>
+
+namespace QRhiWidgetFormats {
+
+enum AlphaConversion {
+    NoAlphaConversion,
+    PremultiplyAlpha,
+    UnpremultiplyAlpha
+};
+
+int bytesPerPixel(QRhiTexture::Format format);
+QImage::Format imageFormat(QRhiTexture::Format format);
+QImage::Format imageFormat(QRhiTexture::Format format, AlphaConversion alphaConversion);
+QImage imageFromTextureData(const uchar *data, const QSize &pixelSize, qsizetype bytesPerLine,
+                            QRhiTexture::Format format, AlphaConversion alphaConversion);
+QImage imageFromTextureData(QByteArray &&data, const QSize &pixelSize, qsizetype bytesPerLine,
+                            QRhiTexture::Format format, AlphaConversion alphaConversion);
+bool convertTextureData(QImage *image, const uchar *data, const QSize &pixelSize, qsizetype bytesPerLine,
+                        QRhiTexture::Format format, AlphaConversion alphaConversion);
+
+// the conversion kernels, exposed for benchmarking
+void convertRG8ToRGBX8888(uchar *dst, const uchar *src, qsizetype count);
+void convertRG16ToRGBX64(quint16 *dst, const quint16 *src, qsizetype count);
+void convertR16FToRGBX16F(quint16 *dst, const quint16 *src, qsizetype count);
+void convertR32FToRGBX32F(float *dst, const float *src, qsizetype count);
+void convertBGRA8ToRGBA8(uchar *dst, const uchar *src, qsizetype count);
+void premultiply8888(uchar *data, qsizetype count);
+
+// Every implementation of the kernels, for testing them against each other:
+// the scalar one first, then the SIMD ones the compiler and the CPU support.
+// A kernel without a version for some instruction set uses the next best.
+struct KernelSet {
+    const char *name;
+    void (*convertRG8ToRGBX8888)(uchar *dst, const uchar *src, qsizetype count);
+    void (*convertRG16ToRGBX64)(quint16 *dst, const quint16 *src, qsizetype count);
+    void (*convertR16FToRGBX16F)(quint16 *dst, const quint16 *src, qsizetype count);
+    void (*convertR32FToRGBX32F)(float *dst, const float *src, qsizetype count);
+    void (*premultiply8888)(uchar *data, qsizetype count);
+};
+QList<KernelSet> kernelSets();
+
+} // namespace QRhiWidgetFormats
+
+#endif
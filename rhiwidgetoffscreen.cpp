@@ -0,0 +1,230 @@
+#include "rhiwidgetoffscreen.h"
+#include "rhiwidget_p.h"
+#include <QElapsedTimer>
+#include <QPointer>
+
+struct QRhiWidgetOffscreenRendererPrivate
+{
+    QBackingStoreRhiSupport::RhiRenderResources rhiResources;
+    QRhi *rhi = nullptr;
+    QList<QPointer<QRhiWidget>> widgets; // that may hold resources from rhi
+    std::vector<QRhiReadbackResult> readbacks;
+    QRhiWidgetOffscreenRenderer::Statistics stats;
+
+    bool ensureRhi(QRhiWidgetPrivate *wd);
+    void detach(QRhiWidget *widget);
+};
+
+/*!
+    \class QRhiWidgetOffscreenRenderer
+    \inmodule QtWidgets
+    \since 6.x
+
+    \brief Renders QRhiWidget subclasses without a window, in batches, with a
+    QRhi of its own.
+
+    The widgets keep the same initialize() and render() contract as when they
+    are shown, so the same subclass can be used both in a user interface and
+    for producing images in bulk, for example from a command line tool. The
+    widgets must never be shown, and there is no need for a top-level window
+    or a windowing system; the \c offscreen platform plugin is sufficient.
+
+    Unlike grabTextureData(), which creates a QRhi per widget and waits for
+    the GPU after every image, the renderer creates a single QRhi when
+    rendering for the first time, and keeps it for its entire lifetime. Each
+    call to render() records a frame for every widget in the batch into one
+    command buffer, with a readback for each, and submits and waits only
+    once. The textures, render targets, and pipelines of the widgets are kept
+    between batches, so after the first batch only the per-frame work
+    remains. Converting or encoding the results is best done on other threads
+    while the next batch renders.
+
+    The QRhi is created with the graphics API and debug layer settings of the
+    first widget that is rendered. Widgets requesting another API are
+    skipped. Threaded rendering is not supported, each widget is rendered on
+    the thread calling render().
+
+    As rendering into the same dynamic buffer twice within one frame would
+    only keep the last update, each widget can appear only once per batch.
+    To render N variations of a scene with a batch size of B, use B widgets
+    and change their properties between the batches.
+
+    When the renderer is destroyed, or release() is called, the widgets'
+    QRhiWidget::releaseResources() is invoked, and they give up their texture
+    and render target.
+ */
+
+QRhiWidgetOffscreenRenderer::QRhiWidgetOffscreenRenderer()
+    : d(new QRhiWidgetOffscreenRendererPrivate)
+{
+}
+
+/*!
+    Destructor. Releases the resources of all widgets rendered so far, then
+    destroys the QRhi.
+ */
+QRhiWidgetOffscreenRenderer::~QRhiWidgetOffscreenRenderer()
+{
+    for (const QPointer<QRhiWidget> &widget : std::as_const(d->widgets)) {
+        if (widget)
+            d->detach(widget);
+    }
+    d->widgets.clear();
+    d->rhi = nullptr;
+    d->rhiResources.reset();
+}
+
+/*!
+    \return the QRhi, or null when nothing has been rendered yet.
+ */
+QRhi *QRhiWidgetOffscreenRenderer::rhi() const
+{
+    return d->rhi;
+}
+
+bool QRhiWidgetOffscreenRendererPrivate::ensureRhi(QRhiWidgetPrivate *wd)
+{
+    if (rhi)
+        return rhi->backend() == QBackingStoreRhiSupport::apiToRhiBackend(wd->config.api());
+
+    QBackingStoreRhiSupport rhiSupport;
+    rhiSupport.setConfig(wd->config);
+    rhiResources = rhiSupport.create();
+    rhi = rhiResources.rhi;
+    if (!rhi) {
+        qWarning("QRhiWidgetOffscreenRenderer: Failed to create QRhi");
+        return false;
+    }
+    return true;
+}
+
+void QRhiWidgetOffscreenRendererPrivate::detach(QRhiWidget *widget)
+{
+    QRhiWidgetPrivate *wd = QRhiWidgetPrivate::get(widget);
+    wd->offscreenRendererRhi = nullptr;
+    // the widget may have moved on to another QRhi since, if it was shown
+    if (wd->rhi != rhi)
+        return;
+    widget->releaseResources();
+    wd->resetRenderTarget();
+    wd->releaseTexture();
+    wd->rhi = nullptr;
+}
+
+/*!
+    Renders a frame of each of \a widgets into its texture, and reads back the
+    results into \a results, in the same order. Calls QRhiWidget::synchronize()
+    and, when needed, QRhiWidget::initialize() for each widget before starting
+    the frame, then QRhiWidget::render() for each within the same frame.
+
+    The size of the texture is the widget's explicit size, if set, and its
+    size otherwise. Widgets that could not be rendered, because they are
+    visible, use threaded rendering, request a different graphics API than
+    the one in use, or have no size, get an empty entry in \a results.
+
+    Blocks until the GPU has finished the whole batch. \return false if no
+    QRhi could be created, or the frame could not be started or submitted,
+    for example because the device was lost, true otherwise.
+ */
+bool QRhiWidgetOffscreenRenderer::render(const QList<QRhiWidget *> &widgets,
+                                         std::vector<QRhiWidget::RawTextureData> *results)
+{
+    QElapsedTimer frameTimer;
+    frameTimer.start();
+
+    results->clear();
+    results->resize(widgets.size());
+    d->readbacks.resize(widgets.size());
+
+    std::vector<bool> prepared(widgets.size(), false);
+    for (qsizetype i = 0; i < widgets.size(); ++i) {
+        QRhiWidget *widget = widgets[i];
+        QRhiWidgetPrivate *wd = QRhiWidgetPrivate::get(widget);
+        if (widget->isVisible() || wd->threaded || wd->noSize) {
+            qWarning("QRhiWidgetOffscreenRenderer: Skipping a widget that is visible, "
+                     "uses threaded rendering, or has no size");
+            continue;
+        }
+        if (!d->ensureRhi(wd)) {
+            if (!d->rhi)
+                return false;
+            qWarning("QRhiWidgetOffscreenRenderer: Skipping a widget requesting another graphics API than '%s'",
+                     d->rhi->backendName());
+            continue;
+        }
+        if (wd->offscreenRendererRhi != d->rhi) {
+            wd->offscreenRendererRhi = d->rhi;
+            d->widgets.append(widget);
+        }
+        wd->ensureRhi();
+        if (wd->rhi != d->rhi)
+            continue;
+        prepared[i] = wd->prepareOffscreenFrame();
+    }
+
+    if (!d->rhi)
+        return true; // nothing was renderable
+
+    QRhiCommandBuffer *cb = nullptr;
+    if (d->rhi->beginOffscreenFrame(&cb) != QRhi::FrameOpSuccess)
+        return false;
+    for (qsizetype i = 0; i < widgets.size(); ++i) {
+        if (!prepared[i])
+            continue;
+        QRhiWidgetPrivate *wd = QRhiWidgetPrivate::get(widgets[i]);
+        widgets[i]->render(cb);
+        // reused, a readback that does not complete must not leave the
+        // results of an earlier batch behind
+        d->readbacks[i] = QRhiReadbackResult();
+        QRhiResourceUpdateBatch *readbackBatch = d->rhi->nextResourceUpdateBatch();
+        readbackBatch->readBackTexture(wd->t, &d->readbacks[i]);
+        cb->resourceUpdate(readbackBatch);
+    }
+    if (d->rhi->endOffscreenFrame() != QRhi::FrameOpSuccess) {
+        qWarning("QRhiWidgetOffscreenRenderer: Failed to submit the frame");
+        return false;
+    }
+
+    // offscreen frames are synchronous, all readbacks have completed by now
+    for (qsizetype i = 0; i < widgets.size(); ++i) {
+        if (!prepared[i])
+            continue;
+        QRhiReadbackResult &readback(d->readbacks[i]);
+        QRhiWidget::RawTextureData &result((*results)[i]);
+        if (readback.pixelSize.isEmpty())
+            continue;
+        result.pixelSize = readback.pixelSize;
+        result.bytesPerLine = readback.data.size() / readback.pixelSize.height();
+        result.format = readback.format;
+        result.data = std::move(readback.data);
+        readback.data = QByteArray();
+        ++d->stats.imageCount;
+    }
+
+    ++d->stats.frameCount;
+    d->stats.frameNsecs += frameTimer.nsecsElapsed();
+    return true;
+}
+
+/*!
+    Releases the resources \a widget holds from the renderer's QRhi, calling
+    QRhiWidget::releaseResources(). Rendering the widget again later
+    reinitializes it. Does nothing if the widget was never rendered.
+ */
+void QRhiWidgetOffscreenRenderer::release(QRhiWidget *widget)
+{
+    const qsizetype index = d->widgets.indexOf(widget);
+    if (index < 0)
+        return;
+    d->widgets.removeAt(index);
+    d->detach(widget);
+}
+
+/*!
+    \return the number of batches and images rendered so far, and the time
+    spent in render().
+ */
+QRhiWidgetOffscreenRenderer::Statistics QRhiWidgetOffscreenRenderer::statistics() const
+{
+    return d->stats;
+}
@@ -0,0 +1,35 @@
+#ifndef RHIWIDGETOFFSCREEN_H
+#define RHIWIDGETOFFSCREEN_H
+
+#include "rhiwidget.h"
+#include <QList>
+#include <memory>
+#include <vector>
+
+struct QRhiWidgetOffscreenRendererPrivate;
+
+class QRhiWidgetOffscreenRenderer
+{
+public:
+    struct Statistics {
+        qint64 frameCount = 0;
+        qint64 imageCount = 0;
+        qint64 frameNsecs = 0; // in total, including waiting for the GPU
+    };
+
+    QRhiWidgetOffscreenRenderer();
+    ~QRhiWidgetOffscreenRenderer();
+
+    QRhi *rhi() const;
+
+    bool render(const QList<QRhiWidget *> &widgets, std::vector<QRhiWidget::RawTextureData> *results);
+    void release(QRhiWidget *widget);
+
+    Statistics statistics() const;
+
+private:
+    Q_DISABLE_COPY(QRhiWidgetOffscreenRenderer)
+    std::unique_ptr<QRhiWidgetOffscreenRendererPrivate> d;
+};
+
+#endif
@@ -0,0 +1,163 @@
+#include "rhiwidgetpipelinecache_p.h"
+
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QMutex>
+#include <QSaveFile>
+#include <QSysInfo>
+
+#if QT_CONFIG(vulkan)
+#include <QVulkanInstance>
+#include <QVulkanFunctions>
+#include <QtGui/private/qrhivulkan_p.h>
+#endif
+
+#if QT_CONFIG(opengl)
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QtGui/private/qrhigles2_p.h>
+#endif
+
+// The pipeline cache belongs to the QRhi, which is shared by all widgets in a
+// top-level window, so the cache file is tied to the QRhi as well: the first
+// widget that gets to see a QRhi with a cache file set loads the file, and
+// the contents are written back from a cleanup callback when the QRhi is
+// destroyed. The file starts with a header identifying the graphics API, the
+// device, and the driver version, so that data from another backend, GPU, or
+// driver is never fed to the QRhi.
+
+namespace QRhiWidgetPipelineCache {
+
+static const quint32 CACHE_MAGIC = 0x52575043; // 'RWPC'
+static const quint32 CACHE_VERSION = 2;
+
+typedef QHash<QRhi *, QString> CacheFileHash;
+Q_GLOBAL_STATIC(QMutex, cacheFilesMutex)
+Q_GLOBAL_STATIC(CacheFileHash, cacheFiles)
+
+// QRhiDriverInfo names the device but not the driver. Vulkan reports the
+// driver version and the UUID its pipeline caches are valid for, with OpenGL
+// the version string includes the driver's version. With the other APIs the
+// driver comes with the operating system, so its version stands in.
+static QByteArray driverIdentifier(QRhi *rhi)
+{
+    switch (rhi->backend()) {
+#if QT_CONFIG(vulkan)
+    case QRhi::Vulkan: {
+        const QRhiVulkanNativeHandles *handles = static_cast<const QRhiVulkanNativeHandles *>(rhi->nativeHandles());
+        if (!handles || !handles->inst || !handles->physDev)
+            break;
+        VkPhysicalDeviceProperties properties;
+        handles->inst->functions()->vkGetPhysicalDeviceProperties(handles->physDev, &properties);
+        return QByteArray::number(properties.driverVersion, 16) + ' '
+                + QByteArray(reinterpret_cast<const char *>(properties.pipelineCacheUUID), VK_UUID_SIZE).toHex();
+    }
+#endif
+#if QT_CONFIG(opengl)
+    case QRhi::OpenGLES2: {
+        const QRhiGles2NativeHandles *handles = static_cast<const QRhiGles2NativeHandles *>(rhi->nativeHandles());
+        if (!handles || !handles->context || !rhi->makeThreadLocalNativeContextCurrent())
+            break;
+        return QByteArray(reinterpret_cast<const char *>(handles->context->functions()->glGetString(GL_VERSION)));
+    }
+#endif
+    default:
+        break;
+    }
+    return QSysInfo::kernelVersion().toUtf8();
+}
+
+static void writeHeader(QDataStream &ds, QRhi *rhi)
+{
+    const QRhiDriverInfo info = rhi->driverInfo();
+    ds << CACHE_MAGIC << CACHE_VERSION << QByteArray(rhi->backendName())
+       << info.deviceName << quint64(info.deviceId) << quint64(info.vendorId)
+       << driverIdentifier(rhi);
+}
+
+static bool readHeader(QDataStream &ds, QRhi *rhi)
+{
+    quint32 magic = 0;
+    quint32 version = 0;
+    QByteArray backendName;
+    QByteArray deviceName;
+    quint64 deviceId = 0;
+    quint64 vendorId = 0;
+    QByteArray driver;
+    ds >> magic >> version;
+    if (ds.status() != QDataStream::Ok || magic != CACHE_MAGIC || version != CACHE_VERSION)
+        return false;
+    ds >> backendName >> deviceName >> deviceId >> vendorId >> driver;
+    const QRhiDriverInfo info = rhi->driverInfo();
+    return ds.status() == QDataStream::Ok
+            && backendName == rhi->backendName()
+            && deviceName == info.deviceName
+            && deviceId == info.deviceId
+            && vendorId == info.vendorId
+            && driver == driverIdentifier(rhi);
+}
+
+static void load(QRhi *rhi, const QString &fileName)
+{
+    QFile f(fileName);
+    if (!f.open(QIODevice::ReadOnly))
+        return;
+
+    QDataStream ds(&f);
+    if (!readHeader(ds, rhi)) {
+        qWarning("QRhiWidget: Ignoring pipeline cache file %s created for a different graphics API, device, or driver",
+                 qPrintable(fileName));
+        return;
+    }
+    QByteArray data;
+    ds >> data;
+    if (ds.status() == QDataStream::Ok && !data.isEmpty())
+        rhi->setPipelineCacheData(data);
+}
+
+static void save(QRhi *rhi, const QString &fileName)
+{
+    // empty unless the QRhi was created with QRhi::EnablePipelineCacheDataSave,
+    // do not replace a usable file with nothing in that case
+    const QByteArray data = rhi->pipelineCacheData();
+    if (data.isEmpty())
+        return;
+
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+    QSaveFile f(fileName);
+    if (!f.open(QIODevice::WriteOnly)) {
+        qWarning("QRhiWidget: Failed to open pipeline cache file %s for writing", qPrintable(fileName));
+        return;
+    }
+    QDataStream ds(&f);
+    writeHeader(ds, rhi);
+    ds << data;
+    if (ds.status() != QDataStream::Ok || !f.commit())
+        qWarning("QRhiWidget: Failed to write pipeline cache file %s", qPrintable(fileName));
+}
+
+void attach(QRhi *rhi, const QString &fileName)
+{
+    {
+        QMutexLocker lock(cacheFilesMutex());
+        if (cacheFiles()->contains(rhi))
+            return;
+        cacheFiles()->insert(rhi, fileName);
+    }
+
+    load(rhi, fileName);
+
+    rhi->addCleanupCallback([](QRhi *destroyedRhi) {
+        QString fileName;
+        {
+            QMutexLocker lock(cacheFilesMutex());
+            fileName = cacheFiles()->take(destroyedRhi);
+        }
+        save(destroyedRhi, fileName);
+    });
+}
+
+} // namespace QRhiWidgetPipelineCache
@@ -0,0 +1,13 @@
+#ifndef RHIWIDGETPIPELINECACHE_P_H
+#define RHIWIDGETPIPELINECACHE_P_H
+
+#include <QString>
+#include <QtGui/private/qrhi_p.h>
+
+namespace QRhiWidgetPipelineCache {
+
+void attach(QRhi *rhi, const QString &fileName);
+
+} // namespace QRhiWidgetPipelineCache
+
+#endif
@@ -0,0 +1,168 @@
+#include "rhiwidgetpool_p.h"
+#include "rhiwidgetformats_p.h"
+
+#include <QHash>
+#include <QMutex>
+#include <algorithm>
+
+// There is one pool per QRhi, meaning per top-level window, living as long as
+// the QRhi. Textures are owned by a single widget at a time, but the ones
+// given back (destroyed widgets, textures replaced after a resize)
+// are kept around, up to a limit, so that other widgets can pick them up
+// instead of creating new ones. Depth-stencil and multisample color buffers
+// only matter while a widget is rendering, and since all widgets render one
+// after another, each within its own offscreen frame that is complete by the
+// time the next widget starts, these can be shared between all widgets
+// requesting the same type, size, sample count and format.
+
+static const size_t MAX_FREE_TEXTURES = 4;
+
+typedef QHash<QRhi *, QRhiWidgetResourcePool *> PoolHash;
+Q_GLOBAL_STATIC(QMutex, poolsMutex)
+Q_GLOBAL_STATIC(PoolHash, pools)
+
+QRhiWidgetResourcePool::QRhiWidgetResourcePool(QRhi *rhi)
+    : rhi(rhi)
+{
+}
+
+QRhiWidgetResourcePool::~QRhiWidgetResourcePool()
+{
+    // Textures still in use are left alone, their widgets own them. The shared
+    // render buffers are only referenced, so those go away with the pool.
+    qDeleteAll(freeTextures);
+    for (const SharedRenderBuffer &rb : renderBuffers)
+        delete rb.renderBuffer;
+}
+
+QRhiWidgetResourcePool *QRhiWidgetResourcePool::forRhi(QRhi *rhi, bool create)
+{
+    QMutexLocker lock(poolsMutex());
+    QRhiWidgetResourcePool *pool = pools()->value(rhi);
+    if (!pool && create) {
+        pool = new QRhiWidgetResourcePool(rhi);
+        pools()->insert(rhi, pool);
+        rhi->addCleanupCallback([](QRhi *destroyedRhi) {
+            QMutexLocker lock(poolsMutex());
+            delete pools()->take(destroyedRhi);
+        });
+    }
+    return pool;
+}
+
+QRhiTexture *QRhiWidgetResourcePool::acquireTexture(QRhiTexture::Format format, const QSize &pixelSize)
+{
+    if (QRhiTexture *texture = takeFreeTexture(format, pixelSize))
+        return texture;
+
+    QRhiTexture *texture = rhi->newTexture(format, pixelSize, 1,
+                                           QRhiTexture::RenderTarget | QRhiTexture::UsedAsTransferSource);
+    if (!texture->create()) {
+        delete texture;
+        return nullptr;
+    }
+    textures.push_back(texture);
+    return texture;
+}
+
+// Returns a previously released texture, if there is one with a matching
+// format and size, without ever creating a new one.
+QRhiTexture *QRhiWidgetResourcePool::takeFreeTexture(QRhiTexture::Format format, const QSize &pixelSize)
+{
+    auto it = std::find_if(freeTextures.begin(), freeTextures.end(), [format, pixelSize](QRhiTexture *t) {
+        return t->format() == format && t->pixelSize() == pixelSize;
+    });
+    if (it == freeTextures.end())
+        return nullptr;
+
+    QRhiTexture *texture = *it;
+    freeTextures.erase(it);
+    textures.push_back(texture);
+    return texture;
+}
+
+void QRhiWidgetResourcePool::releaseTexture(QRhiTexture *texture)
+{
+    auto it = std::find(textures.begin(), textures.end(), texture);
+    if (it == textures.end()) {
+        delete texture;
+        return;
+    }
+    textures.erase(it);
+
+    // most recently released last, evict the oldest ones
+    freeTextures.push_back(texture);
+    if (freeTextures.size() > MAX_FREE_TEXTURES) {
+        delete freeTextures.front();
+        freeTextures.erase(freeTextures.begin());
+    }
+}
+
+QRhiRenderBuffer *QRhiWidgetResourcePool::acquireRenderBuffer(QRhiRenderBuffer::Type type, const QSize &pixelSize,
+                                                              int sampleCount, QRhiTexture::Format backingFormat)
+{
+    if (type == QRhiRenderBuffer::DepthStencil)
+        backingFormat = QRhiTexture::UnknownFormat;
+
+    for (SharedRenderBuffer &rb : renderBuffers) {
+        if (rb.renderBuffer->type() == type && rb.renderBuffer->pixelSize() == pixelSize
+                && rb.renderBuffer->sampleCount() == sampleCount && rb.backingFormat == backingFormat)
+        {
+            ++rb.refCount;
+            return rb.renderBuffer;
+        }
+    }
+
+    QRhiRenderBuffer *renderBuffer = rhi->newRenderBuffer(type, pixelSize, sampleCount, {}, backingFormat);
+    if (!renderBuffer->create()) {
+        delete renderBuffer;
+        return nullptr;
+    }
+    renderBuffers.push_back({ renderBuffer, backingFormat, 1 });
+    return renderBuffer;
+}
+
+void QRhiWidgetResourcePool::releaseRenderBuffer(QRhiRenderBuffer *renderBuffer)
+{
+    auto it = std::find_if(renderBuffers.begin(), renderBuffers.end(), [renderBuffer](const SharedRenderBuffer &rb) {
+        return rb.renderBuffer == renderBuffer;
+    });
+    if (it != renderBuffers.end() && --it->refCount == 0) {
+        delete it->renderBuffer;
+        renderBuffers.erase(it);
+    }
+}
+
+static qint64 textureByteSize(const QRhiTexture *t)
+{
+    return qint64(t->pixelSize().width()) * t->pixelSize().height()
+            * QRhiWidgetFormats::bytesPerPixel(t->format());
+}
+
+static qint64 renderBufferByteSize(const QRhiRenderBuffer *rb, QRhiTexture::Format backingFormat)
+{
+    // assume D24S8 for depth-stencil, and RGBA8 when there is no explicit format
+    const int bpp = rb->type() == QRhiRenderBuffer::DepthStencil ? 4
+            : QRhiWidgetFormats::bytesPerPixel(backingFormat == QRhiTexture::UnknownFormat ? QRhiTexture::RGBA8
+                                                                                            : backingFormat);
+    return qint64(rb->pixelSize().width()) * rb->pixelSize().height() * rb->sampleCount() * bpp;
+}
+
+QRhiWidget::ResourcePoolStatistics QRhiWidgetResourcePool::statistics() const
+{
+    QRhiWidget::ResourcePoolStatistics stats;
+    stats.textureCount = int(textures.size());
+    for (const QRhiTexture *t : textures)
+        stats.textureBytes += textureByteSize(t);
+    stats.freeTextureCount = int(freeTextures.size());
+    for (const QRhiTexture *t : freeTextures)
+        stats.freeTextureBytes += textureByteSize(t);
+    stats.renderBufferCount = int(renderBuffers.size());
+    for (const SharedRenderBuffer &rb : renderBuffers) {
+        const qint64 size = renderBufferByteSize(rb.renderBuffer, rb.backingFormat);
+        stats.renderBufferReferenceCount += rb.refCount;
+        stats.renderBufferBytes += size;
+        stats.sharedBytesSaved += size * (rb.refCount - 1);
+    }
+    return stats;
+}
@@ -0,0 +1,38 @@
+#ifndef RHIWIDGETPOOL_P_H
+#define RHIWIDGETPOOL_P_H
+
+#include "rhiwidget.h"
+#include <vector>
+
+class QRhiWidgetResourcePool
+{
+public:
+    static QRhiWidgetResourcePool *forRhi(QRhi *rhi, bool create = true);
+
+    QRhiTexture *acquireTexture(QRhiTexture::Format format, const QSize &pixelSize);
+    QRhiTexture *takeFreeTexture(QRhiTexture::Format format, const QSize &pixelSize);
+    void releaseTexture(QRhiTexture *texture);
+
+    QRhiRenderBuffer *acquireRenderBuffer(QRhiRenderBuffer::Type type, const QSize &pixelSize,
+                                          int sampleCount, QRhiTexture::Format backingFormat);
+    void releaseRenderBuffer(QRhiRenderBuffer *renderBuffer);
+
+    QRhiWidget::ResourcePoolStatistics statistics() const;
+
+private:
+    QRhiWidgetResourcePool(QRhi *rhi);
+    ~QRhiWidgetResourcePool();
+
+    struct SharedRenderBuffer {
+        QRhiRenderBuffer *renderBuffer;
+        QRhiTexture::Format backingFormat;
+        int refCount;
+    };
+
+    QRhi *rhi;
+    std::vector<QRhiTexture *> textures;
+    std::vector<QRhiTexture *> freeTextures;
+    std::vector<SharedRenderBuffer> renderBuffers;
+};
+
+#endif
@@ -0,0 +1,171 @@
+#include "rhiwidgetproducer.h"
+#include "rhiwidget.h"
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QThreadPool>
+
+// Shared with the job running on the pool, which may outlive the producer.
+struct QRhiWidgetImageProducerState
+{
+    QMutex mutex;
+    QRhiWidgetImageProducer *receiver = nullptr;
+
+    // not yet started
+    QRhiWidgetImageProducer::Function pending;
+    quint64 pendingGeneration = 0;
+    quint64 latestGeneration = 0;
+    bool running = false;
+
+    // completed, not yet taken
+    QImage ready;
+    bool hasReady = false;
+
+    qint64 produced = 0;
+    qint64 discarded = 0;
+    qint64 productionNsecs = 0;
+};
+
+static void runJobs(QSharedPointer<QRhiWidgetImageProducerState> state)
+{
+    QMutexLocker lock(&state->mutex);
+    while (state->pending) {
+        QRhiWidgetImageProducer::Function function = std::move(state->pending);
+        state->pending = nullptr;
+        const quint64 generation = state->pendingGeneration;
+        lock.unlock();
+
+        QElapsedTimer timer;
+        timer.start();
+        QImage image = function();
+        const qint64 nsecs = timer.nsecsElapsed();
+
+        lock.relock();
+        ++state->produced;
+        state->productionNsecs += nsecs;
+        if (generation != state->latestGeneration || !state->receiver) {
+            // superseded while in progress
+            ++state->discarded;
+            continue;
+        }
+        if (state->hasReady)
+            ++state->discarded; // completed, but never taken
+        state->ready = std::move(image);
+        state->hasReady = true;
+        // dropped by Qt if the producer is gone by the time it is delivered
+        QRhiWidgetImageProducer *receiver = state->receiver;
+        QMetaObject::invokeMethod(receiver, [receiver] { emit receiver->imageReady(); }, Qt::QueuedConnection);
+    }
+    state->running = false;
+}
+
+/*!
+    \class QRhiWidgetImageProducer
+    \inmodule QtWidgets
+    \since 6.x
+
+    \brief Produces CPU-side texture contents for a QRhiWidget on a worker thread.
+
+    Rasterizing with QPainter, decoding, or generating data for a texture in
+    the widget's render() blocks the GUI thread, and so input handling, for
+    the duration. Instead, pass a function producing the image to produce().
+    It is invoked on a thread from \a pool, or QThreadPool::globalInstance()
+    when null, and the widget is scheduled for an update once the image is
+    complete. render() then calls takeImage() and uploads what it got, if
+    anything.
+
+    There is at most one image being produced, one waiting to be started, and
+    one completed for each producer. Calling produce() while a function is
+    still waiting replaces it. The result of a function that was superseded
+    while it was running is discarded, as is a completed image that was not
+    taken before a newer one completed. The GUI thread never waits for a
+    function to finish, including when the producer is destroyed.
+
+    The function must not touch the widget or any other object living on the
+    GUI thread, and should capture everything it needs by value.
+ */
+QRhiWidgetImageProducer::QRhiWidgetImageProducer(QRhiWidget *widget, QThreadPool *pool)
+    : m_pool(pool ? pool : QThreadPool::globalInstance()),
+      m_state(new QRhiWidgetImageProducerState)
+{
+    m_state->receiver = this;
+    if (widget)
+        connect(this, &QRhiWidgetImageProducer::imageReady, widget, qOverload<>(&QWidget::update));
+}
+
+QRhiWidgetImageProducer::~QRhiWidgetImageProducer()
+{
+    QMutexLocker lock(&m_state->mutex);
+    m_state->receiver = nullptr;
+    m_state->pending = nullptr;
+}
+
+/*!
+    Schedules \a function to be invoked on a worker thread. The image it
+    returns supersedes all images requested earlier.
+ */
+void QRhiWidgetImageProducer::produce(Function function)
+{
+    QMutexLocker lock(&m_state->mutex);
+    m_state->pending = std::move(function);
+    m_state->pendingGeneration = ++m_state->latestGeneration;
+    if (!m_state->running) {
+        m_state->running = true;
+        QSharedPointer<QRhiWidgetImageProducerState> state = m_state;
+        m_pool->start([state] { runJobs(state); });
+    }
+}
+
+/*!
+    Moves the most recently completed image into \a image and returns true,
+    or returns false when no new image has completed since the last call.
+    Intended to be called from QRhiWidget::render().
+ */
+bool QRhiWidgetImageProducer::takeImage(QImage *image)
+{
+    QMutexLocker lock(&m_state->mutex);
+    if (!m_state->hasReady)
+        return false;
+    *image = std::move(m_state->ready);
+    m_state->ready = QImage();
+    m_state->hasReady = false;
+    return true;
+}
+
+/*!
+    Returns true while a function is running or waiting to be started.
+ */
+bool QRhiWidgetImageProducer::isBusy() const
+{
+    QMutexLocker lock(&m_state->mutex);
+    return m_state->running;
+}
+
+/*!
+    Returns the number of functions that have finished.
+ */
+qint64 QRhiWidgetImageProducer::producedImageCount() const
+{
+    QMutexLocker lock(&m_state->mutex);
+    return m_state->produced;
+}
+
+/*!
+    Returns the number of finished images that were superseded before they
+    could be taken.
+ */
+qint64 QRhiWidgetImageProducer::discardedImageCount() const
+{
+    QMutexLocker lock(&m_state->mutex);
+    return m_state->discarded;
+}
+
+/*!
+    Returns the total time, in nanoseconds, the functions that have finished
+    spent running on the worker threads, including the ones whose images were
+    discarded.
+ */
+qint64 QRhiWidgetImageProducer::productionNsecs() const
+{
+    QMutexLocker lock(&m_state->mutex);
+    return m_state->productionNsecs;
+}
@@ -0,0 +1,39 @@
+#ifndef RHIWIDGETPRODUCER_H
+#define RHIWIDGETPRODUCER_H
+
+#include <QObject>
+#include <QImage>
+#include <QSharedPointer>
+#include <functional>
+
+class QRhiWidget;
+class QThreadPool;
+struct QRhiWidgetImageProducerState;
+
+class QRhiWidgetImageProducer : public QObject
+{
+    Q_OBJECT
+
+public:
+    using Function = std::function<QImage()>;
+
+    explicit QRhiWidgetImageProducer(QRhiWidget *widget, QThreadPool *pool = nullptr);
+    ~QRhiWidgetImageProducer();
+
+    void produce(Function function);
+    bool takeImage(QImage *image);
+
+    bool isBusy() const;
+    qint64 producedImageCount() const;
+    qint64 discardedImageCount() const;
+    qint64 productionNsecs() const;
+
+Q_SIGNALS:
+    void imageReady();
+
+private:
+    QThreadPool *m_pool;
+    QSharedPointer<QRhiWidgetImageProducerState> m_state;
+};
+
+#endif
@@ -0,0 +1,187 @@
+#include "rhiwidgetrenderthread_p.h"
+#include "rhiwidget_p.h"
+
+// Renders the frames of a QRhiWidget with threaded rendering enabled, with a
+// QRhi of its own, created and destroyed on this thread.
+//
+// The thread only ever touches the widget's rendering state (the QRhi, the
+// texture, the render target) while rendering a frame, and the GUI thread
+// only does so while the thread is idle. The frame statistics have a lock of
+// their own, as the GUI thread reads them while the next frame renders. A frame
+// is requested by the GUI thread after synchronizing, and the result is
+// handed back by a queued call to the widget once the frame has completed.
+// Neither thread ever waits for the other, except when the GUI thread
+// explicitly waits for the current frame, such as for a synchronous grab.
+//
+// Where the graphics API allows two QRhi instances on two threads to submit
+// to the same device and queue, the QRhi is created on the device of the
+// window's QRhi, and the window composites the texture rendered to without
+// a copy. As the queue is shared, work the window submitted before a frame
+// was requested completes before that frame does.
+
+QRhiWidgetRenderThread::QRhiWidgetRenderThread(QRhiWidget *widget, QRhiWidgetPrivate *d,
+                                               const QPlatformBackingStoreRhiConfig &config)
+    : widget(widget),
+      d(d),
+      config(config)
+{
+}
+
+QRhiWidgetRenderThread::~QRhiWidgetRenderThread()
+{
+    {
+        QMutexLocker lock(&mutex);
+        stopRequested = true;
+        cond.wakeAll();
+    }
+    wait();
+}
+
+// Called on the GUI thread before the first frame, with the QRhi of the
+// window the widget is in. Returns true when the thread's QRhi will be
+// created on the same device, so that the window can import its textures.
+bool QRhiWidgetRenderThread::shareDevice(QRhi *windowRhi)
+{
+    QMutexLocker lock(&mutex);
+    switch (windowRhi->backend()) {
+    case QRhi::Null:
+        // no device, but textures can be imported just the same
+        sharedBackend = QRhi::Null;
+        deviceShared = true;
+        break;
+#if QT_CONFIG(metal)
+    case QRhi::Metal:
+        // devices and command queues are thread-safe
+        if (const QRhiMetalNativeHandles *handles = static_cast<const QRhiMetalNativeHandles *>(windowRhi->nativeHandles())) {
+            metalHandles.dev = handles->dev;
+            metalHandles.cmdQueue = handles->cmdQueue;
+            sharedBackend = QRhi::Metal;
+            deviceShared = true;
+        }
+        break;
+#endif
+    default:
+        // The window's Vulkan device has a single queue, and a Direct 3D 11
+        // device a single immediate context. Neither may be used from two
+        // threads without synchronization that QRhi does not do.
+        deviceShared = false;
+        break;
+    }
+    return deviceShared;
+}
+
+// True when a new frame can be requested: the thread is idle and the
+// previous frame has been taken.
+bool QRhiWidgetRenderThread::isReady()
+{
+    QMutexLocker lock(&mutex);
+    return !frameRequested && !rendering && completedFrames.empty();
+}
+
+// Waits until the thread is idle. Frames completed meanwhile are left for
+// takeFrames().
+void QRhiWidgetRenderThread::waitForIdle()
+{
+    QMutexLocker lock(&mutex);
+    while (frameRequested || rendering)
+        cond.wait(&mutex);
+}
+
+void QRhiWidgetRenderThread::requestFrame(quint64 sequence, bool readBack)
+{
+    QMutexLocker lock(&mutex);
+    frameRequested = true;
+    requestedSequence = sequence;
+    requestedReadBack = readBack;
+    cond.wakeAll();
+}
+
+// Replaces the contents of frames with all completed frames, oldest first.
+bool QRhiWidgetRenderThread::takeFrames(std::vector<QRhiWidgetThreadedFrame> *frames)
+{
+    frames->clear();
+    QMutexLocker lock(&mutex);
+    if (completedFrames.empty())
+        return false;
+    std::swap(*frames, completedFrames);
+    return true;
+}
+
+void QRhiWidgetRenderThread::run()
+{
+    QBackingStoreRhiSupport::RhiRenderResources resources;
+    QScopedPointer<QRhi> importedDeviceRhi;
+    bool rhiCreated = false;
+
+    QMutexLocker lock(&mutex);
+    for (;;) {
+        while (!frameRequested && !stopRequested)
+            cond.wait(&mutex);
+        if (stopRequested)
+            break;
+        frameRequested = false;
+        rendering = true;
+        QRhiWidgetThreadedFrame result;
+        result.sequence = requestedSequence;
+        result.readBack = requestedReadBack;
+        const bool shareDeviceRequested = deviceShared;
+        lock.unlock();
+
+        if (!rhiCreated) {
+            // no window, so no swapchain, but a functional QRhi owned by this thread
+#if QT_CONFIG(metal)
+            if (shareDeviceRequested && sharedBackend == QRhi::Metal) {
+                QRhiMetalInitParams params;
+                importedDeviceRhi.reset(QRhi::create(QRhi::Metal, &params, {}, &metalHandles));
+                if (!importedDeviceRhi)
+                    qWarning("QRhiWidget: Failed to create QRhi on the window's device, the contents will be copied");
+                d->rhi = importedDeviceRhi.data();
+            }
+#endif
+            if (!d->rhi) {
+                QBackingStoreRhiSupport rhiSupport;
+                rhiSupport.setConfig(config);
+                resources = rhiSupport.create();
+                if (!resources.rhi)
+                    qWarning("QRhiWidget: Failed to create QRhi for the render thread");
+                d->rhi = resources.rhi;
+            }
+            d->textureShared = shareDeviceRequested && d->rhi
+                    && (d->rhi == importedDeviceRhi.data() || d->rhi->backend() == QRhi::Null);
+            rhiCreated = true;
+        }
+        result.sharesTexture = d->textureShared;
+
+        if (d->rhi)
+            d->renderThreadFrame(&result);
+
+        lock.relock();
+        completedFrames.push_back(std::move(result));
+        rendering = false;
+        cond.wakeAll();
+        QRhiWidgetPrivate *dd = d;
+        QMetaObject::invokeMethod(widget, [dd] { dd->threadedFrameCompleted(); }, Qt::QueuedConnection);
+    }
+    lock.unlock();
+
+    // everything created with the QRhi goes away before it, on the thread
+    // that created it
+    if (d->rhi) {
+        if (d->textureShared) {
+            // the window has let go of the texture, but may still have
+            // work using it on the shared queue, which an empty frame
+            // waits for
+            QRhiCommandBuffer *cb = nullptr;
+            if (d->rhi->beginOffscreenFrame(&cb) == QRhi::FrameOpSuccess)
+                d->rhi->endOffscreenFrame();
+        }
+        widget->releaseResources();
+        d->resetRenderTarget();
+        d->releaseTexture();
+        d->releaseRetiredTextures(&d->retiredTextures);
+    }
+    d->rhi = nullptr;
+    d->textureShared = false;
+    resources.reset();
+    importedDeviceRhi.reset();
+}
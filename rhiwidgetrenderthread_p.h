@@ -0,0 +1,69 @@
+#ifndef RHIWIDGETRENDERTHREAD_P_H
+#define RHIWIDGETRENDERTHREAD_P_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QtGui/private/qrhi_p.h>
+#include <qpa/qplatformbackingstore.h>
+#include <vector>
+
+#if QT_CONFIG(metal)
+#include <QtGui/private/qrhimetal_p.h>
+#endif
+
+class QRhiWidget;
+class QRhiWidgetPrivate;
+
+// The outcome of a frame rendered on the render thread, handed back to the
+// GUI thread.
+struct QRhiWidgetThreadedFrame
+{
+    quint64 sequence = 0;
+    bool readBack = true;
+    bool rendered = false;
+    QRhiReadbackResult readback;
+    // the texture rendered to, when the window can composite it directly
+    bool sharesTexture = false;
+    QRhiTexture::NativeTexture texture = {};
+    QRhiTexture::Format format = QRhiTexture::UnknownFormat;
+    QSize pixelSize;
+    qint64 frameNsecs = 0;
+    qint64 droppedCaptureFrame = -1;
+};
+
+class QRhiWidgetRenderThread : public QThread
+{
+public:
+    QRhiWidgetRenderThread(QRhiWidget *widget, QRhiWidgetPrivate *d, const QPlatformBackingStoreRhiConfig &config);
+    ~QRhiWidgetRenderThread();
+
+    bool shareDevice(QRhi *windowRhi);
+    bool isReady();
+    void waitForIdle();
+    void requestFrame(quint64 sequence, bool readBack);
+    bool takeFrames(std::vector<QRhiWidgetThreadedFrame> *frames);
+
+protected:
+    void run() override;
+
+private:
+    QRhiWidget *widget;
+    QRhiWidgetPrivate *d;
+    QPlatformBackingStoreRhiConfig config;
+    QMutex mutex;
+    QWaitCondition cond;
+    bool frameRequested = false;
+    quint64 requestedSequence = 0;
+    bool requestedReadBack = true;
+    bool rendering = false;
+    bool stopRequested = false;
+    std::vector<QRhiWidgetThreadedFrame> completedFrames; // oldest first
+    QRhi::Implementation sharedBackend = QRhi::Null;
+    bool deviceShared = false;
+#if QT_CONFIG(metal)
+    QRhiMetalNativeHandles metalHandles;
+#endif
+};
+
+#endif
@@ -0,0 +1,96 @@
+#include "rhiwidgetresolution_p.h"
+
+#include <QtMath>
+
+// Adjusts the resolution scale of a QRhiWidget from the measured frame times,
+// aiming for frames that take a bit less than the target.
+//
+// The cost of a frame is assumed to be proportional to the number of pixels,
+// meaning the square of the scale. Going down happens as soon as the frames
+// are over the target, straight to the scale that is expected to fit. Going
+// up happens one step at a time, after a longer period, and only when the
+// frames are expected to stay under the target at the higher scale as well.
+// Together with the scale being quantized, this keeps the resolution from
+// going back and forth between two sizes, and the texture from being
+// reallocated all the time.
+
+// the scale changes in steps of 1/20
+static const qreal SCALE_STEP = 0.05;
+// frames right after a change include reallocating the texture
+static const int SETTLE_FRAMES = 2;
+static const int DOWN_FRAMES = 10;
+static const int UP_FRAMES = 30;
+// aim for frames taking this fraction of the target
+static const qreal HEADROOM = 0.85;
+
+static qreal quantizeDown(qreal scale)
+{
+    return qFloor(scale / SCALE_STEP + 0.001) * SCALE_STEP;
+}
+
+void QRhiWidgetResolutionController::setTargetFrameTime(qint64 nsecs)
+{
+    target = qMax<qint64>(0, nsecs);
+    reset();
+}
+
+void QRhiWidgetResolutionController::setRange(qreal minimumScale, qreal maximumScale)
+{
+    minimum = qMin(minimumScale, maximumScale);
+    maximum = maximumScale;
+    current = qBound(minimum, current, maximum);
+    sum = 0;
+    count = 0;
+}
+
+// Starts over at the maximum scale.
+void QRhiWidgetResolutionController::reset()
+{
+    current = maximum;
+    framesSinceChange = 0;
+    sum = 0;
+    count = 0;
+}
+
+bool QRhiWidgetResolutionController::changeScale(qreal newScale)
+{
+    newScale = qBound(minimum, newScale, maximum);
+    framesSinceChange = 0;
+    sum = 0;
+    count = 0;
+    if (qFuzzyCompare(newScale, current))
+        return false;
+    current = newScale;
+    return true;
+}
+
+// Returns true when the scale changed.
+bool QRhiWidgetResolutionController::addFrame(qint64 nsecs)
+{
+    if (!isEnabled())
+        return false;
+
+    if (++framesSinceChange <= SETTLE_FRAMES)
+        return false;
+
+    sum += nsecs;
+    ++count;
+    const qreal average = sum / qreal(count);
+
+    if (count >= DOWN_FRAMES && average > target && current > minimum) {
+        // at least one step down, the expected cost is never exact
+        const qreal fit = current * qSqrt(HEADROOM * target / average);
+        return changeScale(qMin(quantizeDown(fit), current - SCALE_STEP));
+    }
+
+    if (count >= UP_FRAMES) {
+        const qreal next = qMin(current + SCALE_STEP, maximum);
+        const qreal ratio = next / current;
+        if (next > current && average * ratio * ratio < HEADROOM * target)
+            return changeScale(next);
+        // keep measuring with fresh samples
+        sum = 0;
+        count = 0;
+    }
+    return false;
+}
@@ -0,0 +1,29 @@
+#ifndef RHIWIDGETRESOLUTION_P_H
+#define RHIWIDGETRESOLUTION_P_H
+
+#include <QtGlobal>
+
+class QRhiWidgetResolutionController
+{
+public:
+    bool isEnabled() const { return target > 0; }
+    void setTargetFrameTime(qint64 nsecs);
+    void setRange(qreal minimumScale, qreal maximumScale);
+
+    qreal scale() const { return current; }
+    bool addFrame(qint64 nsecs);
+    void reset();
+
+private:
+    bool changeScale(qreal newScale);
+
+    qint64 target = 0;
+    qreal minimum = 0.5;
+    qreal maximum = 1;
+    qreal current = 1;
+    int framesSinceChange = 0;
+    qint64 sum = 0;
+    int count = 0;
+};
+
+#endif
@@ -0,0 +1,211 @@
+#include "rhiwidgetscheduler_p.h"
+#include "rhiwidget_p.h"
+
+#include <QBasicTimer>
+#include <QElapsedTimer>
+#include <QMetaObject>
+#include <QTimerEvent>
+
+// There is one scheduler per top-level window, living as a child object of
+// the window. It drives the widgets that are not updated on demand with a
+// single timer, so that all of them get their update() in the same tick,
+// which the widget repaint manager then turns into a single repaint of the
+// window. With batched rendering it renders the batch when the window is
+// about to repaint, and remembers which widgets that has rendered already.
+
+// a QStringLiteral, as the lookup happens in every frame and must not allocate
+#define SCHEDULER_OBJECT_NAME QStringLiteral("_q_rhiwidget_scheduler")
+
+namespace {
+
+class SystemClock : public QObject, public QRhiWidgetSchedulerClock
+{
+public:
+    SystemClock(QRhiWidgetScheduler *scheduler)
+        : scheduler(scheduler)
+    {
+        clock.start();
+    }
+
+    qint64 nsecsElapsed() const override
+    {
+        return clock.nsecsElapsed();
+    }
+
+    void setTickInterval(qint64 intervalNsecs) override
+    {
+        if (intervalNsecs > 0)
+            timer.start(qMax(1, int(intervalNsecs / 1000000)), Qt::PreciseTimer, this);
+        else
+            timer.stop();
+    }
+
+protected:
+    void timerEvent(QTimerEvent *e) override
+    {
+        if (e->timerId() == timer.timerId())
+            scheduler->tick();
+        else
+            QObject::timerEvent(e);
+    }
+
+private:
+    QRhiWidgetScheduler *scheduler;
+    QElapsedTimer clock;
+    QBasicTimer timer;
+};
+
+} // namespace
+
+QRhiWidgetScheduler::QRhiWidgetScheduler(QWidget *window)
+    : QObject(window),
+      clock(new SystemClock(this))
+{
+    setObjectName(SCHEDULER_OBJECT_NAME);
+}
+
+void QRhiWidgetScheduler::setClock(std::unique_ptr<QRhiWidgetSchedulerClock> newClock)
+{
+    clock->setTickInterval(0);
+    clock = std::move(newClock);
+    restartTimer();
+}
+
+QRhiWidgetScheduler *QRhiWidgetScheduler::forWindow(QWidget *window, bool create)
+{
+    QRhiWidgetScheduler *scheduler = static_cast<QRhiWidgetScheduler *>(
+                window->findChild<QObject *>(SCHEDULER_OBJECT_NAME, Qt::FindDirectChildrenOnly));
+    if (!scheduler && create)
+        scheduler = new QRhiWidgetScheduler(window);
+    return scheduler;
+}
+
+void QRhiWidgetScheduler::setWidget(QRhiWidget *widget, qint64 intervalNsecs)
+{
+    for (Entry &e : entries) {
+        if (e.widget == widget) {
+            e.interval = intervalNsecs;
+            restartTimer();
+            return;
+        }
+    }
+    entries.append({ widget, intervalNsecs, clock->nsecsElapsed(), 0 });
+    restartTimer();
+}
+
+void QRhiWidgetScheduler::removeWidget(QRhiWidget *widget)
+{
+    entries.removeIf([widget](const Entry &e) { return e.widget == widget; });
+    restartTimer();
+}
+
+void QRhiWidgetScheduler::reportFrameCost(QRhiWidget *widget, qint64 nsecs)
+{
+    for (Entry &e : entries) {
+        if (e.widget == widget) {
+            e.lastCost = nsecs;
+            return;
+        }
+    }
+}
+
+void QRhiWidgetScheduler::restartTimer()
+{
+    if (entries.isEmpty()) {
+        clock->setTickInterval(0);
+        return;
+    }
+    qint64 interval = entries.first().interval;
+    for (const Entry &e : entries)
+        interval = qMin(interval, e.interval);
+    clock->setTickInterval(interval);
+}
+
+void QRhiWidgetScheduler::tick()
+{
+    const qint64 now = clock->nsecsElapsed();
+    // a millisecond of slack since the timer is not precise to the nanosecond
+    const qint64 due = now + 1000000;
+    const int count = entries.count();
+    qint64 spent = 0;
+    int deferred = -1;
+
+    // Go round-robin, starting with the first widget that was deferred in the
+    // previous tick due to the budget running out, so that all widgets get
+    // their turn eventually.
+    for (int n = 0; n < count; ++n) {
+        const int i = (firstEntry + n) % count;
+        Entry &e(entries[i]);
+        if (e.nextDue > due)
+            continue;
+
+        // invisible or fully obscured widgets are not worth rendering
+        if (!e.widget->isVisible() || e.widget->visibleRegion().isEmpty()) {
+            e.nextDue = now + e.interval;
+            continue;
+        }
+
+        if (budget > 0 && spent > 0 && spent + e.lastCost > budget) {
+            if (deferred < 0)
+                deferred = i;
+            continue;
+        }
+
+        spent += e.lastCost;
+        e.widget->update();
+        e.nextDue += e.interval;
+        if (e.nextDue < now) // fell behind, do not try to catch up
+            e.nextDue = now + e.interval;
+    }
+
+    firstEntry = deferred >= 0 ? deferred : 0;
+}
+
+void QRhiWidgetScheduler::setBatchedRendering(bool enable)
+{
+    if (batched == enable)
+        return;
+    batched = enable;
+    if (enable)
+        parent()->installEventFilter(this);
+    else
+        parent()->removeEventFilter(this);
+}
+
+// The window processes UpdateRequest by repainting, both for update() and
+// for repaint(), so this is right before the widgets get their paint events.
+bool QRhiWidgetScheduler::eventFilter(QObject *watched, QEvent *e)
+{
+    if (batched && watched == parent() && e->type() == QEvent::UpdateRequest) {
+        // anything left over from an earlier repaint is stale by now
+        renderedBatch.clear();
+        QRhiWidgetPrivate::renderBatch(static_cast<QWidget *>(watched), this);
+    }
+    return QObject::eventFilter(watched, e);
+}
+
+void QRhiWidgetScheduler::markBatchRendered(const QList<QRhiWidget *> &widgets)
+{
+    for (QRhiWidget *widget : widgets)
+        renderedBatch.append(widget);
+    if (renderedBatch.isEmpty() || renderedBatchClearPending)
+        return;
+    // The widgets of the batch normally get their paint event in the same
+    // repaint, and are taken out one by one. Anything left over was not
+    // painted, and must not be skipped when painted some time later, for
+    // example on an expose, which does not go through UpdateRequest.
+    renderedBatchClearPending = true;
+    QMetaObject::invokeMethod(this, [this] {
+        renderedBatchClearPending = false;
+        renderedBatch.clear();
+    }, Qt::QueuedConnection);
+}
+
+bool QRhiWidgetScheduler::takeFromRenderedBatch(QRhiWidget *widget)
+{
+    const qsizetype index = renderedBatch.indexOf(widget);
+    if (index < 0)
+        return false;
+    renderedBatch.removeAt(index);
+    return true;
+}
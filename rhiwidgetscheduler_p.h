@@ -0,0 +1,66 @@
+#ifndef RHIWIDGETSCHEDULER_P_H
+#define RHIWIDGETSCHEDULER_P_H
+
+#include <QObject>
+#include <QList>
+#include <QPointer>
+#include <memory>
+
+class QRhiWidget;
+
+// The time source of a scheduler, replaceable for testing.
+class QRhiWidgetSchedulerClock
+{
+public:
+    virtual ~QRhiWidgetSchedulerClock() = default;
+    virtual qint64 nsecsElapsed() const = 0;
+    // from now on, the scheduler's tick() is to be called every
+    // intervalNsecs, or not at all when 0
+    virtual void setTickInterval(qint64 intervalNsecs) = 0;
+};
+
+class QRhiWidgetScheduler : public QObject
+{
+public:
+    static QRhiWidgetScheduler *forWindow(QWidget *window, bool create = true);
+
+    void setWidget(QRhiWidget *widget, qint64 intervalNsecs);
+    void removeWidget(QRhiWidget *widget);
+    void reportFrameCost(QRhiWidget *widget, qint64 nsecs);
+
+    qint64 frameBudget() const { return budget; }
+    void setFrameBudget(qint64 nsecs) { budget = nsecs; }
+
+    bool isBatchedRenderingEnabled() const { return batched; }
+    void setBatchedRendering(bool enable);
+    void markBatchRendered(const QList<QRhiWidget *> &widgets);
+    bool takeFromRenderedBatch(QRhiWidget *widget);
+
+    // for testing, to be set before any widget is added
+    void setClock(std::unique_ptr<QRhiWidgetSchedulerClock> newClock);
+    void tick();
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *e) override;
+
+private:
+    QRhiWidgetScheduler(QWidget *window);
+    void restartTimer();
+
+    struct Entry {
+        QRhiWidget *widget;
+        qint64 interval;
+        qint64 nextDue;
+        qint64 lastCost;
+    };
+    QList<Entry> entries;
+    std::unique_ptr<QRhiWidgetSchedulerClock> clock;
+    qint64 budget = 0;
+    int firstEntry = 0;
+    bool batched = false;
+    // rendered by the batch of another widget, not yet painted themselves
+    QList<QPointer<QRhiWidget>> renderedBatch;
+    bool renderedBatchClearPending = false;
+};
+
+#endif
@@ -0,0 +1,183 @@
+#include <QApplication>
+#include <QAtomicInt>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QSemaphore>
+#include <QThreadPool>
+#include <cstdio>
+#include "examplewidget.h"
+#include "rhiwidgetoffscreen.h"
+#include "rhiwidgetformats_p.h"
+
+// Renders a parameter sweep of the example scene to PNG files, without any
+// window, and reports the throughput. The cube's rotation goes around once
+// over all images, while the text and the number of instances cycle through
+// the given values. The widgets are never shown, QRhiWidgetOffscreenRenderer
+// renders a batch of them per frame on its own QRhi, while the images of the
+// previous batches are converted and encoded on the thread pool.
+
+static bool apiFromString(const QString &s, QRhiWidget::Api *api)
+{
+    if (s == QLatin1String("null"))
+        *api = QRhiWidget::Null;
+    else if (s == QLatin1String("opengl"))
+        *api = QRhiWidget::OpenGL;
+    else if (s == QLatin1String("vulkan"))
+        *api = QRhiWidget::Vulkan;
+    else if (s == QLatin1String("d3d11"))
+        *api = QRhiWidget::D3D11;
+    else if (s == QLatin1String("metal"))
+        *api = QRhiWidget::Metal;
+    else
+        return false;
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QLatin1String("Renders a parameter sweep of the example scene to PNG files"));
+    parser.addHelpOption();
+    QCommandLineOption backendOption(QLatin1String("backend"),
+                                     QLatin1String("Graphics API: null, opengl, vulkan, d3d11, metal."),
+                                     QLatin1String("api"), QLatin1String("opengl"));
+    parser.addOption(backendOption);
+    QCommandLineOption countOption(QLatin1String("count"),
+                                   QLatin1String("Number of images."),
+                                   QLatin1String("count"), QLatin1String("360"));
+    parser.addOption(countOption);
+    QCommandLineOption batchOption(QLatin1String("batch"),
+                                   QLatin1String("Images rendered per frame."),
+                                   QLatin1String("count"), QLatin1String("8"));
+    parser.addOption(batchOption);
+    QCommandLineOption sizeOption(QLatin1String("size"),
+                                  QLatin1String("Width and height of the images in pixels."),
+                                  QLatin1String("pixels"), QLatin1String("512"));
+    parser.addOption(sizeOption);
+    QCommandLineOption textOption(QLatin1String("text"),
+                                  QLatin1String("Text on the cube, %1 is replaced with the image number. Can be given multiple times."),
+                                  QLatin1String("text"));
+    parser.addOption(textOption);
+    QCommandLineOption instancesOption(QLatin1String("instances"),
+                                       QLatin1String("Number of cubes. Can be given multiple times."),
+                                       QLatin1String("count"));
+    parser.addOption(instancesOption);
+    QCommandLineOption outputOption(QLatin1String("output"),
+                                    QLatin1String("Directory for the images. Nothing is written when not set."),
+                                    QLatin1String("dir"));
+    parser.addOption(outputOption);
+    parser.process(app);
+
+    QRhiWidget::Api api;
+    if (!apiFromString(parser.value(backendOption), &api)) {
+        qWarning("Unknown backend '%s'", qPrintable(parser.value(backendOption)));
+        return 1;
+    }
+    const int count = qMax(1, parser.value(countOption).toInt());
+    const int batchSize = qBound(1, parser.value(batchOption).toInt(), count);
+    const int size = qMax(1, parser.value(sizeOption).toInt());
+    QStringList texts = parser.values(textOption);
+    if (texts.isEmpty())
+        texts.append(QLatin1String("Image %1"));
+    QList<int> instanceCounts;
+    for (const QString &s : parser.values(instancesOption))
+        instanceCounts.append(qMax(1, s.toInt()));
+    if (instanceCounts.isEmpty())
+        instanceCounts.append(1);
+
+    QString outputDir;
+    if (parser.isSet(outputOption)) {
+        outputDir = parser.value(outputOption);
+        if (!QDir().mkpath(outputDir)) {
+            qWarning("Failed to create %s", qPrintable(outputDir));
+            return 1;
+        }
+    }
+
+    std::vector<std::unique_ptr<ExampleRhiWidget>> widgets;
+    QList<QRhiWidget *> batch;
+    for (int i = 0; i < batchSize; ++i) {
+        ExampleRhiWidget *w = new ExampleRhiWidget;
+        w->setApi(api);
+        w->setPipelineCacheFile(QString());
+        w->setExplicitSize(QSize(size, size));
+        widgets.emplace_back(w);
+    }
+
+    // Every batch in flight keeps its images in memory until encoded, bound
+    // the number of those so that rendering cannot run arbitrarily far ahead.
+    QThreadPool *pool = QThreadPool::globalInstance();
+    QSemaphore encodeSlots(qMax(2, pool->maxThreadCount()) * batchSize);
+    QAtomicInt failedCount;
+
+    QRhiWidgetOffscreenRenderer renderer;
+    std::vector<QRhiWidget::RawTextureData> results;
+    QElapsedTimer timer;
+    timer.start();
+
+    for (int first = 0; first < count; first += batchSize) {
+        const int n = qMin(batchSize, count - first);
+        batch.clear();
+        for (int i = 0; i < n; ++i) {
+            const int index = first + i;
+            ExampleRhiWidget *w = widgets[i].get();
+            w->setCubeRotation(360.0f * index / count);
+            w->setCubeTextureText(texts[index % texts.size()].arg(index));
+            w->setInstanceCount(instanceCounts[index % instanceCounts.size()]);
+            batch.append(w);
+        }
+
+        if (!renderer.render(batch, &results)) {
+            qWarning("Rendering failed");
+            pool->waitForDone();
+            return 1;
+        }
+
+        const bool mirror = renderer.rhi() && renderer.rhi()->isYUpInFramebuffer();
+        for (int i = 0; i < n; ++i) {
+            QRhiWidget::RawTextureData &data(results[i]);
+            if (data.data.isEmpty()) {
+                failedCount.fetchAndAddRelaxed(1);
+                continue;
+            }
+            if (outputDir.isEmpty())
+                continue;
+            const QString fileName = QDir(outputDir).filePath(QString::asprintf("image%05d.png", first + i));
+            encodeSlots.acquire();
+            pool->start([data = std::move(data), fileName, mirror, &encodeSlots, &failedCount]() mutable {
+                QImage image = QRhiWidgetFormats::imageFromTextureData(std::move(data.data), data.pixelSize,
+                                                                       data.bytesPerLine, data.format,
+                                                                       QRhiWidgetFormats::NoAlphaConversion);
+                if (mirror)
+                    image.mirror();
+                if (image.isNull() || !image.save(fileName))
+                    failedCount.fetchAndAddRelaxed(1);
+                encodeSlots.release();
+            });
+        }
+    }
+
+    pool->waitForDone();
+    const qint64 totalNsecs = timer.nsecsElapsed();
+
+    if (!renderer.rhi())
+        return 2; // warned about already, for every widget
+
+    // only the time spent in render(), not the time waiting for a free
+    // encoding slot, which would make the rendering rate follow the encoding
+    const QRhiWidgetOffscreenRenderer::Statistics stats = renderer.statistics();
+    const qint64 renderNsecs = stats.frameNsecs;
+    std::printf("%d images of %dx%d, %lld frames with %s: %.1f images/sec rendered, %.1f images/sec including encoding\n",
+                count, size, size, stats.frameCount, renderer.rhi()->backendName(),
+                count / (renderNsecs / 1e9), count / (totalNsecs / 1e9));
+    if (failedCount.loadRelaxed()) {
+        qWarning("%d images failed", failedCount.loadRelaxed());
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,14 @@
+#version 440
+
+layout(location = 0) in vec2 v_texcoord;
+
+layout(location = 0) out vec4 fragColor;
+
+layout(binding = 0) uniform sampler2D glyphs;
+
+void main()
+{
+    // black text, premultiplied
+    float a = texture(glyphs, v_texcoord).r;
+    fragColor = vec4(0.0, 0.0, 0.0, a);
+}
@@ -2,6 +2,8 @@
 
 layout(location = 0) in vec4 position;
 layout(location = 1) in vec2 texcoord;
+layout(location = 2) in vec4 instTranslationScale;
+layout(location = 3) in vec4 instRotation;
 
 layout(location = 0) out vec2 v_texcoord;
 
@@ -10,10 +12,16 @@ layout(std140, binding = 0) uniform buf {
     int flip;
 };
 
+vec3 rotate(vec4 q, vec3 v)
+{
+    return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
 void main()
 {
     v_texcoord = vec2(texcoord.x, texcoord.y);
     if (flip != 0)
         v_texcoord.y = 1.0 - v_texcoord.y;
-    gl_Position = mvp * position;
+    vec3 p = rotate(instRotation, position.xyz * instTranslationScale.w) + instTranslationScale.xyz;
+    gl_Position = mvp * vec4(p, 1.0);
 }
@@ -0,0 +1,205 @@
+#include <QTest>
+#include <QPaintEvent>
+#include <QSemaphore>
+#include <QThread>
+#include "rhiwidget.h"
+
+// Runs headless, with the offscreen platform plugin and the Null backend.
+// That platform plugin may not composite QRhiWidgets at all, in which case
+// shown widgets have no QRhi of the window to render with. Tests needing
+// frames from paint events then render with the widget's dedicated QRhi, or
+// skip when there are no paint events to render in.
+
+class TestWidget : public QRhiWidget
+{
+public:
+    TestWidget()
+    {
+        setApi(QRhiWidget::Null);
+        setAutoRenderTarget(true);
+        resize(64, 48);
+    }
+
+    void initialize(QRhi *, QRhiTexture *) override
+    {
+        ++initializeCount;
+    }
+
+    void render(QRhiCommandBuffer *cb) override
+    {
+        ++renderCount;
+        cb->beginPass(renderTarget(), Qt::green, { 1.0f, 0 });
+        cb->endPass();
+    }
+
+    void paintFrame()
+    {
+        QPaintEvent e(rect());
+        paintEvent(&e);
+    }
+
+    int initializeCount = 0;
+    int renderCount = 0;
+};
+
+// Renders on the render thread, render() can be held up until released.
+class ThreadedTestWidget : public TestWidget
+{
+public:
+    ThreadedTestWidget()
+    {
+        setThreadedRendering(true);
+    }
+
+    ~ThreadedTestWidget()
+    {
+        stopRenderThread();
+    }
+
+    void synchronize() override
+    {
+        synchronizeThread = QThread::currentThread();
+        ++synchronizeCount;
+    }
+
+    void render(QRhiCommandBuffer *cb) override
+    {
+        renderThread = QThread::currentThread();
+        if (blockRender)
+            renderGate.acquire();
+        TestWidget::render(cb);
+    }
+
+    QThread *synchronizeThread = nullptr;
+    int synchronizeCount = 0;
+    // written on the render thread, read once it is idle
+    QThread *renderThread = nullptr;
+    bool blockRender = false;
+    QSemaphore renderGate;
+};
+
+class tst_QRhiWidget : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void grabHidden();
+    void grabAsyncHidden();
+    void grabAsyncRendersNoExtraFrame();
+    void grabAsyncResolvedWhenPaintCannotRender();
+    void threadedGrab();
+    void threadedPaintDoesNotWait();
+};
+
+void tst_QRhiWidget::grabHidden()
+{
+    TestWidget widget;
+    widget.setExplicitSize(QSize(32, 16));
+    const QImage image = widget.grabTexture();
+    QVERIFY(!image.isNull());
+    QCOMPARE(image.size(), QSize(32, 16));
+    QCOMPARE(widget.initializeCount, 1);
+    QCOMPARE(widget.renderCount, 1);
+}
+
+void tst_QRhiWidget::grabAsyncHidden()
+{
+    // nothing to piggyback on, the future is ready on return
+    TestWidget widget;
+    widget.setExplicitSize(QSize(32, 16));
+    QFuture<QImage> future = widget.grabTextureAsync();
+    QVERIFY(future.isFinished());
+    QCOMPARE(future.result().size(), QSize(32, 16));
+    QCOMPARE(widget.renderCount, 1);
+}
+
+void tst_QRhiWidget::grabAsyncRendersNoExtraFrame()
+{
+    TestWidget widget;
+    widget.show();
+    QVERIFY(QTest::qWaitForWindowExposed(&widget));
+    QCoreApplication::processEvents();
+
+    // Without composition the window has no QRhi. A synchronous grab gives
+    // the widget a dedicated one, which its paint events then render with.
+    if (widget.grabTexture().isNull())
+        QSKIP("No QRhi could be created");
+    const int rendersBeforeUpdate = widget.renderCount;
+    widget.update();
+    if (!QTest::qWaitFor([&] { return widget.renderCount > rendersBeforeUpdate; }, 1000))
+        QSKIP("The widget does not get painted on this platform");
+    QCoreApplication::processEvents();
+    const int rendersBefore = widget.renderCount;
+
+    // two requests before the next paint, neither renders nor waits for a
+    // frame by itself
+    QFuture<QImage> first = widget.grabTextureAsync();
+    QFuture<QImage> second = widget.grabTextureAsync();
+    QCOMPARE(widget.renderCount, rendersBefore);
+    QVERIFY(!first.isFinished());
+    QVERIFY(!second.isFinished());
+
+    // both are served by the one frame of the next paint
+    QTRY_VERIFY(first.isFinished() && second.isFinished());
+    QCOMPARE(widget.renderCount, rendersBefore + 1);
+    const QImage image = first.result();
+    QVERIFY(!image.isNull());
+    QCOMPARE(image.size(), QSize(64, 48) * widget.devicePixelRatio());
+    QCOMPARE(second.result().size(), image.size());
+}
+
+void tst_QRhiWidget::grabAsyncResolvedWhenPaintCannotRender()
+{
+    TestWidget widget;
+    widget.show();
+    QVERIFY(QTest::qWaitForWindowExposed(&widget));
+    QCoreApplication::processEvents();
+
+    QFuture<QImage> future = widget.grabTextureAsync();
+    QVERIFY(!future.isFinished());
+    widget.setUpdatesEnabled(false);
+    widget.paintFrame();
+    QVERIFY(future.isFinished());
+    QVERIFY(future.result().isNull());
+}
+
+void tst_QRhiWidget::threadedGrab()
+{
+    ThreadedTestWidget widget;
+    widget.setExplicitSize(QSize(32, 16));
+    const QImage image = widget.grabTexture();
+    QVERIFY(!image.isNull());
+    QCOMPARE(image.size(), QSize(32, 16));
+    QCOMPARE(widget.renderCount, 1);
+    QCOMPARE(widget.synchronizeCount, 1);
+    QCOMPARE(widget.synchronizeThread, QThread::currentThread());
+    QVERIFY(widget.renderThread);
+    QVERIFY(widget.renderThread != QThread::currentThread());
+    QVERIFY(widget.isThreadedRenderingEnabled());
+}
+
+void tst_QRhiWidget::threadedPaintDoesNotWait()
+{
+    ThreadedTestWidget widget;
+    widget.setExplicitSize(QSize(32, 16));
+    widget.blockRender = true;
+
+    // the paint event only starts the frame, render() is still held up on
+    // the render thread when it returns
+    widget.paintFrame();
+    QCOMPARE(widget.synchronizeCount, 1);
+    QCOMPARE(widget.renderCount, 0);
+    widget.renderGate.release();
+
+    // a grab hands back the frame in flight first, then renders one more
+    widget.renderGate.release();
+    const QImage image = widget.grabTexture();
+    QVERIFY(!image.isNull());
+    QCOMPARE(widget.renderCount, 2);
+    QCOMPARE(widget.synchronizeCount, 2);
+    QVERIFY(widget.renderThread != QThread::currentThread());
+}
+
+QTEST_MAIN(tst_QRhiWidget)
+
+#include "tst_rhiwidget.moc"
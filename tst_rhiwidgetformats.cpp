@@ -0,0 +1,241 @@
+#include <QTest>
+#include <QRandomGenerator>
+#include <QFloat16>
+#include "rhiwidgetformats_p.h"
+
+using namespace QRhiWidgetFormats;
+
+class tst_QRhiWidgetFormats : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void kernels_data();
+    void kernels();
+    void premultiplyRounding();
+    void imageFormats_data();
+    void imageFormats();
+    void premultiply();
+    void unpremultiply();
+};
+
+template <typename T>
+static std::vector<T> randomData(qsizetype count)
+{
+    std::vector<T> data(count);
+    QRandomGenerator rng(quint32(count));
+    rng.fillRange(reinterpret_cast<quint32 *>(data.data()), count * sizeof(T) / sizeof(quint32));
+    return data;
+}
+
+// Tails of every length below the widest vector, around multiples of it,
+// and a long run, with the kernels writing into the middle of a buffer so
+// that writing past either end is caught as well.
+void tst_QRhiWidgetFormats::kernels_data()
+{
+    QTest::addColumn<int>("count");
+    for (int count : { 0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 33, 1001 })
+        QTest::addRow("%d", count) << count;
+}
+
+void tst_QRhiWidgetFormats::kernels()
+{
+    QFETCH(int, count);
+    static const int GUARD = 64;
+    const QList<KernelSet> sets = kernelSets();
+    QVERIFY(!sets.isEmpty());
+    const KernelSet &scalar(sets.first());
+
+    const auto check = [&](const char *kernel, auto run, qsizetype srcBytes, qsizetype dstBytes) {
+        std::vector<quint32> src = randomData<quint32>((srcBytes + 3) / 4 + 1);
+        std::vector<uchar> expected(dstBytes + 2 * GUARD, 0xCD);
+        run(scalar, expected.data() + GUARD, reinterpret_cast<const uchar *>(src.data()));
+        for (const KernelSet &set : sets) {
+            std::vector<uchar> actual(dstBytes + 2 * GUARD, 0xCD);
+            run(set, actual.data() + GUARD, reinterpret_cast<const uchar *>(src.data()));
+            if (actual != expected)
+                QFAIL(qPrintable(QString::asprintf("%s: %s differs from scalar", kernel, set.name)));
+        }
+    };
+
+    check("convertRG8ToRGBX8888", [count](const KernelSet &set, uchar *dst, const uchar *src) {
+        set.convertRG8ToRGBX8888(dst, src, count);
+    }, count * 2, count * 4);
+    check("convertRG16ToRGBX64", [count](const KernelSet &set, uchar *dst, const uchar *src) {
+        set.convertRG16ToRGBX64(reinterpret_cast<quint16 *>(dst), reinterpret_cast<const quint16 *>(src), count);
+    }, count * 4, count * 8);
+    check("convertR16FToRGBX16F", [count](const KernelSet &set, uchar *dst, const uchar *src) {
+        set.convertR16FToRGBX16F(reinterpret_cast<quint16 *>(dst), reinterpret_cast<const quint16 *>(src), count);
+    }, count * 2, count * 8);
+    check("convertR32FToRGBX32F", [count](const KernelSet &set, uchar *dst, const uchar *src) {
+        set.convertR32FToRGBX32F(reinterpret_cast<float *>(dst), reinterpret_cast<const float *>(src), count);
+    }, count * 4, count * 16);
+    check("premultiply8888", [count](const KernelSet &set, uchar *dst, const uchar *src) {
+        memcpy(dst, src, count * 4);
+        set.premultiply8888(dst, count);
+    }, count * 4, count * 4);
+}
+
+void tst_QRhiWidgetFormats::premultiplyRounding()
+{
+    // the scalar kernel, and so all others, round exactly like qPremultiply()
+    const KernelSet &scalar(kernelSets().first());
+    std::vector<uchar> data;
+    std::vector<QRgb> expected;
+    for (int a = 0; a < 256; ++a) {
+        for (int c = 0; c < 256; ++c) {
+            data.insert(data.end(), { uchar(c), uchar(255 - c), uchar(c / 2), uchar(a) });
+            expected.push_back(qPremultiply(qRgba(c, 255 - c, c / 2, a)));
+        }
+    }
+    scalar.premultiply8888(data.data(), qsizetype(expected.size()));
+    for (size_t i = 0; i < expected.size(); ++i) {
+        const uchar *px = data.data() + i * 4;
+        QCOMPARE(qRgba(px[0], px[1], px[2], px[3]), expected[i]);
+    }
+}
+
+// A texture of 5x3 pixels, odd so that the rows of the narrow formats are
+// not 32-bit aligned, with every pixel holding the same value.
+static QByteArray textureData(const QByteArray &pixel, int width = 5, int height = 3)
+{
+    return pixel.repeated(width * height);
+}
+
+template <typename T>
+static QByteArray pixelBytes(std::initializer_list<T> channels)
+{
+    QByteArray bytes;
+    for (T c : channels)
+        bytes.append(reinterpret_cast<const char *>(&c), sizeof(T));
+    return bytes;
+}
+
+void tst_QRhiWidgetFormats::imageFormats_data()
+{
+    // as int, the enums are not registered metatypes
+    QTest::addColumn<int>("formatValue");
+    QTest::addColumn<QByteArray>("pixel");
+    QTest::addColumn<int>("imageFormatValue");
+    QTest::addColumn<QByteArray>("imagePixel");
+
+    const QByteArray rgba = pixelBytes<quint8>({ 10, 20, 30, 40 });
+    QTest::newRow("RGBA8") << int(QRhiTexture::RGBA8) << rgba << int(QImage::Format_RGBA8888) << rgba;
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    QTest::newRow("BGRA8") << int(QRhiTexture::BGRA8) << pixelBytes<quint8>({ 30, 20, 10, 40 })
+                           << int(QImage::Format_ARGB32) << pixelBytes<quint8>({ 30, 20, 10, 40 });
+#else
+    QTest::newRow("BGRA8") << int(QRhiTexture::BGRA8) << pixelBytes<quint8>({ 30, 20, 10, 40 })
+                           << int(QImage::Format_RGBA8888) << rgba;
+#endif
+    QTest::newRow("R8") << int(QRhiTexture::R8) << pixelBytes<quint8>({ 77 })
+                        << int(QImage::Format_Grayscale8) << pixelBytes<quint8>({ 77 });
+    QTest::newRow("RED_OR_ALPHA8") << int(QRhiTexture::RED_OR_ALPHA8) << pixelBytes<quint8>({ 77 })
+                                   << int(QImage::Format_Grayscale8) << pixelBytes<quint8>({ 77 });
+    QTest::newRow("RG8") << int(QRhiTexture::RG8) << pixelBytes<quint8>({ 10, 20 })
+                         << int(QImage::Format_RGBX8888) << pixelBytes<quint8>({ 10, 20, 0, 255 });
+    QTest::newRow("R16") << int(QRhiTexture::R16) << pixelBytes<quint16>({ 1000 })
+                         << int(QImage::Format_Grayscale16) << pixelBytes<quint16>({ 1000 });
+    QTest::newRow("RG16") << int(QRhiTexture::RG16) << pixelBytes<quint16>({ 1000, 2000 })
+                          << int(QImage::Format_RGBX64) << pixelBytes<quint16>({ 1000, 2000, 0, 65535 });
+    const QByteArray rgba16f = pixelBytes<qfloat16>({ qfloat16(0.5f), qfloat16(0.25f), qfloat16(1.0f), qfloat16(0.5f) });
+    QTest::newRow("RGBA16F") << int(QRhiTexture::RGBA16F) << rgba16f << int(QImage::Format_RGBA16FPx4) << rgba16f;
+    const QByteArray rgba32f = pixelBytes<float>({ 0.5f, 0.25f, 2.0f, 0.5f });
+    QTest::newRow("RGBA32F") << int(QRhiTexture::RGBA32F) << rgba32f << int(QImage::Format_RGBA32FPx4) << rgba32f;
+    QTest::newRow("R16F") << int(QRhiTexture::R16F) << pixelBytes<qfloat16>({ qfloat16(0.75f) })
+                          << int(QImage::Format_RGBX16FPx4)
+                          << pixelBytes<qfloat16>({ qfloat16(0.75f), qfloat16(0.0f), qfloat16(0.0f), qfloat16(1.0f) });
+    QTest::newRow("R32F") << int(QRhiTexture::R32F) << pixelBytes<float>({ -3.5f })
+                          << int(QImage::Format_RGBX32FPx4) << pixelBytes<float>({ -3.5f, 0.0f, 0.0f, 1.0f });
+    const QByteArray rgb10a2 = pixelBytes<quint32>({ (3u << 30) | (1023u << 20) | (512u << 10) | 1u });
+    QTest::newRow("RGB10A2") << int(QRhiTexture::RGB10A2) << rgb10a2 << int(QImage::Format_A2BGR30_Premultiplied) << rgb10a2;
+}
+
+static void verifyPixels(const QImage &image, const QByteArray &imagePixel)
+{
+    QCOMPARE(image.size(), QSize(5, 3));
+    for (int y = 0; y < image.height(); ++y) {
+        const QByteArray row(reinterpret_cast<const char *>(image.constScanLine(y)), 5 * imagePixel.size());
+        QCOMPARE(row, imagePixel.repeated(5));
+    }
+}
+
+void tst_QRhiWidgetFormats::imageFormats()
+{
+    QFETCH(int, formatValue);
+    QFETCH(QByteArray, pixel);
+    QFETCH(int, imageFormatValue);
+    QFETCH(QByteArray, imagePixel);
+    const QRhiTexture::Format format = QRhiTexture::Format(formatValue);
+    const QImage::Format imageFormat = QImage::Format(imageFormatValue);
+
+    QCOMPARE(bytesPerPixel(format), pixel.size());
+    QCOMPARE(QRhiWidgetFormats::imageFormat(format), imageFormat);
+
+    const QByteArray data = textureData(pixel);
+    const qsizetype bytesPerLine = 5 * pixel.size();
+
+    const QImage copied = imageFromTextureData(reinterpret_cast<const uchar *>(data.constData()), QSize(5, 3),
+                                               bytesPerLine, format, NoAlphaConversion);
+    QCOMPARE(copied.format(), imageFormat);
+    verifyPixels(copied, imagePixel);
+
+    QByteArray adopted = data;
+    const QImage taken = imageFromTextureData(std::move(adopted), QSize(5, 3), bytesPerLine, format, NoAlphaConversion);
+    QCOMPARE(taken.format(), imageFormat);
+    verifyPixels(taken, imagePixel);
+
+    QImage reused;
+    QVERIFY(convertTextureData(&reused, reinterpret_cast<const uchar *>(data.constData()), QSize(5, 3),
+                               bytesPerLine, format, NoAlphaConversion));
+    QCOMPARE(reused.format(), imageFormat);
+    verifyPixels(reused, imagePixel);
+    // and once more into the same image
+    const uchar *bits = reused.constBits();
+    QVERIFY(convertTextureData(&reused, reinterpret_cast<const uchar *>(data.constData()), QSize(5, 3),
+                               bytesPerLine, format, NoAlphaConversion));
+    QCOMPARE(reused.constBits(), bits);
+    verifyPixels(reused, imagePixel);
+}
+
+void tst_QRhiWidgetFormats::premultiply()
+{
+    const QByteArray data = textureData(pixelBytes<quint8>({ 200, 100, 50, 128 }));
+    const QRgb expected = qPremultiply(qRgba(200, 100, 50, 128));
+    const QByteArray expectedPixel = pixelBytes<quint8>({ quint8(qRed(expected)), quint8(qGreen(expected)),
+                                                          quint8(qBlue(expected)), 128 });
+
+    const QImage image = imageFromTextureData(reinterpret_cast<const uchar *>(data.constData()), QSize(5, 3),
+                                              5 * 4, QRhiTexture::RGBA8, PremultiplyAlpha);
+    QCOMPARE(image.format(), QImage::Format_RGBA8888_Premultiplied);
+    verifyPixels(image, expectedPixel);
+
+    QByteArray adopted = data;
+    const QImage taken = imageFromTextureData(std::move(adopted), QSize(5, 3), 5 * 4,
+                                              QRhiTexture::RGBA8, PremultiplyAlpha);
+    QCOMPARE(taken.format(), QImage::Format_RGBA8888_Premultiplied);
+    verifyPixels(taken, expectedPixel);
+
+    QCOMPARE(QRhiWidgetFormats::imageFormat(QRhiTexture::RGBA16F, PremultiplyAlpha),
+             QImage::Format_RGBA16FPx4_Premultiplied);
+    // without alpha, nothing to premultiply
+    QCOMPARE(QRhiWidgetFormats::imageFormat(QRhiTexture::RG8, PremultiplyAlpha), QImage::Format_RGBX8888);
+}
+
+void tst_QRhiWidgetFormats::unpremultiply()
+{
+    const QByteArray data = textureData(pixelBytes<quint8>({ 100, 50, 25, 128 }));
+    const QRgb expected = qUnpremultiply(qRgba(100, 50, 25, 128));
+
+    const QImage image = imageFromTextureData(reinterpret_cast<const uchar *>(data.constData()), QSize(5, 3),
+                                              5 * 4, QRhiTexture::RGBA8, UnpremultiplyAlpha);
+    QCOMPARE(image.format(), QImage::Format_RGBA8888);
+    for (int y = 0; y < image.height(); ++y) {
+        for (int x = 0; x < image.width(); ++x)
+            QCOMPARE(image.pixel(x, y), expected);
+    }
+}
+
+QTEST_MAIN(tst_QRhiWidgetFormats)
+
+#include "tst_rhiwidgetformats.moc"
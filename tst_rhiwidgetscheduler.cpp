@@ -0,0 +1,186 @@
+#include <QTest>
+#include "rhiwidget.h"
+#include "rhiwidgetscheduler_p.h"
+
+// Drives the scheduler of a window with a fake clock, calling tick()
+// directly, and counts the paint events the widgets get in response.
+
+static const qint64 MSEC = 1000000;
+
+class FakeClock : public QRhiWidgetSchedulerClock
+{
+public:
+    qint64 nsecsElapsed() const override { return now; }
+    void setTickInterval(qint64 intervalNsecs) override { tickInterval = intervalNsecs; }
+
+    qint64 now = 0;
+    qint64 tickInterval = 0;
+};
+
+class CountingWidget : public QRhiWidget
+{
+public:
+    CountingWidget(QWidget *parent)
+        : QRhiWidget(parent)
+    {
+        setApi(QRhiWidget::Null);
+        setUpdateBehavior(QRhiWidget::CappedUpdates);
+        setMaximumFrameRate(50);
+    }
+
+    int paintCount = 0;
+
+protected:
+    void paintEvent(QPaintEvent *) override
+    {
+        ++paintCount;
+    }
+};
+
+class tst_QRhiWidgetScheduler : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+    void coalescing();
+    void frameRateCap();
+    void budgetRoundRobin();
+    void hiddenWidgetsSkipped();
+
+private:
+    void tickAt(qint64 nsecs);
+    QList<int> takePaintCounts();
+
+    QWidget *window = nullptr;
+    QList<CountingWidget *> widgets;
+    FakeClock *clock = nullptr;
+    QRhiWidgetScheduler *scheduler = nullptr;
+};
+
+void tst_QRhiWidgetScheduler::init()
+{
+    window = new QWidget;
+    window->resize(300, 100);
+    scheduler = QRhiWidgetScheduler::forWindow(window);
+    clock = new FakeClock;
+    scheduler->setClock(std::unique_ptr<QRhiWidgetSchedulerClock>(clock));
+    widgets.clear();
+    for (int i = 0; i < 3; ++i) {
+        CountingWidget *widget = new CountingWidget(window);
+        widget->setGeometry(i * 100, 0, 100, 100);
+        widgets.append(widget);
+    }
+    window->show();
+    QVERIFY(QTest::qWaitForWindowExposed(window));
+    QCoreApplication::processEvents();
+    takePaintCounts();
+}
+
+void tst_QRhiWidgetScheduler::cleanup()
+{
+    delete window;
+    window = nullptr;
+}
+
+void tst_QRhiWidgetScheduler::tickAt(qint64 nsecs)
+{
+    clock->now = nsecs;
+    scheduler->tick();
+    QCoreApplication::processEvents();
+}
+
+QList<int> tst_QRhiWidgetScheduler::takePaintCounts()
+{
+    QList<int> counts;
+    for (CountingWidget *widget : std::as_const(widgets)) {
+        counts.append(widget->paintCount);
+        widget->paintCount = 0;
+    }
+    return counts;
+}
+
+void tst_QRhiWidgetScheduler::coalescing()
+{
+    // one timer for all widgets, at the highest of their frame rates
+    widgets[2]->setMaximumFrameRate(25);
+    QCOMPARE(clock->tickInterval, 20 * MSEC);
+
+    // all widgets that are due get their update in the same tick, and so
+    // get painted in the same repaint of the window
+    tickAt(0);
+    QCOMPARE(takePaintCounts(), QList<int>({ 1, 1, 1 }));
+    tickAt(20 * MSEC);
+    QCOMPARE(takePaintCounts(), QList<int>({ 1, 1, 0 }));
+    tickAt(40 * MSEC);
+    QCOMPARE(takePaintCounts(), QList<int>({ 1, 1, 1 }));
+
+    // nothing is due in between
+    tickAt(45 * MSEC);
+    QCOMPARE(takePaintCounts(), QList<int>({ 0, 0, 0 }));
+}
+
+void tst_QRhiWidgetScheduler::frameRateCap()
+{
+    // ticking far more often than the cap does not render more often
+    for (qint64 t = 0; t < 1000 * MSEC; t += 5 * MSEC)
+        tickAt(t);
+    QCOMPARE(takePaintCounts(), QList<int>({ 50, 50, 50 }));
+
+    // falling behind does not lead to catching up with a burst
+    tickAt(2000 * MSEC);
+    tickAt(2005 * MSEC);
+    tickAt(2010 * MSEC);
+    QCOMPARE(takePaintCounts(), QList<int>({ 1, 1, 1 }));
+}
+
+void tst_QRhiWidgetScheduler::budgetRoundRobin()
+{
+    // only one 10 ms frame fits into the 15 ms budget per tick
+    scheduler->setFrameBudget(15 * MSEC);
+    for (CountingWidget *widget : std::as_const(widgets))
+        scheduler->reportFrameCost(widget, 10 * MSEC);
+
+    // the widgets that did not fit get their turn first in the next tick
+    tickAt(0);
+    QCOMPARE(takePaintCounts(), QList<int>({ 1, 0, 0 }));
+    tickAt(20 * MSEC);
+    QCOMPARE(takePaintCounts(), QList<int>({ 0, 1, 0 }));
+    tickAt(40 * MSEC);
+    QCOMPARE(takePaintCounts(), QList<int>({ 0, 0, 1 }));
+    tickAt(60 * MSEC);
+    QCOMPARE(takePaintCounts(), QList<int>({ 1, 0, 0 }));
+
+    // cheap frames all fit
+    for (CountingWidget *widget : std::as_const(widgets))
+        scheduler->reportFrameCost(widget, 4 * MSEC);
+    tickAt(80 * MSEC);
+    tickAt(100 * MSEC);
+    QCOMPARE(takePaintCounts(), QList<int>({ 2, 2, 2 }));
+}
+
+void tst_QRhiWidgetScheduler::hiddenWidgetsSkipped()
+{
+    // a hidden widget leaves the scheduler, one moved out of the window's
+    // area stays but is not updated while it has nothing visible
+    widgets[0]->hide();
+    widgets[1]->move(1000, 0);
+    QCoreApplication::processEvents();
+    takePaintCounts();
+
+    tickAt(0);
+    tickAt(20 * MSEC);
+    QCOMPARE(takePaintCounts(), QList<int>({ 0, 0, 2 }));
+
+    widgets[0]->show();
+    widgets[1]->move(100, 0);
+    QCoreApplication::processEvents();
+    takePaintCounts();
+    tickAt(40 * MSEC);
+    QCOMPARE(takePaintCounts(), QList<int>({ 1, 1, 1 }));
+}
+
+QTEST_MAIN(tst_QRhiWidgetScheduler)
+
+#include "tst_rhiwidgetscheduler.moc"